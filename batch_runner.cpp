@@ -0,0 +1,264 @@
+#include "batch_runner.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include "metrics_evaluator.h"
+#include "metrics_report.h"
+#include "string_utils.h"
+extern "C" {
+#include <libavutil/dict.h>
+#include <libavutil/pixdesc.h>
+}
+
+// reference frames a decoder may hold on top of one frame per thread
+static constexpr size_t DECODER_REFERENCE_FRAMES = 16;
+
+// file names and error messages may contain separators
+static std::string csv_field(const std::string& value) {
+  if (value.find_first_of(",\"\r\n") == std::string::npos) {
+    return value;
+  }
+
+  std::string quoted = "\"";
+
+  for (const char c : value) {
+    quoted += c == '"' ? "\"\"" : std::string(1, c);
+  }
+
+  return quoted + "\"";
+}
+
+static std::vector<std::string> split_fields(const std::string& line) {
+  std::vector<std::string> fields;
+  size_t start = 0;
+
+  while (true) {
+    const size_t separator = line.find('\t', start);
+
+    fields.push_back(line.substr(start, separator - start));
+
+    if (separator == std::string::npos) {
+      return fields;
+    }
+
+    start = separator + 1;
+  }
+}
+
+BatchRunner::BatchRunner(const VideoCompareConfig& config, const std::string& jobs_file_name, const std::string& report_file_name, const size_t parallel_jobs, const size_t memory_budget)
+    : config_{config}, report_file_name_{report_file_name}, parallel_jobs_{parallel_jobs}, memory_budget_{memory_budget} {
+  std::ifstream jobs_file(jobs_file_name);
+
+  if (!jobs_file) {
+    throw std::runtime_error(string_sprintf("Could not open jobs file: %s", jobs_file_name.c_str()));
+  }
+
+  std::string line;
+  size_t line_number = 0;
+
+  while (std::getline(jobs_file, line)) {
+    line_number++;
+
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+
+    const std::vector<std::string> fields = split_fields(line);
+
+    if (fields.size() < 2 || fields.size() > 3 || fields[0].empty() || fields[1].empty()) {
+      throw std::runtime_error(string_sprintf("Malformed job on line %zu of %s (required format: LEFT<tab>RIGHT[<tab>METRICS])", line_number, jobs_file_name.c_str()));
+    }
+
+    Job job;
+    job.line = line_number;
+    job.left_file_name = fields[0];
+    job.right_file_name = fields[1];
+    job.metrics_file_name = fields.size() == 3 ? fields[2] : "";
+
+    jobs_.push_back(job);
+  }
+
+  if (jobs_.empty()) {
+    throw std::runtime_error(string_sprintf("No jobs in %s", jobs_file_name.c_str()));
+  }
+
+  threads_per_job_ = std::max(1, static_cast<int>(std::thread::hardware_concurrency() / parallel_jobs_));
+
+  // a third of the share for each decoder and the rest for the metric workers
+  decoder_threads_ = std::max(1, threads_per_job_ / 3);
+  metric_threads_ = std::max(1, threads_per_job_ - 2 * decoder_threads_);
+}
+
+void BatchRunner::reserve_memory(const size_t memory) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  // a job larger than the whole budget runs on its own
+  memory_released_.wait(lock, [&]() { return memory_budget_ == 0 || memory_in_use_ == 0 || memory_in_use_ + memory <= memory_budget_; });
+
+  memory_in_use_ += memory;
+}
+
+void BatchRunner::release_memory(const size_t memory) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_in_use_ -= memory;
+  }
+
+  memory_released_.notify_all();
+}
+
+void BatchRunner::run(Job& job) {
+  const auto start_time = std::chrono::steady_clock::now();
+
+  VideoCompareConfig job_config = config_;
+  job_config.left.file_name = job.left_file_name;
+  job_config.right.file_name = job.right_file_name;
+
+  // decoders get their part of the job's share of the cores unless their threads are set explicitly
+  AVDictionary* left_decoder_options = nullptr;
+  AVDictionary* right_decoder_options = nullptr;
+
+  av_dict_copy(&left_decoder_options, config_.left.decoder_options, 0);
+  av_dict_copy(&right_decoder_options, config_.right.decoder_options, 0);
+  av_dict_set_int(&left_decoder_options, "threads", decoder_threads_, AV_DICT_DONT_OVERWRITE);
+  av_dict_set_int(&right_decoder_options, "threads", decoder_threads_, AV_DICT_DONT_OVERWRITE);
+
+  job_config.left.decoder_options = left_decoder_options;
+  job_config.right.decoder_options = right_decoder_options;
+
+  try {
+    MetricsEvaluator evaluator{job_config, job.metrics_file_name, 1, false, metric_threads_};
+    evaluator.set_print_summary(false);
+
+    const size_t memory = evaluator.estimated_frame_memory(decoder_threads_ + DECODER_REFERENCE_FRAMES);
+
+    reserve_memory(memory);
+
+    try {
+      job.measured = evaluator();
+    } catch (...) {
+      release_memory(memory);
+      throw;
+    }
+
+    release_memory(memory);
+
+    job.pixel_format = av_get_pix_fmt_name(evaluator.pixel_format());
+    job.frames = evaluator.accumulator().frames();
+
+    if (job.measured) {
+      job.mean = evaluator.accumulator().mean();
+    }
+  } catch (const std::exception& e) {
+    job.error = e.what();
+  } catch (...) {
+    job.error = "unknown error";
+  }
+
+  // the evaluator's sources made their own copies
+  av_dict_free(&left_decoder_options);
+  av_dict_free(&right_decoder_options);
+
+  job.elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  finished_jobs_++;
+
+  std::string outcome;
+
+  if (!job.error.empty()) {
+    outcome = "failed: " + job.error;
+  } else if (!job.measured) {
+    outcome = "no frame pairs to compute metrics for";
+  } else {
+    outcome = string_sprintf("%zu frames, PSNR-W(%s) MS-SSIM(%.5f)", job.frames, metrics_report::format_psnr(job.mean.weighted_psnr).c_str(), job.mean.ms_ssim);
+  }
+
+  std::cerr << string_sprintf("[%zu/%zu] %s vs %s: %s in %.1f s", finished_jobs_, jobs_.size(), job.left_file_name.c_str(), job.right_file_name.c_str(), outcome.c_str(), job.elapsed) << std::endl;
+}
+
+void BatchRunner::work() {
+  while (true) {
+    size_t job_index;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      if (next_job_ == jobs_.size()) {
+        return;
+      }
+
+      job_index = next_job_++;
+    }
+
+    run(jobs_[job_index]);
+  }
+}
+
+bool BatchRunner::operator()() {
+  std::ofstream report_file;
+
+  if (report_file_name_ != "-") {
+    report_file.open(report_file_name_);
+
+    if (!report_file) {
+      throw std::runtime_error(string_sprintf("Could not open report file for writing: %s", report_file_name_.c_str()));
+    }
+  }
+
+  std::ostream& output = report_file_name_ != "-" ? report_file : std::cout;
+
+  const auto start_time = std::chrono::steady_clock::now();
+
+  const size_t worker_count = std::min(parallel_jobs_, jobs_.size());
+  std::vector<std::thread> workers;
+
+  for (size_t i = 0; i < worker_count; i++) {
+    workers.emplace_back(&BatchRunner::work, this);
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  // planes are numbered, as their names depend on the pixel format of each job
+  output << "job,line,left,right,status,pixel_format,frames,psnr_1,psnr_2,psnr_3,psnr_weighted,ssim_1,ssim_2,ssim_3,ms_ssim,seconds" << std::endl;
+
+  size_t measured_jobs = 0;
+  size_t total_frames = 0;
+
+  for (size_t i = 0; i < jobs_.size(); i++) {
+    const Job& job = jobs_[i];
+
+    output << string_sprintf("%zu,%zu,", i + 1, job.line) << csv_field(job.left_file_name) << "," << csv_field(job.right_file_name) << ",";
+
+    if (!job.error.empty()) {
+      output << csv_field("error: " + job.error) << ",,,,,,,,,,";
+    } else if (!job.measured) {
+      output << "no frames," << job.pixel_format << ",0,,,,,,,,";
+    } else {
+      output << "ok," << job.pixel_format << "," << job.frames << metrics_report::csv_values(job.mean, 3);
+
+      measured_jobs++;
+      total_frames += job.frames;
+    }
+
+    output << string_sprintf(",%.3f", job.elapsed) << std::endl;
+  }
+
+  std::ostream& summary = metrics_report::summary_stream(report_file_name_);
+
+  summary << string_sprintf("Ran %zu jobs, %zu at a time with %d threads each, in %.1f s: %zu measured (%zu frame pairs at %.1f frames/s), %zu failed or without frames", jobs_.size(), worker_count, threads_per_job_, elapsed, measured_jobs,
+                            total_frames, total_frames / std::max(elapsed, 1e-6), jobs_.size() - measured_jobs)
+          << std::endl;
+
+  return measured_jobs == jobs_.size();
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "metrics_engine.h"
+
+// Headless evaluation of many (left, right) pairs listed in a job file, within one process. A fixed number of jobs
+// runs at a time, each measured as by MetricsEvaluator with an equal share of the cores: a third of it for each of
+// the two decoders and the rest for the metric workers, so running many comparisons side by side does not
+// oversubscribe the CPU. Jobs wait to start while their estimated frame memory would exceed the budget. The
+// clip-level metrics of all jobs form a single report.
+class BatchRunner {
+ public:
+  static constexpr size_t DEFAULT_MEMORY_BUDGET_MIB = 4096;
+
+  // the job file has one job per line: the left file, the right file and optionally a file for the per-frame
+  // metrics, separated by tabs; empty lines and lines starting with '#' are ignored. Inputs take their other
+  // settings from config. A memory budget of 0 is unbounded.
+  BatchRunner(const VideoCompareConfig& config, const std::string& jobs_file_name, const std::string& report_file_name, const size_t parallel_jobs, const size_t memory_budget);
+
+  // writes one CSV row of clip-level metrics per job and prints a summary; returns false if any job failed or
+  // had no frame pair to measure
+  bool operator()();
+
+ private:
+  struct Job {
+    size_t line;
+
+    std::string left_file_name;
+    std::string right_file_name;
+    std::string metrics_file_name;
+
+    bool measured{false};
+    std::string error;
+
+    std::string pixel_format;
+    size_t frames{0};
+    FrameMetrics mean;
+
+    double elapsed{0};
+  };
+
+  void work();
+  void run(Job& job);
+
+  // blocks until the memory can be taken from the budget, or nothing else holds any
+  void reserve_memory(const size_t memory);
+  void release_memory(const size_t memory);
+
+  const VideoCompareConfig& config_;
+  const std::string report_file_name_;
+  const size_t parallel_jobs_;
+  const size_t memory_budget_;
+
+  // the cores of a job, split between each of its decoders and its metric workers
+  int threads_per_job_;
+  int decoder_threads_;
+  int metric_threads_;
+
+  std::vector<Job> jobs_;
+
+  std::mutex mutex_;
+  std::condition_variable memory_released_;
+  size_t next_job_{0};
+  size_t finished_jobs_{0};
+  size_t memory_in_use_{0};
+};
@@ -0,0 +1,193 @@
+#include "bit_exact_verifier.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include "ffmpeg.h"
+#include "string_utils.h"
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+static constexpr size_t QUEUE_SIZE = 8;
+
+// mismatches are reported in blocks of this many pixels squared
+static constexpr int BLOCK_SIZE = 16;
+
+static auto avpacket_deleter = [](AVPacket* packet) {
+  av_packet_unref(packet);
+  delete packet;
+};
+
+static auto avframe_deleter = [](AVFrame* frame) { av_frame_free(&frame); };
+
+BitExactVerifier::BitExactVerifier(const VideoCompareConfig& config)
+    : demuxers_{std::make_unique<Demuxer>(LEFT, config.left.demuxer, config.left.file_name, config.left.demuxer_options, config.left.decoder_options, config.read_ahead_size, config.memory_mapped_input, config.verbose),
+                std::make_unique<Demuxer>(RIGHT, config.right.demuxer, config.right.file_name, config.right.demuxer_options, config.right.decoder_options, config.read_ahead_size, config.memory_mapped_input, config.verbose)},
+      video_decoders_{
+          std::make_unique<VideoDecoder>(LEFT, config.left.decoder, config.left.hw_accel_spec, demuxers_[LEFT]->video_codec_parameters(), config.left.peak_luminance_nits, config.left.hw_accel_options, config.left.decoder_options),
+          std::make_unique<VideoDecoder>(RIGHT, config.right.decoder, config.right.hw_accel_spec, demuxers_[RIGHT]->video_codec_parameters(), config.right.peak_luminance_nits, config.right.hw_accel_options, config.right.decoder_options)},
+      frame_queues_{std::make_unique<FrameQueue>(QUEUE_SIZE), std::make_unique<FrameQueue>(QUEUE_SIZE)} {}
+
+bool BitExactVerifier::operator()() {
+  std::thread left_decoder(&BitExactVerifier::decode, this, LEFT);
+  std::thread right_decoder(&BitExactVerifier::decode, this, RIGHT);
+
+  std::string difference;
+  uint64_t frame_number = 0;
+
+  for (;; frame_number++) {
+    std::shared_ptr<AVFrame> left_frame;
+    std::shared_ptr<AVFrame> right_frame;
+
+    const bool has_left_frame = frame_queues_[LEFT]->pop(left_frame);
+    const bool has_right_frame = frame_queues_[RIGHT]->pop(right_frame);
+
+    if (!has_left_frame && !has_right_frame) {
+      break;
+    }
+    if (!has_left_frame || !has_right_frame) {
+      difference = string_sprintf("%s input ends after %llu frames", has_left_frame ? "Right" : "Left", static_cast<unsigned long long>(frame_number));
+      break;
+    }
+
+    difference = find_difference(left_frame.get(), right_frame.get());
+
+    if (!difference.empty()) {
+      difference = string_sprintf("Frame %llu (left %s, right %s): %s", static_cast<unsigned long long>(frame_number), format_position(left_frame->pts * av_q2d(demuxers_[LEFT]->time_base()), false).c_str(),
+                                  format_position(right_frame->pts * av_q2d(demuxers_[RIGHT]->time_base()), false).c_str(), difference.c_str());
+      break;
+    }
+  }
+
+  // unblock decoders still running after a mismatch
+  frame_queues_[LEFT]->quit();
+  frame_queues_[RIGHT]->quit();
+
+  left_decoder.join();
+  right_decoder.join();
+
+  for (auto& exception : exceptions_) {
+    if (exception != nullptr) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+  if (!difference.empty()) {
+    std::cout << "MISMATCH: " << difference << std::endl;
+    return false;
+  }
+
+  std::cout << "BIT-EXACT: " << frame_number << " frames are identical" << std::endl;
+  return true;
+}
+
+void BitExactVerifier::decode(const Side side) {
+  ScopedLogSide scoped_log_side(side);
+
+  auto receive_frames = [&]() {
+    while (true) {
+      std::shared_ptr<AVFrame> frame{av_frame_alloc(), avframe_deleter};
+
+      if (!video_decoders_[side]->receive(frame.get(), demuxers_[side].get())) {
+        return true;
+      }
+
+      if (frame->format == video_decoders_[side]->hw_pixel_format()) {
+        std::shared_ptr<AVFrame> sw_frame{av_frame_alloc(), avframe_deleter};
+
+        // Transfer data from GPU to CPU
+        if (av_hwframe_transfer_data(sw_frame.get(), frame.get(), 0) < 0) {
+          throw std::runtime_error("Error transferring frame from GPU to CPU");
+        }
+        if (av_frame_copy_props(sw_frame.get(), frame.get()) < 0) {
+          throw std::runtime_error("Copying SW frame properties");
+        }
+
+        frame = sw_frame;
+      }
+
+      if (!frame_queues_[side]->push(frame)) {
+        return false;
+      }
+    }
+  };
+
+  try {
+    while (true) {
+      std::unique_ptr<AVPacket, decltype(avpacket_deleter)> packet{new AVPacket, avpacket_deleter};
+      av_init_packet(packet.get());
+      packet->data = nullptr;
+
+      if (!(*demuxers_[side])(*packet)) {
+        // drain the decoder
+        video_decoders_[side]->send(nullptr);
+        receive_frames();
+        break;
+      }
+      if (packet->stream_index != demuxers_[side]->video_stream_index()) {
+        continue;
+      }
+
+      // receive frames until the packet is accepted
+      while (!video_decoders_[side]->send(packet.get())) {
+        if (!receive_frames()) {
+          return;
+        }
+      }
+      if (!receive_frames()) {
+        return;
+      }
+    }
+  } catch (...) {
+    exceptions_[side] = std::current_exception();
+    frame_queues_[LEFT]->quit();
+    frame_queues_[RIGHT]->quit();
+  }
+
+  frame_queues_[side]->stop();
+}
+
+std::string BitExactVerifier::find_difference(const AVFrame* left_frame, const AVFrame* right_frame) const {
+  if (left_frame->format != right_frame->format) {
+    return string_sprintf("pixel formats differ (%s vs. %s)", av_get_pix_fmt_name(static_cast<AVPixelFormat>(left_frame->format)), av_get_pix_fmt_name(static_cast<AVPixelFormat>(right_frame->format)));
+  }
+  if (left_frame->width != right_frame->width || left_frame->height != right_frame->height) {
+    return string_sprintf("dimensions differ (%dx%d vs. %dx%d)", left_frame->width, left_frame->height, right_frame->width, right_frame->height);
+  }
+
+  const AVPixelFormat pixel_format = static_cast<AVPixelFormat>(left_frame->format);
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(pixel_format);
+
+  int row_sizes[4];
+  ffmpeg::check(av_image_fill_linesizes(row_sizes, pixel_format, left_frame->width));
+
+  for (int plane = 0; plane < av_pix_fmt_count_planes(pixel_format); plane++) {
+    const bool is_chroma_plane = (plane == 1 || plane == 2) && !(descriptor->flags & AV_PIX_FMT_FLAG_RGB);
+    const int plane_width = is_chroma_plane ? -((-left_frame->width) >> descriptor->log2_chroma_w) : left_frame->width;
+    const int plane_height = is_chroma_plane ? -((-left_frame->height) >> descriptor->log2_chroma_h) : left_frame->height;
+
+    for (int y = 0; y < plane_height; y++) {
+      const uint8_t* left_row = left_frame->data[plane] + static_cast<ptrdiff_t>(y) * left_frame->linesize[plane];
+      const uint8_t* right_row = right_frame->data[plane] + static_cast<ptrdiff_t>(y) * right_frame->linesize[plane];
+
+      // libc's memcmp is vectorized; only locate the exact position once a row differs
+      if (memcmp(left_row, right_row, row_sizes[plane]) == 0) {
+        continue;
+      }
+
+      int offset = 0;
+
+      while (left_row[offset] == right_row[offset]) {
+        offset++;
+      }
+
+      const int x = offset / std::max(row_sizes[plane] / plane_width, 1);
+
+      return string_sprintf("plane %d differs first in block (%d, %d) of %dx%d pixels, at pixel (%d, %d)", plane, x / BLOCK_SIZE, y / BLOCK_SIZE, BLOCK_SIZE, BLOCK_SIZE, x, y);
+    }
+  }
+
+  return "";
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <array>
+#include <exception>
+#include <memory>
+#include <string>
+#include "config.h"
+#include "core_types.h"
+#include "demuxer.h"
+#include "queue.h"
+#include "video_decoder.h"
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Headless check whether both inputs decode to identical frames. The decoded planes are compared right after
+// decoding, without filtering or conversion, so verification runs at decoding speed.
+class BitExactVerifier {
+ public:
+  explicit BitExactVerifier(const VideoCompareConfig& config);
+
+  // true if all frames are identical; otherwise the first difference is reported
+  bool operator()();
+
+ private:
+  using FrameQueue = Queue<std::shared_ptr<AVFrame>>;
+
+  void decode(const Side side);
+
+  // empty if the frames are identical
+  std::string find_difference(const AVFrame* left_frame, const AVFrame* right_frame) const;
+
+  const std::array<std::unique_ptr<Demuxer>, Side::Count> demuxers_;
+  const std::array<std::unique_ptr<VideoDecoder>, Side::Count> video_decoders_;
+  const std::array<std::unique_ptr<FrameQueue>, Side::Count> frame_queues_;
+
+  std::array<std::exception_ptr, Side::Count> exceptions_;
+};
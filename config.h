@@ -43,8 +43,10 @@ struct VideoCompareConfig {
   bool high_dpi_allowed{false};
   bool use_10_bpc{false};
   bool fast_input_alignment{false};
+  bool adaptive_resolution{false};
   bool bilinear_texture_filtering{false};
   bool disable_auto_filters{false};
+  bool tone_map_lut{false};
 
   int display_number{0};
   std::tuple<int, int> window_size{-1, -1};
@@ -54,8 +56,18 @@ struct VideoCompareConfig {
 
   size_t frame_buffer_size{50};
 
+  // images decoded ahead in parallel for image sequences; -1 for automatic, 0 disables parallel decoding
+  int sequence_lookahead{-1};
+
+  // in bytes, 0 disables read-ahead
+  size_t read_ahead_size{0};
+  bool memory_mapped_input{false};
+
   TimeShiftConfig time_shift;
 
+  // per-frame metric scores are cached in this file if set
+  std::string metrics_database_file_name;
+
   float wheel_sensitivity{1};
 
   InputVideo left{Side::LEFT, "Left"};
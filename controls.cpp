@@ -39,7 +39,8 @@ static const std::vector<std::pair<std::string, std::string>> controls{{"H", "To
                                                                        {"-", "Time-shift right video 1 frame backward"},
                                                                        {"X", "Show the current video frame and UI update rates (in FPS)"},
                                                                        {"Y", "Cycle through subtraction modes"},
-                                                                       {"U", "Toggle luminance-only subtraction mode"}};
+                                                                       {"U", "Toggle luminance-only subtraction mode"},
+                                                                       {"N", "Toggle subtraction of the native YUV planes (before RGB conversion)"}};
 
 static const std::vector<std::string> instructions{
     "Move the mouse horizontally to adjust the movable slider position.",
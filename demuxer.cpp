@@ -3,7 +3,8 @@
 #include "ffmpeg.h"
 #include "string_utils.h"
 
-Demuxer::Demuxer(const Side side, const std::string& demuxer_name, const std::string& file_name, AVDictionary* demuxer_options, const AVDictionary* decoder_options) : SideAware(side) {
+Demuxer::Demuxer(const Side side, const std::string& demuxer_name, const std::string& file_name, AVDictionary* demuxer_options, const AVDictionary* decoder_options, const size_t read_ahead_size, const bool memory_mapped, const bool verbose)
+    : SideAware(side), verbose_(verbose) {
   ScopedLogSide scoped_log_side(side);
 
   const AVInputFormat* input_format = nullptr;
@@ -16,6 +17,27 @@ Demuxer::Demuxer(const Side side, const std::string& demuxer_name, const std::st
     }
   }
 
+  if (memory_mapped || read_ahead_size > 0) {
+    if (InputIO::is_local_file(file_name)) {
+      if (memory_mapped) {
+        input_io_ = std::make_unique<MappedFileIO>(file_name);
+      } else {
+        input_io_ = std::make_unique<ReadAheadIO>(file_name, read_ahead_size);
+      }
+
+      format_context_ = avformat_alloc_context();
+
+      if (format_context_ == nullptr) {
+        throw ffmpeg::Error{"Failed to allocate format context"};
+      }
+
+      format_context_->pb = input_io_->context();
+      format_context_->flags |= AVFMT_FLAG_CUSTOM_IO;
+    } else {
+      log_warning(string_sprintf("Custom input is only supported for files, reading '%s' directly", file_name.c_str()));
+    }
+  }
+
   ffmpeg::check(file_name, avformat_open_input(&format_context_, file_name.c_str(), const_cast<AVInputFormat*>(input_format), &demuxer_options));
   ffmpeg::check_dict_is_empty(demuxer_options, string_sprintf("Demuxer %s", format_name().c_str()));
 
@@ -57,10 +79,23 @@ Demuxer::Demuxer(const Side side, const std::string& demuxer_name, const std::st
   }
 
   av_freep(&opts_for_streams);
+
+  // raw frames are served straight from a memory mapping of local files
+  if ((format_name() == "rawvideo" || format_name() == "yuv4mpegpipe") && file_name != "-" && InputIO::is_local_file(file_name)) {
+    mapped_raw_video_ = MappedRawVideo::create(InputIO::local_path(file_name), format_name(), video_codec_parameters(), guess_frame_rate(), time_base(), video_stream_index_);
+
+    if (mapped_raw_video_ != nullptr && verbose_) {
+      log_info(string_sprintf("Reading %lld raw frames directly from a memory mapping", static_cast<long long>(mapped_raw_video_->frame_count())));
+    }
+  }
 }
 
 Demuxer::~Demuxer() {
   avformat_close_input(&format_context_);
+
+  if (verbose_ && input_io_ != nullptr) {
+    log_info(input_io_->statistics());
+  }
 }
 
 AVCodecParameters* Demuxer::video_codec_parameters() {
@@ -114,18 +149,107 @@ AVRational Demuxer::guess_frame_rate(AVFrame* frame) const {
   return av_guess_frame_rate(format_context_, format_context_->streams[video_stream_index_], frame);
 }
 
+bool Demuxer::is_still_image() const {
+  const std::string name = format_context_->iformat->name;
+  const AVStream* stream = format_context_->streams[video_stream_index_];
+
+  static const std::string PIPE_SUFFIX = "_pipe";
+
+  if (name == "image2") {
+    // the image2 demuxer sets the duration to the number of images in the sequence
+    return stream->duration == 1;
+  }
+
+  // probing reads the first image, so only pipes which can be rewound (e.g. not stdin) are considered
+  const bool seekable = format_context_->pb != nullptr && (format_context_->pb->seekable & AVIO_SEEKABLE_NORMAL) != 0;
+
+  return seekable && name.size() > PIPE_SUFFIX.size() && name.compare(name.size() - PIPE_SUFFIX.size(), PIPE_SUFFIX.size(), PIPE_SUFFIX) == 0;
+}
+
+bool Demuxer::is_image_sequence() const {
+  return std::string(format_context_->iformat->name) == "image2" && format_context_->streams[video_stream_index_]->duration > 1;
+}
+
 bool Demuxer::operator()(AVPacket& packet) {
+  if (mapped_raw_video_ != nullptr) {
+    return mapped_raw_video_->read(packet);
+  }
+
   return av_read_frame(format_context_, &packet) >= 0;
 }
 
 bool Demuxer::seek(const float position, const bool backward) {
   ScopedLogSide scoped_log_side(get_side());
 
+  if (mapped_raw_video_ != nullptr) {
+    return mapped_raw_video_->seek(position, backward);
+  }
+
   int64_t seek_target = static_cast<int64_t>(position * AV_TIME_BASE);
 
   return av_seek_frame(format_context_, -1, seek_target, backward ? AVSEEK_FLAG_BACKWARD : 0) >= 0;
 }
 
+int64_t Demuxer::keyframe_at_or_before(const int64_t pts) const {
+  // raw frames are all intra-coded
+  if (mapped_raw_video_ != nullptr) {
+    return pts;
+  }
+
+  AVStream* stream = format_context_->streams[video_stream_index_];
+  const int64_t timestamp = av_rescale_q(pts + start_time(), AV_R_MICROSECONDS, stream->time_base);
+
+#if (LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100))
+  const AVIndexEntry* entry = avformat_index_get_entry_from_timestamp(stream, timestamp, AVSEEK_FLAG_BACKWARD);
+#else
+  const int index = av_index_search_timestamp(stream, timestamp, AVSEEK_FLAG_BACKWARD);
+  const AVIndexEntry* entry = index >= 0 ? &stream->index_entries[index] : nullptr;
+#endif
+
+  return entry != nullptr ? av_rescale_q(entry->timestamp, stream->time_base, AV_R_MICROSECONDS) - start_time() : AV_NOPTS_VALUE;
+}
+
+std::vector<int64_t> Demuxer::keyframes() const {
+  std::vector<int64_t> keyframes;
+
+  if (mapped_raw_video_ != nullptr) {
+    const AVRational frame_rate = guess_frame_rate();
+
+    for (int64_t i = 0; i < mapped_raw_video_->frame_count(); i++) {
+      keyframes.push_back(av_rescale_q(i, av_inv_q(frame_rate), AV_R_MICROSECONDS));
+    }
+    return keyframes;
+  }
+
+  AVStream* stream = format_context_->streams[video_stream_index_];
+
+#if (LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100))
+  const int entry_count = avformat_index_get_entries_count(stream);
+#else
+  const int entry_count = stream->nb_index_entries;
+#endif
+
+  for (int i = 0; i < entry_count; i++) {
+#if (LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100))
+    const AVIndexEntry* entry = avformat_index_get_entry(stream, i);
+#else
+    const AVIndexEntry* entry = &stream->index_entries[i];
+#endif
+
+    if (entry->flags & AVINDEX_KEYFRAME) {
+      keyframes.push_back(av_rescale_q(entry->timestamp, stream->time_base, AV_R_MICROSECONDS) - start_time());
+    }
+  }
+
+  return keyframes;
+}
+
+bool Demuxer::rewind() {
+  ScopedLogSide scoped_log_side(get_side());
+
+  return av_seek_frame(format_context_, -1, 0, AVSEEK_FLAG_BYTE) >= 0;
+}
+
 std::string Demuxer::format_name() {
   return format_context_->iformat->name;
 }
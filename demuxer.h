@@ -1,5 +1,9 @@
 #pragma once
+#include <memory>
 #include <string>
+#include <vector>
+#include "input_io.h"
+#include "mapped_raw_video.h"
 #include "side_aware.h"
 extern "C" {
 #include <libavformat/avformat.h>
@@ -8,7 +12,7 @@ extern "C" {
 
 class Demuxer : public SideAware {
  public:
-  explicit Demuxer(const Side side, const std::string& demuxer_name, const std::string& file_name, AVDictionary* demuxer_options, const AVDictionary* decoder_options);
+  explicit Demuxer(const Side side, const std::string& demuxer_name, const std::string& file_name, AVDictionary* demuxer_options, const AVDictionary* decoder_options, const size_t read_ahead_size = 0, const bool memory_mapped = false, const bool verbose = false);
   ~Demuxer();
 
   AVCodecParameters* video_codec_parameters();
@@ -23,14 +27,30 @@ class Demuxer : public SideAware {
 
   AVRational guess_frame_rate(AVFrame* frame = nullptr) const;
 
+  // true for single images and seekable image pipes, which are likely to hold a single frame
+  bool is_still_image() const;
+  bool is_image_sequence() const;
+
+  // in microseconds from the start, as for filtered frames; AV_NOPTS_VALUE if the index does not cover the time
+  int64_t keyframe_at_or_before(const int64_t pts) const;
+  // all keyframes in the index, which may be empty until the input has been read for some formats
+  std::vector<int64_t> keyframes() const;
+
   bool operator()(AVPacket& packet);
   bool seek(float position, bool backward);
 
+  // back to the first byte, for image demuxers whose inputs have no header
+  bool rewind();
+
   std::string format_name();
   int64_t file_size();
   int64_t bit_rate();
 
  private:
+  std::unique_ptr<InputIO> input_io_;
+  std::unique_ptr<MappedRawVideo> mapped_raw_video_;
+  const bool verbose_;
+
   AVFormatContext* format_context_{};
   int video_stream_index_{};
 };
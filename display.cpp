@@ -1,21 +1,21 @@
 #include "display.h"
 #include <libgen.h>
 #include <algorithm>
-#include <atomic>
+#include <cmath>
 #include <future>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <numeric>
 #include <regex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
-#include <thread>
 #include "controls.h"
 #include "ffmpeg.h"
 #include "format_converter.h"
-#include "png_saver.h"
+#include "png_exporter.h"
 #include "source_code_pro_regular_ttf.h"
 #include "version.h"
 #include "video_compare_icon.h"
@@ -23,6 +23,7 @@
 extern "C" {
 #include <libavfilter/avfilter.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
 #include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
 }
@@ -393,41 +394,6 @@ Display::Display(const int display_number,
 
   diff_planes_ = {diff_plane_0, nullptr, nullptr};
   diff_pitches_ = {video_width_ * 3 * (use_10_bpc ? sizeof(uint16_t) : sizeof(uint8_t)), 0, 0};
-
-  // initialize help texts
-  bool primary_color = true;
-
-  auto add_help_texture = [&](TTF_Font* font, const std::string& text) {
-    int h;
-
-    SDL_Surface* surface = TTF_RenderUTF8_Blended_Wrapped(font, text.c_str(), primary_color ? HELP_TEXT_PRIMARY_COLOR : HELP_TEXT_ALTERNATE_COLOR, drawable_width_ - HELP_TEXT_HORIZONTAL_MARGIN * 2);
-    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer_, surface);
-    SDL_FreeSurface(surface);
-
-    SDL_QueryTexture(texture, nullptr, nullptr, nullptr, &h);
-    help_total_height_ += h;
-
-    help_textures_.push_back(texture);
-  };
-
-  add_help_texture(small_font_, " ");
-  TTF_SetFontStyle(big_font_, TTF_STYLE_BOLD | TTF_STYLE_UNDERLINE);
-  add_help_texture(big_font_, "CONTROLS");
-  TTF_SetFontStyle(big_font_, TTF_STYLE_NORMAL);
-  add_help_texture(small_font_, " ");
-
-  for (auto& key_description_pair : get_controls()) {
-    primary_color = !primary_color;
-    add_help_texture(small_font_, string_sprintf(" %-12s %s", key_description_pair.first.c_str(), key_description_pair.second.c_str()));
-  }
-
-  add_help_texture(big_font_, " ");
-
-  for (auto& text : get_instructions()) {
-    primary_color = !primary_color;
-    add_help_texture(small_font_, text);
-    add_help_texture(small_font_, " ");
-  }
 }
 
 Display::~Display() {
@@ -785,73 +751,183 @@ void Display::process_difference_planes(const typename BitDepthTraits<Bpc>::P* p
   const std::vector<uint32_t> mag_u = std::move(luts.first);
   const std::vector<uint32_t> mag_s = std::move(luts.second);
 
+  // in reduced resolution mode, each computed row is duplicated into the one below it
+  const int row_step = reduce_diff_resolution_ ? 2 : 1;
+  const int rows = (video_height_ + row_step - 1) / row_step;
+
   row_workers_.run_dynamic(
-      video_height_,
+      rows,
       [=](const int start_row, const int end_row) {
-        auto plane_left = plane_left0 + start_row * (pitch_left / sizeof(typename T::P));
-        auto plane_right = plane_right0 + start_row * (pitch_right / sizeof(typename T::P));
-        auto plane_difference = plane_difference0 + start_row * (pitch_difference / sizeof(typename T::P));
+        auto plane_left = plane_left0 + start_row * row_step * (pitch_left / sizeof(typename T::P));
+        auto plane_right = plane_right0 + start_row * row_step * (pitch_right / sizeof(typename T::P));
+        auto plane_difference = plane_difference0 + start_row * row_step * (pitch_difference / sizeof(typename T::P));
 
-        for (int y = start_row; y < end_row; y++) {
+        for (int y = start_row * row_step; y < end_row * row_step && y < video_height_; y += row_step) {
           process_difference_scanline<Bpc>(plane_left, plane_right, plane_difference, width_right, diff_mode_, diff_luma_only_, mag_u, mag_s);
-          plane_left += pitch_left / sizeof(typename T::P);
-          plane_right += pitch_right / sizeof(typename T::P);
-          plane_difference += pitch_difference / sizeof(typename T::P);
+
+          if (row_step == 2 && (y + 1) < video_height_) {
+            memcpy(plane_difference + pitch_difference / sizeof(typename T::P), plane_difference, width_right * 3 * sizeof(typename T::P));
+          }
+
+          plane_left += row_step * (pitch_left / sizeof(typename T::P));
+          plane_right += row_step * (pitch_right / sizeof(typename T::P));
+          plane_difference += row_step * (pitch_difference / sizeof(typename T::P));
         }
       },
-      suggest_block_rows_by_bytes(video_width_, video_height_, sizeof(typename BitDepthTraits<Bpc>::P), 3));
+      suggest_block_rows_by_bytes(video_width_, rows, sizeof(typename BitDepthTraits<Bpc>::P), 3));
+}
+
+template <int Bpc>
+void Display::fill_zero_difference_planes(const typename BitDepthTraits<Bpc>::P* plane_left0, typename BitDepthTraits<Bpc>::P* plane_difference0, const size_t pitch_difference, const int width_right) const {
+  using T = BitDepthTraits<Bpc>;
+
+  auto luts = make_diff_lut(T::MaxCode, diff_mode_, 1);
+
+  // a row compared with itself yields the zero-difference row, which is then replicated
+  process_difference_scanline<Bpc>(plane_left0, plane_left0, plane_difference0, width_right, diff_mode_, diff_luma_only_, luts.first, luts.second);
+
+  const size_t stride_difference = pitch_difference / sizeof(typename T::P);
+
+  for (int y = 1; y < video_height_; y++) {
+    memcpy(plane_difference0 + y * stride_difference, plane_difference0, width_right * 3 * sizeof(typename T::P));
+  }
+}
+
+uint64_t Display::content_hash(const AVFrame* frame) {
+  uint64_t hash = ffmpeg::get_content_hash(frame);
+
+  // the displayed frames are owned by the main thread, so storing the hash alongside them is safe
+  if (hash == 0) {
+    hash = ffmpeg::compute_content_hash(frame, row_workers_);
+    ffmpeg::set_content_hash(const_cast<AVFrame*>(frame), hash);
+  }
+
+  return hash;
 }
 
-void Display::update_difference(std::array<uint8_t*, 3> planes_left, std::array<size_t, 3> pitches_left, std::array<uint8_t*, 3> planes_right, std::array<size_t, 3> pitches_right, int split_x) {
+void Display::update_difference(std::array<uint8_t*, 3> planes_left,
+                                std::array<size_t, 3> pitches_left,
+                                std::array<uint8_t*, 3> planes_right,
+                                std::array<size_t, 3> pitches_right,
+                                int split_x,
+                                const uint64_t left_hash,
+                                const uint64_t right_hash) {
   constexpr int CHANNELS = 3;
+  constexpr size_t MAX_CACHED_FRAME_P99S = 1024;
 
   const int width_right = (video_width_ - split_x);
   if (width_right <= 0) {
     return;
   }
 
-  const bool update_frame_max = diff_mode_ != DiffMode::LegacyAbs;
-  float frame_max = 1.f;
+  const bool known_contents = left_hash != 0 && right_hash != 0;
+  const bool identical_contents = known_contents && left_hash == right_hash;
+
+  const bool update_frame_max = diff_mode_ != DiffMode::LegacyAbs && (!freeze_diff_scale_ || diff_frame_max_ < 0.f);
+  float frame_max = diff_mode_ != DiffMode::LegacyAbs ? diff_frame_max_ : 1.f;
 
   // row starts after split_x pixels, i.e., split_x * 3 samples
-  if (use_10_bpc_) {
-    auto plane_left0 = reinterpret_cast<uint16_t*>(planes_left[0]) + split_x * CHANNELS;
-    auto plane_right0 = reinterpret_cast<uint16_t*>(planes_right[0]) + split_x * CHANNELS;
-    auto plane_difference0 = reinterpret_cast<uint16_t*>(diff_planes_[0]) + split_x * CHANNELS;
+  const size_t sample_offset = split_x * CHANNELS;
+
+  if (update_frame_max) {
+    const auto p99_key = std::make_tuple(left_hash, right_hash, diff_luma_only_, split_x);
+    const auto cached_p99 = known_contents ? frame_p99_cache_.find(p99_key) : frame_p99_cache_.end();
 
-    if (update_frame_max) {
-      frame_max = calculate_frame_p99<10>(plane_left0, plane_right0, pitches_left[0], pitches_right[0], width_right);
+    if (identical_contents) {
+      frame_max = 0.f;
+    } else if (cached_p99 != frame_p99_cache_.end()) {
+      frame_max = cached_p99->second;
+    } else {
+      if (use_10_bpc_) {
+        frame_max = calculate_frame_p99<10>(reinterpret_cast<uint16_t*>(planes_left[0]) + sample_offset, reinterpret_cast<uint16_t*>(planes_right[0]) + sample_offset, pitches_left[0], pitches_right[0], width_right);
+      } else {
+        frame_max = calculate_frame_p99<8>(planes_left[0] + sample_offset, planes_right[0] + sample_offset, pitches_left[0], pitches_right[0], width_right);
+      }
+
+      if (known_contents) {
+        if (frame_p99_cache_.size() >= MAX_CACHED_FRAME_P99S) {
+          frame_p99_cache_.clear();
+        }
+        frame_p99_cache_[p99_key] = frame_max;
+      }
     }
 
-    process_difference_planes<10>(plane_left0, plane_right0, plane_difference0, pitches_left[0], pitches_right[0], diff_pitches_[0], width_right, frame_max);
+    diff_frame_max_ = frame_max;
+  }
+
+  // diff_planes_ still holds the difference of this very frame pair, e.g. when only the zoom or overlays changed
+  const DifferenceKey difference_key{left_hash, right_hash, diff_mode_, diff_luma_only_, reduce_diff_resolution_, frame_max, split_x};
+
+  if (known_contents && difference_key == difference_key_) {
+    return;
+  }
+  difference_key_ = known_contents ? difference_key : DifferenceKey{};
+
+  if (use_10_bpc_) {
+    auto plane_left0 = reinterpret_cast<uint16_t*>(planes_left[0]) + sample_offset;
+    auto plane_right0 = reinterpret_cast<uint16_t*>(planes_right[0]) + sample_offset;
+    auto plane_difference0 = reinterpret_cast<uint16_t*>(diff_planes_[0]) + sample_offset;
+
+    if (identical_contents) {
+      fill_zero_difference_planes<10>(plane_left0, plane_difference0, diff_pitches_[0], width_right);
+    } else {
+      process_difference_planes<10>(plane_left0, plane_right0, plane_difference0, pitches_left[0], pitches_right[0], diff_pitches_[0], width_right, frame_max);
+    }
   } else {
-    auto plane_left0 = planes_left[0] + split_x * CHANNELS;
-    auto plane_right0 = planes_right[0] + split_x * CHANNELS;
-    auto plane_difference0 = diff_planes_[0] + split_x * CHANNELS;
+    auto plane_left0 = planes_left[0] + sample_offset;
+    auto plane_right0 = planes_right[0] + sample_offset;
+    auto plane_difference0 = diff_planes_[0] + sample_offset;
 
-    if (update_frame_max) {
-      frame_max = calculate_frame_p99<8>(plane_left0, plane_right0, pitches_left[0], pitches_right[0], width_right);
+    if (identical_contents) {
+      fill_zero_difference_planes<8>(plane_left0, plane_difference0, diff_pitches_[0], width_right);
+    } else {
+      process_difference_planes<8>(plane_left0, plane_right0, plane_difference0, pitches_left[0], pitches_right[0], diff_pitches_[0], width_right, frame_max);
     }
+  }
+}
+
+bool Display::update_yuv_difference(const AVFrame* left_frame, const AVFrame* right_frame, const int split_x) {
+  if (!yuv_subtraction_ || split_x >= video_width_) {
+    return false;
+  }
+
+  const AVFrame* left_source_frame = ffmpeg::get_source_frame(left_frame);
+  const AVFrame* right_source_frame = ffmpeg::get_source_frame(right_frame);
+
+  // the difference replaces the right frame's texels, so neither side may have been converted at reduced resolution
+  auto is_full_resolution = [&](const AVFrame* frame) { return frame->width == video_width_ && frame->height == video_height_; };
 
-    process_difference_planes<8>(plane_left0, plane_right0, plane_difference0, pitches_left[0], pitches_right[0], diff_pitches_[0], width_right, frame_max);
+  const bool usable = YuvDifference::is_supported(left_source_frame, right_source_frame) && is_full_resolution(left_source_frame) && is_full_resolution(left_frame) && is_full_resolution(right_frame);
+
+  if (usable == yuv_difference_fallback_) {
+    yuv_difference_fallback_ = !usable;
+
+    if (!usable) {
+      std::cout << "YUV-domain subtraction needs equally sized planar YUV frames at the display resolution which were converted after enabling it; subtracting in RGB instead" << std::endl;
+    }
   }
+  if (!usable) {
+    return false;
+  }
+
+  // the YUV difference has a fixed scale and no sign, so only the response of the subtraction mode carries over
+  const bool sqrt_response = diff_mode_ == DiffMode::AbsSqrt || diff_mode_ == DiffMode::SignedDiverging;
+
+  yuv_difference_(left_source_frame, right_source_frame, diff_planes_[0], diff_pitches_[0], use_10_bpc_, sqrt_response, diff_luma_only_, split_x, row_workers_);
+
+  // diff_planes_ no longer holds an RGB difference
+  difference_key_ = DifferenceKey{};
+
+  return true;
 }
 
-void write_png(const AVFrame* frame, const std::string& filename, std::atomic_bool& error_occurred) {
-  try {
-    PngSaver::save(frame, filename);
-  } catch (const PngSaver::IOException& e) {
-    std::cerr << "Error saving video PNG image to file: " << filename << std::endl;
-    error_occurred = true;
-  } catch (const std::runtime_error& e) {
-    std::cerr << "Unexpected while error saving PNG: " << e.what() << std::endl;
-    error_occurred = true;
+void Display::print_yuv_difference_response() {
+  if (yuv_subtraction_ && diff_mode_ != DiffMode::AbsSqrt) {
+    std::cout << "YUV-domain subtraction uses a fixed gain and shows " << (diff_mode_ == DiffMode::SignedDiverging ? "absolute differences with a square-root" : "a linear") << " response" << std::endl;
   }
-};
+}
 
 void Display::save_image_frames(const AVFrame* left_frame, const AVFrame* right_frame) {
-  std::atomic_bool error_occurred(false);
-
   const auto create_onscreen_display_avframe = [&]() -> AVFramePtr {
     const size_t pitch = use_10_bpc_ ? drawable_width_ * 3 * sizeof(uint16_t) : drawable_width_ * 3;
     uint8_t* pixels = reinterpret_cast<uint8_t*>(av_malloc(pitch * drawable_height_));
@@ -889,26 +965,17 @@ void Display::save_image_frames(const AVFrame* left_frame, const AVFrame* right_
     return AVFramePtr(renderer_frame, frame_deleter);
   };
 
-  const auto osd_frame = create_onscreen_display_avframe();
+  // the rendered window has to be read here, the rest is written in the background
+  std::shared_ptr<AVFrame> osd_frame = create_onscreen_display_avframe();
 
   const std::string left_filename = string_sprintf("%s%s_%04d.png", left_file_stem_.c_str(), (left_file_stem_ == right_file_stem_) ? "_left" : "", saved_image_number_);
   const std::string right_filename = string_sprintf("%s%s_%04d.png", right_file_stem_.c_str(), (left_file_stem_ == right_file_stem_) ? "_right" : "", saved_image_number_);
   const std::string osd_filename = string_sprintf("%s_%s_osd_%04d.png", left_file_stem_.c_str(), right_file_stem_.c_str(), saved_image_number_);
 
-  auto save_frame = [&](const AVFrame* frame, const std::string& filename) { return write_png(frame, filename, error_occurred); };
-
-  std::thread save_left_frame_thread(save_frame, left_frame, left_filename);
-  std::thread save_right_frame_thread(save_frame, right_frame, right_filename);
-  std::thread save_osd_frame_thread(save_frame, osd_frame.get(), osd_filename);
-
-  save_left_frame_thread.join();
-  save_right_frame_thread.join();
-  save_osd_frame_thread.join();
-
-  if (!error_occurred) {
-    std::cout << "Saved " << string_sprintf("%s, %s and %s", left_filename.c_str(), right_filename.c_str(), osd_filename.c_str()) << std::endl;
-
+  if (png_exporter_.submit({{PngExporter::reference(left_frame), left_filename}, {PngExporter::reference(right_frame), right_filename}, {osd_frame, osd_filename}})) {
     saved_image_number_++;
+  } else {
+    std::cerr << "Still saving earlier images, try again in a moment" << std::endl;
   }
 }
 
@@ -1229,7 +1296,48 @@ float Display::compute_psnr(const float* left_plane, const float* right_plane) {
   return -10.f * log10f(mse);
 }
 
+void Display::create_help_textures() {
+  bool primary_color = true;
+
+  auto add_help_texture = [&](TTF_Font* font, const std::string& text) {
+    int h;
+
+    SDL_Surface* surface = TTF_RenderUTF8_Blended_Wrapped(font, text.c_str(), primary_color ? HELP_TEXT_PRIMARY_COLOR : HELP_TEXT_ALTERNATE_COLOR, drawable_width_ - HELP_TEXT_HORIZONTAL_MARGIN * 2);
+    SDL_Texture* texture = SDL_CreateTextureFromSurface(renderer_, surface);
+    SDL_FreeSurface(surface);
+
+    SDL_QueryTexture(texture, nullptr, nullptr, nullptr, &h);
+    help_total_height_ += h;
+
+    help_textures_.push_back(texture);
+  };
+
+  add_help_texture(small_font_, " ");
+  TTF_SetFontStyle(big_font_, TTF_STYLE_BOLD | TTF_STYLE_UNDERLINE);
+  add_help_texture(big_font_, "CONTROLS");
+  TTF_SetFontStyle(big_font_, TTF_STYLE_NORMAL);
+  add_help_texture(small_font_, " ");
+
+  for (auto& key_description_pair : get_controls()) {
+    primary_color = !primary_color;
+    add_help_texture(small_font_, string_sprintf(" %-12s %s", key_description_pair.first.c_str(), key_description_pair.second.c_str()));
+  }
+
+  add_help_texture(big_font_, " ");
+
+  for (auto& text : get_instructions()) {
+    primary_color = !primary_color;
+    add_help_texture(small_font_, text);
+    add_help_texture(small_font_, " ");
+  }
+}
+
 void Display::render_help() {
+  // created on first use to keep them out of startup
+  if (help_textures_.empty()) {
+    create_help_textures();
+  }
+
   SDL_SetRenderDrawBlendMode(renderer_, SDL_BLENDMODE_BLEND);
   SDL_SetRenderDrawColor(renderer_, 0, 0, 0, BACKGROUND_ALPHA * 3 / 2);
   SDL_RenderFillRect(renderer_, nullptr);
@@ -1254,6 +1362,11 @@ void Display::render_metadata_overlay() {
     update_metadata(right_metadata_, left_metadata_);
   }
 
+  // created on first use to keep them out of startup
+  if (metadata_textures_.empty()) {
+    create_metadata_textures();
+  }
+
   SDL_SetRenderDrawBlendMode(renderer_, SDL_BLENDMODE_BLEND);
   SDL_SetRenderDrawColor(renderer_, 0, 0, 0, BACKGROUND_ALPHA * 3 / 2);
   SDL_RenderFillRect(renderer_, nullptr);
@@ -1290,13 +1403,19 @@ void Display::update_metadata(const VideoMetadata left_metadata, const VideoMeta
   left_metadata_ = left_metadata;
   right_metadata_ = right_metadata;
 
-  constexpr char TOKENIZER = ',';
-
+  // the textures are recreated on next use
   for (auto texture : metadata_textures_) {
     SDL_DestroyTexture(texture);
   }
   metadata_textures_.clear();
   metadata_total_height_ = 0;
+}
+
+void Display::create_metadata_textures() {
+  const VideoMetadata& left_metadata = left_metadata_;
+  const VideoMetadata& right_metadata = right_metadata_;
+
+  constexpr char TOKENIZER = ',';
 
   auto add_metadata_texture = [&](TTF_Font* font, const std::string& text, bool primary_color, bool is_header) {
     int h;
@@ -1508,10 +1627,8 @@ void Display::possibly_save_selected_area(const AVFrame* left_frame, const AVFra
 }
 
 void Display::save_selected_area(const AVFrame* left_frame, const AVFrame* right_frame, const SDL_Rect& selection_rect) {
-  std::atomic_bool error_occurred(false);
-
-  // Lambda for creating and initializing frames
-  auto create_frame = [&](const int width, const int height, const AVFrame* source_frame) -> AVFrame* {
+  // Lambda for creating and initializing frames, which are freed once written
+  auto create_frame = [&](const int width, const int height, const AVFrame* source_frame) -> std::shared_ptr<AVFrame> {
     AVFrame* frame = av_frame_alloc();
     frame->format = source_frame->format;
     frame->width = width;
@@ -1519,12 +1636,12 @@ void Display::save_selected_area(const AVFrame* left_frame, const AVFrame* right
     frame->colorspace = source_frame->colorspace;
     frame->color_range = source_frame->color_range;
     av_frame_get_buffer(frame, 0);
-    return frame;
+    return std::shared_ptr<AVFrame>(frame, [](AVFrame* frame_to_free) { av_frame_free(&frame_to_free); });
   };
 
-  AVFrame* left_selected = create_frame(selection_rect.w, selection_rect.h, left_frame);
-  AVFrame* right_selected = create_frame(selection_rect.w, selection_rect.h, right_frame);
-  AVFrame* concatenated = create_frame(selection_rect.w * 2, selection_rect.h, left_frame);
+  const std::shared_ptr<AVFrame> left_selected = create_frame(selection_rect.w, selection_rect.h, left_frame);
+  const std::shared_ptr<AVFrame> right_selected = create_frame(selection_rect.w, selection_rect.h, right_frame);
+  const std::shared_ptr<AVFrame> concatenated = create_frame(selection_rect.w * 2, selection_rect.h, left_frame);
 
   const int pixel_size = use_10_bpc_ ? 3 * sizeof(uint16_t) : 3;
 
@@ -1547,24 +1664,10 @@ void Display::save_selected_area(const AVFrame* left_frame, const AVFrame* right
   const std::string right_filename = string_sprintf("%s%s_cutout_%04d.png", right_file_stem_.c_str(), (left_file_stem_ == right_file_stem_) ? "_right" : "", saved_selected_image_number_);
   const std::string concatenated_filename = string_sprintf("%s_%s_cutout_concat_%04d.png", left_file_stem_.c_str(), right_file_stem_.c_str(), saved_selected_image_number_);
 
-  auto save_frame = [&](const AVFrame* frame, const std::string& filename) { return write_png(frame, filename, error_occurred); };
-
-  std::thread save_left_thread(save_frame, left_selected, left_filename);
-  std::thread save_right_thread(save_frame, right_selected, right_filename);
-  std::thread save_concatenated_thread(save_frame, concatenated, concatenated_filename);
-
-  save_left_thread.join();
-  save_right_thread.join();
-  save_concatenated_thread.join();
-
-  av_frame_free(&left_selected);
-  av_frame_free(&right_selected);
-  av_frame_free(&concatenated);
-
-  if (!error_occurred) {
-    std::cout << "Saved " << string_sprintf("%s, %s and %s", left_filename.c_str(), right_filename.c_str(), concatenated_filename.c_str()) << std::endl;
-
+  if (png_exporter_.submit({{left_selected, left_filename}, {right_selected, right_filename}, {concatenated, concatenated_filename}})) {
     saved_selected_image_number_++;
+  } else {
+    std::cerr << "Still saving earlier images, try again in a moment" << std::endl;
   }
 }
 
@@ -1583,18 +1686,24 @@ bool Display::possibly_refresh(const AVFrame* left_frame, const AVFrame* right_f
 
   // init 10 bpc temp buffers
   if (use_10_bpc_) {
+    // sized for full-resolution frames, which may arrive after reduced-resolution ones
+    const size_t full_resolution_pitch = FFALIGN(video_width_ * 6, 64);
+
     if (left_buffer_ == nullptr) {
-      left_buffer_ = new uint32_t[pitches_left[0] * video_height_ / 4];
+      left_buffer_ = new uint32_t[std::max(pitches_left[0], full_resolution_pitch) * video_height_ / 4];
       left_planes_ = {left_buffer_, nullptr, nullptr};
     }
     if (right_buffer_ == nullptr) {
-      right_buffer_ = new uint32_t[pitches_right[0] * video_height_ / 4];
+      right_buffer_ = new uint32_t[std::max(pitches_right[0], full_resolution_pitch) * video_height_ / 4];
       right_planes_ = {right_buffer_, nullptr, nullptr};
     }
   }
 
   const bool compare_mode = show_left_ && show_right_;
 
+  // reduced-resolution frames are only shown; anything reading pixels at video coordinates waits for full-resolution ones
+  const bool full_resolution = left_frame->width == video_width_ && left_frame->height == video_height_ && right_frame->width == video_width_ && right_frame->height == video_height_;
+
   const auto zoom_rect = compute_zoom_rect();
 
   const Vector2D mouse_video_pos = get_mouse_video_position(mouse_x_, mouse_y_, zoom_rect);
@@ -1602,7 +1711,7 @@ bool Display::possibly_refresh(const AVFrame* left_frame, const AVFrame* right_f
   const int mouse_video_y = mouse_video_pos.y();
 
   // print pixel position in original video coordinates and RGB+YUV color value
-  if (print_mouse_position_and_color_) {
+  if (print_mouse_position_and_color_ && full_resolution) {
     const bool print_left_pixel = mouse_video_x >= 0 && mouse_video_x < video_width_ && mouse_video_y >= 0 && mouse_video_y < video_height_;
 
     bool print_right_pixel;
@@ -1644,16 +1753,90 @@ bool Display::possibly_refresh(const AVFrame* left_frame, const AVFrame* right_f
   }
 
   // print image similarity metrics
-  if (print_image_similarity_metrics_) {
-    const float* left_gray = rgb_to_grayscale(planes_left[0], pitches_left[0]);
-    const float* right_gray = rgb_to_grayscale(planes_right[0], pitches_right[0]);
+  if (print_image_similarity_metrics_ && full_resolution) {
+    constexpr size_t MAX_CACHED_DISPLAYED_METRICS = 1024;
+
+    const uint64_t display_context = MetricsDatabase::with_domain(metrics_context_, string_sprintf("display %dx%d %s", left_frame->width, left_frame->height, av_get_pix_fmt_name(static_cast<AVPixelFormat>(left_frame->format))));
+    const std::pair<uint64_t, uint64_t> hash_key{content_hash(left_frame), content_hash(right_frame)};
+    const bool known_contents = hash_key.first != 0 && hash_key.second != 0;
+    const auto cached_metrics = known_contents ? displayed_metrics_cache_.find(hash_key) : displayed_metrics_cache_.end();
+    MetricsDatabase::Values cached_values;
+
+    double psnr, ssim;
+    std::string vmaf;
+    bool cached = true;
+
+    // repeated content (e.g. a static scene) is recognized regardless of its position
+    if (cached_metrics != displayed_metrics_cache_.end()) {
+      std::tie(psnr, ssim, vmaf) = cached_metrics->second;
+    } else if (metrics_database_ != nullptr && metrics_database_->lookup(display_context, MetricsDatabase::Kind::DISPLAY, left_frame->pts, right_frame->pts, cached_values)) {
+      psnr = cached_values[0];
+      ssim = cached_values[1];
+      vmaf = std::isnan(cached_values[2]) ? "n/a" : string_sprintf("%.6f", cached_values[2]);
+    } else {
+      const float* left_gray = rgb_to_grayscale(planes_left[0], pitches_left[0]);
+      const float* right_gray = rgb_to_grayscale(planes_right[0], pitches_right[0]);
+
+      psnr = compute_psnr(left_gray, right_gray);
+      ssim = compute_ssim(left_gray, right_gray);
+      vmaf = VMAFCalculator::instance().compute(left_frame, right_frame);
+      cached = false;
 
-    std::cout << string_sprintf("Metrics: [%s|%s], PSNR(%.3f), SSIM(%.5f), VMAF(%s)", format_position(ffmpeg::pts_in_secs(left_frame), false).c_str(), format_position(ffmpeg::pts_in_secs(right_frame), false).c_str(),
-                                compute_psnr(left_gray, right_gray), compute_ssim(left_gray, right_gray), VMAFCalculator::instance().compute(left_frame, right_frame).c_str())
+      delete left_gray;
+      delete right_gray;
+
+      if (metrics_database_ != nullptr) {
+        // the first score if there are several models
+        const double first_vmaf = vmaf != "n/a" ? std::stod(vmaf.substr(0, vmaf.find('|'))) : std::numeric_limits<double>::quiet_NaN();
+
+        metrics_database_->store(display_context, MetricsDatabase::Kind::DISPLAY, left_frame->pts, right_frame->pts, MetricsDatabase::Values{psnr, ssim, first_vmaf});
+      }
+    }
+
+    if (known_contents && cached_metrics == displayed_metrics_cache_.end()) {
+      if (displayed_metrics_cache_.size() >= MAX_CACHED_DISPLAYED_METRICS) {
+        displayed_metrics_cache_.clear();
+      }
+      displayed_metrics_cache_[hash_key] = std::make_tuple(psnr, ssim, vmaf);
+    }
+
+    std::cout << string_sprintf("Metrics: [%s|%s], PSNR(%.3f), SSIM(%.5f), VMAF(%s)%s", format_position(ffmpeg::pts_in_secs(left_frame), false).c_str(), format_position(ffmpeg::pts_in_secs(right_frame), false).c_str(), psnr, ssim,
+                                vmaf.c_str(), cached ? " (cached)" : "")
               << std::endl;
 
-    delete left_gray;
-    delete right_gray;
+    // the filtered frames are kept alongside the converted ones e.g. while subtracting in the YUV domain
+    const AVFrame* left_source_frame = ffmpeg::get_source_frame(left_frame);
+    const AVFrame* right_source_frame = ffmpeg::get_source_frame(right_frame);
+
+    if (left_source_frame != nullptr && right_source_frame != nullptr && left_source_frame->format == right_source_frame->format && left_source_frame->width == right_source_frame->width &&
+        left_source_frame->height == right_source_frame->height && MetricsEngine::is_supported(static_cast<AVPixelFormat>(left_source_frame->format))) {
+      if (metrics_engine_ == nullptr) {
+        metrics_engine_ = std::make_unique<MetricsEngine>();
+      }
+
+      // same domain as for --metrics, so scores are shared with headless runs
+      const uint64_t native_context =
+          MetricsDatabase::with_domain(metrics_context_, string_sprintf("native %dx%d %s", left_source_frame->width, left_source_frame->height, av_get_pix_fmt_name(static_cast<AVPixelFormat>(left_source_frame->format))));
+      cached = metrics_database_ != nullptr && metrics_database_->lookup(native_context, MetricsDatabase::Kind::NATIVE, left_source_frame->pts, right_source_frame->pts, cached_values);
+
+      const FrameMetrics metrics = cached ? MetricsDatabase::unpack(cached_values) : metrics_engine_->compute(left_source_frame, right_source_frame);
+      const std::array<std::string, 3> plane_names = MetricsEngine::plane_names(static_cast<AVPixelFormat>(left_source_frame->format));
+
+      if (metrics_database_ != nullptr && !cached) {
+        metrics_database_->store(native_context, MetricsDatabase::Kind::NATIVE, left_source_frame->pts, right_source_frame->pts, MetricsDatabase::pack(metrics));
+      }
+
+      std::cout << string_sprintf("Native metrics (%s):", av_get_pix_fmt_name(static_cast<AVPixelFormat>(left_source_frame->format)));
+
+      for (int plane = 0; plane < metrics.planes; plane++) {
+        std::cout << string_sprintf(" PSNR-%s(%.3f)", plane_names[plane].c_str(), metrics.psnr[plane]);
+      }
+      std::cout << string_sprintf(" PSNR-W(%.3f)", metrics.weighted_psnr);
+      for (int plane = 0; plane < metrics.planes; plane++) {
+        std::cout << string_sprintf(" SSIM-%s(%.5f)", plane_names[plane].c_str(), metrics.ssim[plane]);
+      }
+      std::cout << string_sprintf(" MS-SSIM(%.5f)", metrics.ms_ssim) << (cached ? " (cached)" : "") << std::endl;
+    }
 
     print_image_similarity_metrics_ = false;
   }
@@ -1677,19 +1860,20 @@ bool Display::possibly_refresh(const AVFrame* left_frame, const AVFrame* right_f
     // update video
     if (show_left_ && (split_x > 0)) {
       const SDL_Rect tex_render_quad_left = {0, 0, split_x, video_height_};
+      const SDL_Rect tex_frame_quad_left = video_rect_to_frame_texels(tex_render_quad_left, left_frame);
       const SDL_FRect screen_render_quad_left = video_rect_to_drawable_transform(video_to_zoom_space(tex_render_quad_left, zoom_rect));
 
       if (input_received_ || has_updated_left_pts) {
         if (use_10_bpc_) {
-          convert_to_packed_10_bpc(planes_left, pitches_left, left_planes_, pitches_left, tex_render_quad_left);
+          convert_to_packed_10_bpc(planes_left, pitches_left, left_planes_, pitches_left, tex_frame_quad_left);
 
-          update_texture(&tex_render_quad_left, left_planes_[0], pitches_left[0], "left update (10 bpc, video mode)");
+          update_texture(&tex_frame_quad_left, left_planes_[0], pitches_left[0], "left update (10 bpc, video mode)");
         } else {
-          update_texture(&tex_render_quad_left, planes_left[0], pitches_left[0], "left update (video mode)");
+          update_texture(&tex_frame_quad_left, planes_left[0], pitches_left[0], "left update (video mode)");
         }
       }
 
-      check_sdl(SDL_RenderCopyF(renderer_, get_video_texture(), &tex_render_quad_left, &screen_render_quad_left) == 0, "left video texture render copy");
+      check_sdl(SDL_RenderCopyF(renderer_, get_video_texture(), &tex_frame_quad_left, &screen_render_quad_left) == 0, "left video texture render copy");
     }
     if (show_right_ && ((split_x < video_width_) || mode_ != Mode::SPLIT)) {
       const int start_right = (mode_ == Mode::SPLIT) ? std::max(split_x, 0) : 0;
@@ -1697,32 +1881,35 @@ bool Display::possibly_refresh(const AVFrame* left_frame, const AVFrame* right_f
       const int right_y_offset = (mode_ == Mode::VSTACK) ? video_height_ : 0;
 
       const SDL_Rect tex_render_quad_right = {right_x_offset + start_right, right_y_offset, (video_width_ - start_right), video_height_};
-      const SDL_Rect roi = {start_right, 0, (video_width_ - start_right), video_height_};
+      const SDL_Rect roi = video_rect_to_frame_texels({start_right, 0, (video_width_ - start_right), video_height_}, right_frame);
+      const SDL_Rect tex_frame_quad_right = {right_x_offset + roi.x, right_y_offset + roi.y, roi.w, roi.h};
       const SDL_FRect screen_render_quad_right = video_rect_to_drawable_transform(video_to_zoom_space(tex_render_quad_right, zoom_rect));
 
       if (input_received_ || has_updated_right_pts) {
-        if (subtraction_mode_) {
-          update_difference(planes_left, pitches_left, planes_right, pitches_right, start_right);
+        if (subtraction_mode_ && full_resolution) {
+          if (!update_yuv_difference(left_frame, right_frame, start_right)) {
+            update_difference(planes_left, pitches_left, planes_right, pitches_right, start_right, content_hash(left_frame), content_hash(right_frame));
+          }
 
           if (use_10_bpc_) {
             convert_to_packed_10_bpc(diff_planes_, diff_pitches_, right_planes_, pitches_right, roi);
 
-            update_texture(&tex_render_quad_right, right_planes_[0] + start_right, pitches_right[0], "right update (10 bpc, subtraction mode)");
+            update_texture(&tex_frame_quad_right, right_planes_[0] + roi.x, pitches_right[0], "right update (10 bpc, subtraction mode)");
           } else {
-            update_texture(&tex_render_quad_right, diff_planes_[0] + start_right * 3, diff_pitches_[0], "right update (subtraction mode)");
+            update_texture(&tex_frame_quad_right, diff_planes_[0] + roi.x * 3, diff_pitches_[0], "right update (subtraction mode)");
           }
         } else {
           if (use_10_bpc_) {
             convert_to_packed_10_bpc(planes_right, pitches_right, right_planes_, pitches_right, roi);
 
-            update_texture(&tex_render_quad_right, right_planes_[0] + start_right, pitches_right[0], "right update (10 bpc, video mode)");
+            update_texture(&tex_frame_quad_right, right_planes_[0] + roi.x, pitches_right[0], "right update (10 bpc, video mode)");
           } else {
-            update_texture(&tex_render_quad_right, planes_right[0] + start_right * 3, pitches_right[0], "right update (video mode)");
+            update_texture(&tex_frame_quad_right, planes_right[0] + roi.x * 3, pitches_right[0], "right update (video mode)");
           }
         }
       }
 
-      check_sdl(SDL_RenderCopyF(renderer_, get_video_texture(), &tex_render_quad_right, &screen_render_quad_right) == 0, "right video texture render copy");
+      check_sdl(SDL_RenderCopyF(renderer_, get_video_texture(), &tex_frame_quad_right, &screen_render_quad_right) == 0, "right video texture render copy");
     }
   }
 
@@ -2018,10 +2205,34 @@ bool Display::possibly_refresh(const AVFrame* left_frame, const AVFrame* right_f
     save_image_frames_ = false;
   }
 
-  if (save_selected_area_) {
+  if (save_selected_area_ && full_resolution) {
     possibly_save_selected_area(left_frame, right_frame);
   }
 
+  // drawn after saving, so it does not end up in the saved on-screen display
+  const size_t pending_images = png_exporter_.pending_images();
+
+  if (pending_images > 0) {
+    const std::string saving_str = string_sprintf("Saving %zu image%s...", pending_images, pending_images == 1 ? "" : "s");
+
+    text_surface = TTF_RenderText_Blended(small_font_, saving_str.c_str(), TEXT_COLOR);
+    SDL_Texture* saving_text_texture = SDL_CreateTextureFromSurface(renderer_, text_surface);
+    const int saving_text_width = text_surface->w;
+    const int saving_text_height = text_surface->h;
+    SDL_FreeSurface(text_surface);
+
+    SDL_SetRenderDrawColor(renderer_, 0, 0, 0, BACKGROUND_ALPHA * 2);
+
+    const int text_x = drawable_width_ / 2 - saving_text_width / 2;
+    const int text_y = (mode_ == Mode::VSTACK) ? line2_y_ : line1_y_;
+
+    render_text(text_x, text_y, saving_text_texture, saving_text_width, saving_text_height, border_extension_, true);
+    SDL_DestroyTexture(saving_text_texture);
+
+    // keep refreshing until the indicator can be removed
+    timer_based_update_performed_ = true;
+  }
+
   SDL_RenderPresent(renderer_);
 
   input_received_ = false;
@@ -2093,6 +2304,12 @@ void Display::update_playback_speed(const int playback_speed_level) {
   }
 }
 
+void Display::wait_for_input(const int timeout_ms) {
+  if (!timer_based_update_performed_) {
+    SDL_WaitEventTimeout(nullptr, timeout_ms);
+  }
+}
+
 void Display::input() {
   seek_relative_ = 0.0F;
   seek_from_start_ = false;
@@ -2478,11 +2695,20 @@ void Display::input() {
                 break;
             }
             std::cout << "'" << std::endl;
+
+            print_yuv_difference_response();
             break;
           case SDLK_u:
             diff_luma_only_ = !diff_luma_only_;
             std::cout << "Subtraction luminance-only set to '" << (diff_luma_only_ ? "ON" : "OFF") << "'" << std::endl;
             break;
+          case SDLK_n:
+            yuv_subtraction_ = !yuv_subtraction_;
+            yuv_difference_fallback_ = false;
+            std::cout << "Subtraction in the YUV domain set to '" << (yuv_subtraction_ ? "ON" : "OFF") << "'" << std::endl;
+
+            print_yuv_difference_response();
+            break;
           default:
             break;
         }
@@ -2543,6 +2769,15 @@ bool Display::get_fast_input_alignment() const {
   return fast_input_alignment_;
 }
 
+void Display::set_metrics_database(MetricsDatabase* metrics_database, const uint64_t context) {
+  metrics_database_ = metrics_database;
+  metrics_context_ = context;
+}
+
+bool Display::get_yuv_subtraction() const {
+  return yuv_subtraction_;
+}
+
 bool Display::get_swap_left_right() const {
   return swap_left_right_;
 }
@@ -2582,3 +2817,27 @@ bool Display::get_possibly_tick_playback() const {
 bool Display::get_show_fps() const {
   return show_fps_;
 }
+
+void Display::set_freeze_diff_scale(const bool freeze) {
+  freeze_diff_scale_ = freeze;
+}
+
+void Display::set_reduce_diff_resolution(const bool reduce) {
+  reduce_diff_resolution_ = reduce;
+}
+
+bool Display::get_full_resolution_required() const {
+  return !play_ || buffer_play_loop_mode_ != Loop::OFF || global_zoom_factor_ > 1.0F || zoom_left_ || zoom_right_ || subtraction_mode_ || save_image_frames_ || save_selected_area_ || print_mouse_position_and_color_ ||
+         print_image_similarity_metrics_;
+}
+
+std::tuple<int, int> Display::get_on_screen_video_size() const {
+  const float width = video_width_ * global_zoom_factor_ * drawable_to_window_width_factor_ / video_to_window_width_factor_;
+  const float height = video_height_ * global_zoom_factor_ * drawable_to_window_height_factor_ / video_to_window_height_factor_;
+
+  return std::make_tuple(clamp_range(static_cast<int>(std::ceil(width)), 1, video_width_), clamp_range(static_cast<int>(std::ceil(height)), 1, video_height_));
+}
+
+void Display::request_refresh() {
+  input_received_ = true;
+}
@@ -8,10 +8,15 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <tuple>
 #include <vector>
 #include "core_types.h"
+#include "metrics_database.h"
+#include "metrics_engine.h"
+#include "png_exporter.h"
 #include "row_workers.h"
 #include "string_utils.h"
+#include "yuv_difference.h"
 extern "C" {
 #include <libavutil/frame.h>
 }
@@ -163,6 +168,29 @@ class Display {
   // Subtraction mode settings
   DiffMode diff_mode_{DiffMode::AbsLinear};
   bool diff_luma_only_{false};
+  bool yuv_subtraction_{false};
+  bool yuv_difference_fallback_{false};
+  YuvDifference yuv_difference_;
+
+  // created on first use, for metrics of the filtered frames
+  std::unique_ptr<MetricsEngine> metrics_engine_;
+
+  // optional cache of the printed metrics, owned by VideoCompare
+  MetricsDatabase* metrics_database_{nullptr};
+  uint64_t metrics_context_{0};
+  bool freeze_diff_scale_{false};
+  bool reduce_diff_resolution_{false};
+  float diff_frame_max_{-1.0F};
+
+  // (left hash, right hash, mode, luma only, reduced resolution, scale, split x) of the difference in diff_planes_
+  using DifferenceKey = std::tuple<uint64_t, uint64_t, DiffMode, bool, bool, float, int>;
+  DifferenceKey difference_key_{};
+
+  // 99th percentile differences of recently seen frame pairs, keyed by (left hash, right hash, luma only, split x)
+  std::map<std::tuple<uint64_t, uint64_t, bool, int>, float> frame_p99_cache_;
+
+  // PSNR, SSIM and VMAF of recently measured displayed frame pairs, keyed by (left hash, right hash)
+  std::map<std::pair<uint64_t, uint64_t>, std::tuple<double, double, std::string>> displayed_metrics_cache_;
 
   // Rectangle selection state
   enum class SelectionState { NONE, STARTED, COMPLETED };
@@ -230,6 +258,9 @@ class Display {
   int saved_image_number_{1};
   int saved_selected_image_number_{1};
 
+  // saved images are written in the background; a few exports of three images each can be pending
+  PngExporter png_exporter_{4, 3};
+
   std::vector<SDL_Texture*> metadata_textures_;
   int metadata_total_height_{0};
   int metadata_y_offset_{0};
@@ -248,7 +279,24 @@ class Display {
 
   void convert_to_packed_10_bpc(std::array<uint8_t*, 3> in_planes, std::array<size_t, 3> in_pitches, std::array<uint32_t*, 3> out_planes, std::array<size_t, 3> out_pitches, const SDL_Rect& roi);
 
-  void update_difference(std::array<uint8_t*, 3> planes_left, std::array<size_t, 3> pitches_left, std::array<uint8_t*, 3> planes_right, std::array<size_t, 3> pitches_right, int split_x);
+  // the frame's content hash, computed on first use only and then kept in its metadata
+  uint64_t content_hash(const AVFrame* frame);
+
+  // the content hashes (0 if unknown) allow reusing the previous difference and short-circuiting identical frames
+  void update_difference(std::array<uint8_t*, 3> planes_left,
+                         std::array<size_t, 3> pitches_left,
+                         std::array<uint8_t*, 3> planes_right,
+                         std::array<size_t, 3> pitches_right,
+                         int split_x,
+                         const uint64_t left_hash,
+                         const uint64_t right_hash);
+
+  // subtracts the filtered source frames in their native YUV format; returns false if they are unavailable or
+  // unsuitable (e.g. differently sized), in which case the RGB difference is used instead
+  bool update_yuv_difference(const AVFrame* left_frame, const AVFrame* right_frame, const int split_x);
+
+  // notes how the current subtraction mode carries over to YUV-domain subtraction
+  void print_yuv_difference_response();
 
   template <int Bpc>
   float calculate_frame_p99(const typename BitDepthTraits<Bpc>::P* plane_left, const typename BitDepthTraits<Bpc>::P* plane_right, const size_t pitch_left, const size_t pitch_right, const int width_right) const;
@@ -263,6 +311,10 @@ class Display {
                                  const int width_right,
                                  const float diff_max) const;
 
+  // writes the rendering of a zero difference, as produced by process_difference_planes() for identical frames
+  template <int Bpc>
+  void fill_zero_difference_planes(const typename BitDepthTraits<Bpc>::P* plane_left0, typename BitDepthTraits<Bpc>::P* plane_difference0, const size_t pitch_difference, const int width_right) const;
+
   void save_image_frames(const AVFrame* left_frame, const AVFrame* right_frame);
 
   inline int static round(const float value) { return static_cast<int>(std::round(value)); }
@@ -274,6 +326,16 @@ class Display {
     return {rect.x * width_scale, rect.y * height_scale, rect.w * width_scale, rect.h * height_scale};
   }
 
+  // maps a rectangle in video coordinates onto the texels of a frame which may have been converted at reduced resolution
+  SDL_Rect video_rect_to_frame_texels(const SDL_Rect& rect, const AVFrame* frame) const {
+    const int x0 = rect.x * frame->width / video_width_;
+    const int y0 = rect.y * frame->height / video_height_;
+    const int x1 = (rect.x + rect.w) * frame->width / video_width_;
+    const int y1 = (rect.y + rect.h) * frame->height / video_height_;
+
+    return {x0, y0, x1 - x0, y1 - y0};
+  }
+
   void render_text(int x, int y, SDL_Texture* texture, int texture_width, int texture_height, int border_extension, bool left_adjust);
 
   void render_progress_dots(const float position, const float progress, const bool is_top);
@@ -296,7 +358,9 @@ class Display {
 
   float compute_psnr(const float* left_plane, const float* right_plane);
 
+  void create_help_textures();
   void render_help();
+  void create_metadata_textures();
   void render_metadata_overlay();
 
   SDL_Rect get_left_selection_rect() const;
@@ -346,6 +410,9 @@ class Display {
   // Handle events
   void input();
 
+  // blocks until an input event arrives or the timeout expires, unless an animation needs further refreshes
+  void wait_for_input(const int timeout_ms);
+
   bool get_quit() const;
   bool get_play() const;
   Loop get_buffer_play_loop_mode() const;
@@ -353,6 +420,10 @@ class Display {
   bool get_buffer_play_forward() const;
   void toggle_buffer_play_direction();
   bool get_fast_input_alignment() const;
+  // converted frames must keep their filtered source frames attached for YUV-domain subtraction
+  bool get_yuv_subtraction() const;
+  // the context identifies the inputs and filters; the domain of the measured frames is added per metric
+  void set_metrics_database(MetricsDatabase* metrics_database, const uint64_t context);
   bool get_swap_left_right() const;
   float get_seek_relative() const;
   bool get_seek_from_start() const;
@@ -364,5 +435,17 @@ class Display {
   bool get_possibly_tick_playback() const;
   bool get_show_fps() const;
 
+  // load shedding in subtraction mode: keep the previous adaptive scale instead of computing the p99 difference per frame
+  void set_freeze_diff_scale(const bool freeze);
+  // load shedding in subtraction mode: compute the difference for every other row only
+  void set_reduce_diff_resolution(const bool reduce);
+
+  // true when the current view depends on pixel-exact, full-resolution frames
+  bool get_full_resolution_required() const;
+  // size in drawable pixels of a single video at the current zoom level, capped at the video size
+  std::tuple<int, int> get_on_screen_video_size() const;
+  // forces the next possibly_refresh() call to re-upload and redraw
+  void request_refresh();
+
   void update_metadata(const VideoMetadata left_metadata, const VideoMetadata right_metadata);
 };
@@ -1,7 +1,15 @@
 #include "ffmpeg.h"
+#include <cstdlib>
+#include <cstring>
 #include <string>
+#include <vector>
+#include "row_workers.h"
 #include "side_aware_logger.h"
 #include "string_utils.h"
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
 
 namespace ffmpeg {
 std::string error_string(const int error_code) {
@@ -18,4 +26,160 @@ Error::Error(const std::string& message) : std::runtime_error{sa_format_string(s
 Error::Error(const int status) : std::runtime_error{sa_format_string(string_sprintf("FFmpeg: %s", error_string(status).c_str()))} {}
 
 Error::Error(const std::string& file_name, int status) : std::runtime_error{sa_format_string(string_sprintf("%s: %s", file_name.c_str(), error_string(status).c_str()))} {}
+
+void attach_source_frame(AVFrame* frame, AVFrame* source_frame) {
+  auto free_source_frame = [](void*, uint8_t* data) {
+    AVFrame* source_frame = reinterpret_cast<AVFrame*>(data);
+    av_frame_free(&source_frame);
+  };
+
+  AVBufferRef* source_frame_ref = av_buffer_create(reinterpret_cast<uint8_t*>(source_frame), sizeof(AVFrame), free_source_frame, nullptr, AV_BUFFER_FLAG_READONLY);
+
+  if (source_frame_ref == nullptr) {
+    av_frame_free(&source_frame);
+    throw Error{"Failed to reference source frame"};
+  }
+
+  av_buffer_unref(&frame->opaque_ref);
+  frame->opaque_ref = source_frame_ref;
+}
+
+AVFrame* get_source_frame(const AVFrame* frame) {
+  return frame->opaque_ref != nullptr ? reinterpret_cast<AVFrame*>(frame->opaque_ref->data) : nullptr;
+}
+
+static constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotate_left(const uint64_t value, const int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t hash_round(uint64_t accumulator, const uint64_t input) {
+  accumulator += input * PRIME64_2;
+  return rotate_left(accumulator, 31) * PRIME64_1;
+}
+
+static inline uint64_t hash_merge(const uint64_t accumulator, const uint64_t lane) {
+  return (accumulator ^ hash_round(0, lane)) * PRIME64_1 + PRIME64_4;
+}
+
+static inline uint64_t read_u64(const uint8_t* data) {
+  uint64_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+// a fixed number of stripes per plane, so the hash does not depend on the number of workers
+static constexpr int CONTENT_HASH_STRIPES = 16;
+
+// four independent lanes, as in xxHash64, consuming 32 bytes per step
+static uint64_t hash_rows(const uint8_t* data, const int linesize, const int row_size, const int rows, const uint64_t seed) {
+  uint64_t lanes[4] = {seed + PRIME64_1 + PRIME64_2, seed + PRIME64_2, seed, seed - PRIME64_1};
+
+  for (int y = 0; y < rows; y++) {
+    const uint8_t* row = data + static_cast<ptrdiff_t>(y) * linesize;
+    int x = 0;
+
+    for (; x + 32 <= row_size; x += 32) {
+      lanes[0] = hash_round(lanes[0], read_u64(row + x));
+      lanes[1] = hash_round(lanes[1], read_u64(row + x + 8));
+      lanes[2] = hash_round(lanes[2], read_u64(row + x + 16));
+      lanes[3] = hash_round(lanes[3], read_u64(row + x + 24));
+    }
+    for (; x + 8 <= row_size; x += 8) {
+      lanes[0] = hash_round(lanes[0], read_u64(row + x));
+    }
+    for (; x < row_size; x++) {
+      lanes[1] = hash_round(lanes[1], row[x]);
+    }
+  }
+
+  uint64_t hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+
+  for (const uint64_t lane : lanes) {
+    hash = hash_merge(hash, lane);
+  }
+
+  return hash;
+}
+
+uint64_t compute_content_hash(const AVFrame* frame, const RowWorkers& row_workers) {
+  const AVPixelFormat format = static_cast<AVPixelFormat>(frame->format);
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(format);
+  const int planes = av_pix_fmt_count_planes(format);
+
+  if (descriptor == nullptr || planes <= 0 || frame->data[0] == nullptr) {
+    return 0;
+  }
+
+  std::array<int, 4> row_sizes{};
+  std::array<int, 4> plane_heights{};
+
+  for (int plane = 0; plane < planes; plane++) {
+    row_sizes[plane] = av_image_get_linesize(format, frame->width, plane);
+
+    if (frame->data[plane] == nullptr || row_sizes[plane] <= 0) {
+      return 0;
+    }
+
+    // the chroma planes may be subsampled vertically
+    plane_heights[plane] = (plane == 1 || plane == 2) ? -((-frame->height) >> descriptor->log2_chroma_h) : frame->height;
+  }
+
+  const uint64_t seed = (static_cast<uint64_t>(frame->width) << 32) ^ (static_cast<uint64_t>(frame->height) << 8) ^ static_cast<uint64_t>(frame->format);
+
+  std::vector<uint64_t> stripe_hashes(static_cast<size_t>(planes) * CONTENT_HASH_STRIPES);
+
+  row_workers.run_dynamic(
+      static_cast<int>(stripe_hashes.size()),
+      [&](const int start, const int end) {
+        for (int i = start; i < end; i++) {
+          const int plane = i / CONTENT_HASH_STRIPES;
+          const int stripe = i % CONTENT_HASH_STRIPES;
+          const int first_row = stripe * plane_heights[plane] / CONTENT_HASH_STRIPES;
+          const int end_row = (stripe + 1) * plane_heights[plane] / CONTENT_HASH_STRIPES;
+
+          stripe_hashes[i] = hash_rows(frame->data[plane] + static_cast<ptrdiff_t>(first_row) * frame->linesize[plane], frame->linesize[plane], row_sizes[plane], end_row - first_row, seed + i);
+        }
+      },
+      1);
+
+  uint64_t hash = seed + PRIME64_5;
+
+  for (const uint64_t stripe_hash : stripe_hashes) {
+    hash = hash_merge(hash, stripe_hash);
+  }
+
+  for (int plane = 0; plane < planes; plane++) {
+    hash += static_cast<uint64_t>(row_sizes[plane]) * plane_heights[plane];
+  }
+
+  // avalanche
+  hash ^= hash >> 33;
+  hash *= PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= PRIME64_3;
+  hash ^= hash >> 32;
+
+  // 0 is reserved for frames without a hash
+  return hash != 0 ? hash : PRIME64_5;
+}
+
+void set_content_hash(AVFrame* frame, const uint64_t hash) {
+  av_dict_set(&frame->metadata, "content_hash", std::to_string(hash).c_str(), 0);
+}
+
+uint64_t get_content_hash(const AVFrame* frame) {
+  const AVDictionaryEntry* entry = av_dict_get(frame->metadata, "content_hash", nullptr, 0);
+
+  return entry != nullptr ? std::strtoull(entry->value, nullptr, 10) : 0;
+}
+
+void clear_content_hash(AVFrame* frame) {
+  av_dict_set(&frame->metadata, "content_hash", nullptr, 0);
+}
 }  // namespace ffmpeg
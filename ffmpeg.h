@@ -8,6 +8,8 @@ extern "C" {
 }
 #include "string_utils.h"
 
+class RowWorkers;
+
 const static double AV_TIME_TO_SEC = av_q2d(AV_TIME_BASE_Q);
 const static double SEC_TO_AV_TIME = AV_TIME_BASE;
 const static double MILLISEC_TO_AV_TIME = SEC_TO_AV_TIME / 1000.0;
@@ -57,6 +59,25 @@ inline float frame_duration_in_secs(const AVFrame* frame) {
   return frame_duration(frame) * AV_TIME_TO_SEC;
 }
 
+// keeps the frame a converted frame was derived from alive alongside it (via opaque_ref), taking ownership
+void attach_source_frame(AVFrame* frame, AVFrame* source_frame);
+
+// returns nullptr if no source frame has been attached
+AVFrame* get_source_frame(const AVFrame* frame);
+
+// xxHash64-style hash of all planes, computed in stripes on the row workers; the format and dimensions are part of
+// the hash, so differently sized renditions of the same content never collide
+uint64_t compute_content_hash(const AVFrame* frame, const RowWorkers& row_workers);
+
+// stores the hash in the frame metadata, where it travels along with the frame's properties
+void set_content_hash(AVFrame* frame, const uint64_t hash);
+
+// returns 0 if no hash has been stored
+uint64_t get_content_hash(const AVFrame* frame);
+
+// for frames whose pixels are (re)written, as their copied properties may include the hash of other content
+void clear_content_hash(AVFrame* frame);
+
 inline void check_dict_is_empty(AVDictionary* dict, const std::string& context) {
   AVDictionaryEntry* unsupported_option = av_dict_get(dict, "", nullptr, AV_DICT_IGNORE_SUFFIX);
 
@@ -1,9 +1,17 @@
 #include "format_converter.h"
 #include <iostream>
+#include <string>
 #include "ffmpeg.h"
+extern "C" {
+#include <libavutil/imgutils.h>
+}
 
 static constexpr int FIXED_1_0 = (1 << 16);
 
+static inline uint64_t pack_size(const size_t width, const size_t height) {
+  return (static_cast<uint64_t>(width) << 32) | static_cast<uint64_t>(height);
+}
+
 inline int get_sws_colorspace(const AVColorSpace color_space) {
   switch (color_space) {
     case AVCOL_SPC_BT709:
@@ -48,7 +56,8 @@ FormatConverter::FormatConverter(const size_t src_width,
       src_color_space_{src_color_space},
       src_color_range_{src_color_range},
       active_flags_(flags),
-      pending_flags_(active_flags_) {
+      pending_flags_(active_flags_),
+      pending_dest_size_(pack_size(dest_width, dest_height)) {
   ScopedLogSide scoped_log_side(side);
 
   init();
@@ -112,6 +121,10 @@ void FormatConverter::set_pending_flags(const int flags) {
   pending_flags_ = flags;
 }
 
+void FormatConverter::set_pending_dest_size(const size_t dest_width, const size_t dest_height) {
+  pending_dest_size_ = pack_size(dest_width, dest_height);
+}
+
 void FormatConverter::operator()(AVFrame* src, AVFrame* dst) {
   bool must_reinit = false;
 
@@ -143,13 +156,32 @@ void FormatConverter::operator()(AVFrame* src, AVFrame* dst) {
     active_flags_ = pending_flags_;
     must_reinit = true;
   }
+  const uint64_t pending_dest_size = pending_dest_size_;
+
+  if (pending_dest_size != pack_size(dest_width_, dest_height_)) {
+    dest_width_ = pending_dest_size >> 32;
+    dest_height_ = pending_dest_size & 0xFFFFFFFF;
+    must_reinit = true;
+  }
 
   if (must_reinit) {
     reinit();
   }
 
+  // reference counted, so the converted frame can be shared (e.g. with PNG exports) instead of copied
+  if (dst->data[0] == nullptr) {
+    dst->format = dest_pixel_format();
+    dst->width = dest_width();
+    dst->height = dest_height();
+
+    if (av_frame_get_buffer(dst, 64) < 0) {
+      throw ffmpeg::Error{"Allocating converted picture"};
+    }
+  }
+
   av_dict_set(&dst->metadata, "original_width", std::to_string(src->width).c_str(), 0);
   av_dict_set(&dst->metadata, "original_height", std::to_string(src->height).c_str(), 0);
+  av_dict_set(&dst->metadata, "sws_flags", std::to_string(active_flags_).c_str(), 0);
 
   sws_scale(conversion_context_,
             // Source
@@ -160,4 +192,7 @@ void FormatConverter::operator()(AVFrame* src, AVFrame* dst) {
   dst->format = dest_pixel_format();
   dst->width = dest_width();
   dst->height = dest_height();
+
+  // the hash is computed on demand, and any copied from the properties of another frame no longer applies
+  ffmpeg::clear_content_hash(dst);
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include "side_aware.h"
 extern "C" {
 #include "libavformat/avformat.h"
@@ -31,7 +32,9 @@ class FormatConverter : public SideAware {
   AVPixelFormat dest_pixel_format() const;
 
   void set_pending_flags(const int flags);
+  void set_pending_dest_size(const size_t dest_width, const size_t dest_height);
 
+  // allocates the destination picture if dst->data[0] is null
   void operator()(AVFrame* src, AVFrame* dst);
 
  private:
@@ -39,15 +42,18 @@ class FormatConverter : public SideAware {
   size_t src_height_;
   AVPixelFormat src_pixel_format_;
 
-  const size_t dest_width_;
-  const size_t dest_height_;
+  size_t dest_width_;
+  size_t dest_height_;
   const AVPixelFormat dest_pixel_format_;
 
   AVColorSpace src_color_space_;
   AVColorRange src_color_range_;
 
   int active_flags_;
-  int pending_flags_;
+  std::atomic_int pending_flags_;
+
+  // width in the upper and height in the lower 32 bits, so both change at once
+  std::atomic<uint64_t> pending_dest_size_;
 
   SwsContext* conversion_context_{};
 };
@@ -0,0 +1,104 @@
+#include "frame_pairer.h"
+#include <algorithm>
+#include "ffmpeg.h"
+
+// as for the interactive comparison: 80% of the shorter frame duration, but at least 1/480 s
+static constexpr int64_t MIN_PAIRING_TOLERANCE = AV_TIME_BASE / 480;
+
+FramePairer::FramePairer(FrameSource::FrameQueue* left_frames, FrameSource::FrameQueue* right_frames, const TimeShiftConfig& time_shift)
+    : left_frames_{left_frames}, right_frames_{right_frames}, time_shift_(time_shift) {}
+
+int64_t FramePairer::right_to_left_time(const TimeShiftConfig& time_shift, const int64_t right_pts) {
+  if (right_pts == INT64_MIN || right_pts == INT64_MAX || right_pts == AV_NOPTS_VALUE) {
+    return right_pts;
+  }
+
+  return av_rescale_q(right_pts, AVRational{time_shift.multiplier.den, time_shift.multiplier.num}, AVRational{1, 1}) - time_shift.offset_ms * 1000;
+}
+
+int64_t FramePairer::left_to_right_time(const TimeShiftConfig& time_shift, const int64_t left_pts) {
+  if (left_pts == INT64_MIN || left_pts == INT64_MAX || left_pts == AV_NOPTS_VALUE) {
+    return left_pts;
+  }
+
+  return av_rescale_q(left_pts + time_shift.offset_ms * 1000, time_shift.multiplier, AVRational{1, 1});
+}
+
+int64_t FramePairer::duration_of(const AVFrame* frame, const int64_t previous_pts) {
+  const int64_t duration = ffmpeg::frame_duration(frame);
+
+  if (duration > 0) {
+    return duration;
+  }
+
+  return (previous_pts != AV_NOPTS_VALUE && frame->pts > previous_pts) ? frame->pts - previous_pts : 0;
+}
+
+bool FramePairer::next(std::shared_ptr<AVFrame>& left_frame, std::shared_ptr<AVFrame>& right_frame) {
+  while (true) {
+    if (left_frame_ == nullptr && !left_frames_->pop(left_frame_)) {
+      left_ended_ = true;
+    }
+    if (right_frame_ == nullptr && !right_frames_->pop(right_frame_)) {
+      right_ended_ = true;
+    }
+    if (left_ended_ || right_ended_) {
+      return false;
+    }
+
+    // frames without time stamps can only be paired in order
+    if (left_frame_->pts == AV_NOPTS_VALUE || right_frame_->pts == AV_NOPTS_VALUE) {
+      break;
+    }
+
+    const int64_t left_pts = left_frame_->pts;
+    const int64_t right_pts = right_to_left_time(time_shift_, right_frame_->pts);
+
+    const int64_t left_duration = duration_of(left_frame_.get(), previous_left_pts_);
+    const int64_t right_duration = av_rescale_q(duration_of(right_frame_.get(), previous_right_pts_), AVRational{time_shift_.multiplier.den, time_shift_.multiplier.num}, AVRational{1, 1});
+
+    const int64_t shorter_duration = (left_duration > 0 && right_duration > 0) ? std::min(left_duration, right_duration) : std::max(left_duration, right_duration);
+    const int64_t tolerance = std::max(shorter_duration * 8 / 10, MIN_PAIRING_TOLERANCE);
+
+    if (right_pts < left_pts - tolerance) {
+      previous_right_pts_ = right_frame_->pts;
+      right_frame_.reset();
+      skipped_right_frames_++;
+    } else if (left_pts < right_pts - tolerance) {
+      previous_left_pts_ = left_frame_->pts;
+      left_frame_.reset();
+      skipped_left_frames_++;
+    } else {
+      break;
+    }
+  }
+
+  previous_left_pts_ = left_frame_->pts;
+  previous_right_pts_ = right_frame_->pts;
+
+  left_frame = std::move(left_frame_);
+  right_frame = std::move(right_frame_);
+
+  return true;
+}
+
+std::string FramePairer::remaining_frames_side() {
+  if (left_ended_ && right_ended_) {
+    return "";
+  }
+
+  // the side which has not ended may or may not have a frame left
+  if (left_ended_) {
+    return (right_frame_ != nullptr || right_frames_->pop(right_frame_)) ? "right" : "";
+  }
+
+  return (left_frame_ != nullptr || left_frames_->pop(left_frame_)) ? "left" : "";
+}
+
+uint64_t FramePairer::skipped_left_frames() const {
+  return skipped_left_frames_;
+}
+
+uint64_t FramePairer::skipped_right_frames() const {
+  return skipped_right_frames_;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "config.h"
+#include "frame_source.h"
+
+// Pairs the frames of two FrameSources by presentation time, as the interactive comparison does: right PTS are
+// mapped onto the left timeline by the time shift, and frames are paired when they are less than about a frame
+// apart. Frames without a counterpart are skipped and counted, so a dropped or duplicated frame on one side does not
+// misalign the rest of the comparison.
+class FramePairer {
+ public:
+  FramePairer(FrameSource::FrameQueue* left_frames, FrameSource::FrameQueue* right_frames, const TimeShiftConfig& time_shift);
+
+  // both frames keep their own PTS; returns false once either side has ended
+  bool next(std::shared_ptr<AVFrame>& left_frame, std::shared_ptr<AVFrame>& right_frame);
+
+  // after next() returned false: "left" or "right" if that side still had frames, otherwise empty
+  std::string remaining_frames_side();
+
+  uint64_t skipped_left_frames() const;
+  uint64_t skipped_right_frames() const;
+
+  // in microseconds; INT64_MIN and INT64_MAX are kept as open range limits
+  static int64_t right_to_left_time(const TimeShiftConfig& time_shift, const int64_t right_pts);
+  static int64_t left_to_right_time(const TimeShiftConfig& time_shift, const int64_t left_pts);
+
+ private:
+  // the frame's duration if known, otherwise the distance to the previous frame of the same side
+  static int64_t duration_of(const AVFrame* frame, const int64_t previous_pts);
+
+  FrameSource::FrameQueue* left_frames_;
+  FrameSource::FrameQueue* right_frames_;
+  const TimeShiftConfig time_shift_;
+
+  std::shared_ptr<AVFrame> left_frame_;
+  std::shared_ptr<AVFrame> right_frame_;
+  bool left_ended_{false};
+  bool right_ended_{false};
+
+  int64_t previous_left_pts_{AV_NOPTS_VALUE};
+  int64_t previous_right_pts_{AV_NOPTS_VALUE};
+
+  uint64_t skipped_left_frames_{0};
+  uint64_t skipped_right_frames_{0};
+};
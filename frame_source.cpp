@@ -0,0 +1,263 @@
+#include "frame_source.h"
+#include <stdexcept>
+#include "ffmpeg.h"
+#include "string_utils.h"
+
+// without an index, seeking only pays off for large gaps
+static constexpr int64_t UNINDEXED_SEEK_DISTANCE = 10 * AV_TIME_BASE;
+
+static auto avpacket_deleter = [](AVPacket* packet) {
+  av_packet_unref(packet);
+  delete packet;
+};
+
+static auto avframe_deleter = [](AVFrame* frame) { av_frame_free(&frame); };
+
+FrameSource::FrameSource(const Side side, const InputVideo& input, const VideoCompareConfig& config) : SideAware(side) {
+  // the demuxer and decoder take over their options, so several sources can be created from the same input
+  AVDictionary* demuxer_options = nullptr;
+  AVDictionary* decoder_options = nullptr;
+  AVDictionary* hw_accel_options = nullptr;
+
+  av_dict_copy(&demuxer_options, input.demuxer_options, 0);
+  av_dict_copy(&decoder_options, input.decoder_options, 0);
+  av_dict_copy(&hw_accel_options, input.hw_accel_options, 0);
+
+  demuxer_ = std::make_unique<Demuxer>(side, input.demuxer, input.file_name, demuxer_options, decoder_options, config.read_ahead_size, config.memory_mapped_input, config.verbose);
+  video_decoder_ = std::make_unique<VideoDecoder>(side, input.decoder, input.hw_accel_spec, demuxer_->video_codec_parameters(), input.peak_luminance_nits, hw_accel_options, decoder_options);
+}
+
+FrameSource::~FrameSource() {
+  if (thread_.joinable()) {
+    quit();
+    thread_.join();
+  }
+}
+
+void FrameSource::create_filterer(const InputVideo& input, const InputVideo& other_input, const FrameSource& other, const VideoCompareConfig& config) {
+  video_filterer_ = std::make_unique<VideoFilterer>(get_side(), demuxer_.get(), video_decoder_.get(), input.tone_mapping_mode, input.boost_tone, input.video_filters, input.color_space, input.color_range, input.color_primaries,
+                                                    input.color_trc, other.demuxer(), other.video_decoder(), other_input.color_trc, config.disable_auto_filters, config.tone_map_lut, config.verbose);
+}
+
+Demuxer* FrameSource::demuxer() const {
+  return demuxer_.get();
+}
+
+VideoDecoder* FrameSource::video_decoder() const {
+  return video_decoder_.get();
+}
+
+VideoFilterer* FrameSource::video_filterer() const {
+  return video_filterer_.get();
+}
+
+FrameSource::FrameQueue* FrameSource::add_consumer(const size_t queue_size) {
+  consumers_.push_back(std::make_unique<FrameQueue>(queue_size));
+
+  return consumers_.back().get();
+}
+
+void FrameSource::restrict_to(const int64_t start_pts, const int64_t end_pts) {
+  start_pts_ = start_pts;
+  end_pts_ = end_pts;
+
+  if (start_pts_ > 0 && !demuxer_->seek((start_pts_ + demuxer_->start_time()) * AV_TIME_TO_SEC, true)) {
+    throw std::runtime_error(string_sprintf("Could not seek to %.3f s", start_pts_ * AV_TIME_TO_SEC));
+  }
+}
+
+void FrameSource::sample_at(const std::vector<int64_t>& sample_pts, const int64_t tolerance) {
+  sample_pts_ = sample_pts;
+  next_sample_ = 0;
+  sample_tolerance_ = tolerance;
+}
+
+void FrameSource::start(const size_t width, const size_t height, const AVPixelFormat pixel_format) {
+  width_ = width;
+  height_ = height;
+  pixel_format_ = pixel_format;
+
+  format_converter_ = std::make_unique<FormatConverter>(video_filterer_->dest_width(), video_filterer_->dest_height(), width_, height_, video_filterer_->dest_pixel_format(), pixel_format_, video_decoder_->color_space(),
+                                                        video_decoder_->color_range(), get_side(), SWS_BICUBIC | SWS_FULL_CHR_H_INT | SWS_ACCURATE_RND);
+
+  thread_ = std::thread(&FrameSource::run, this);
+}
+
+void FrameSource::quit() {
+  for (auto& consumer : consumers_) {
+    consumer->quit();
+  }
+}
+
+void FrameSource::finish() {
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  if (exception_ != nullptr) {
+    std::rethrow_exception(exception_);
+  }
+}
+
+bool FrameSource::deliver(std::shared_ptr<AVFrame> frame) {
+  if (frame->pts != AV_NOPTS_VALUE) {
+    // frames decoded on the way from the preceding keyframe
+    if (frame->pts < start_pts_) {
+      return true;
+    }
+    if (frame->pts >= end_pts_) {
+      return false;
+    }
+  }
+
+  // true unless the last sample is being delivered
+  bool more_frames_wanted = true;
+
+  // one per sample the frame is the first one for, so both sides deliver a frame for every sample
+  size_t deliveries = 1;
+
+  if (!sample_pts_.empty()) {
+    if (frame->pts == AV_NOPTS_VALUE || frame->pts < sample_pts_[next_sample_] - sample_tolerance_) {
+      return true;
+    }
+
+    deliveries = 0;
+
+    while (next_sample_ < sample_pts_.size() && sample_pts_[next_sample_] - sample_tolerance_ <= frame->pts) {
+      next_sample_++;
+      deliveries++;
+    }
+
+    if (next_sample_ < sample_pts_.size()) {
+      const int64_t next_sample_pts = sample_pts_[next_sample_];
+
+      // the keyframe starting the GOP of the next sample, which may be the sampled frame itself
+      const int64_t keyframe_pts = demuxer_->keyframe_at_or_before(next_sample_pts + sample_tolerance_);
+
+      seek_pending_ = keyframe_pts != AV_NOPTS_VALUE ? keyframe_pts > frame->pts : next_sample_pts - frame->pts > UNINDEXED_SEEK_DISTANCE;
+    } else {
+      more_frames_wanted = false;
+    }
+  }
+
+  if (frame->format != pixel_format_ || static_cast<size_t>(frame->width) != width_ || static_cast<size_t>(frame->height) != height_) {
+    std::shared_ptr<AVFrame> converted_frame{av_frame_alloc(), avframe_deleter};
+
+    if (av_frame_copy_props(converted_frame.get(), frame.get()) < 0) {
+      throw std::runtime_error("Copying filtered frame properties");
+    }
+    (*format_converter_)(frame.get(), converted_frame.get());
+
+    frame = converted_frame;
+  }
+
+  // consumers which gave up early are skipped, so they don't hold back the others
+  bool delivered = false;
+
+  for (size_t i = 0; i < deliveries; i++) {
+    for (auto& consumer : consumers_) {
+      if (consumer->push(frame)) {
+        delivered = true;
+      }
+    }
+  }
+
+  return delivered && more_frames_wanted;
+}
+
+void FrameSource::run() {
+  ScopedLogSide scoped_log_side(get_side());
+
+  auto filter_frames = [&](AVFrame* decoded_frame) {
+    if (!video_filterer_->send(decoded_frame)) {
+      throw std::runtime_error("Error while feeding the filter graph");
+    }
+
+    while (true) {
+      std::shared_ptr<AVFrame> filtered_frame{av_frame_alloc(), avframe_deleter};
+
+      if (!video_filterer_->receive(filtered_frame.get())) {
+        return true;
+      }
+      if (!deliver(filtered_frame)) {
+        return false;
+      }
+    }
+  };
+
+  auto receive_frames = [&]() {
+    while (true) {
+      std::shared_ptr<AVFrame> frame{av_frame_alloc(), avframe_deleter};
+
+      if (!video_decoder_->receive(frame.get(), demuxer_.get())) {
+        return true;
+      }
+
+      if (frame->format == video_decoder_->hw_pixel_format()) {
+        std::shared_ptr<AVFrame> sw_frame{av_frame_alloc(), avframe_deleter};
+
+        // Transfer data from GPU to CPU
+        if (av_hwframe_transfer_data(sw_frame.get(), frame.get(), 0) < 0) {
+          throw std::runtime_error("Error transferring frame from GPU to CPU");
+        }
+        if (av_frame_copy_props(sw_frame.get(), frame.get()) < 0) {
+          throw std::runtime_error("Copying SW frame properties");
+        }
+
+        frame = sw_frame;
+      }
+
+      if (!filter_frames(frame.get())) {
+        return false;
+      }
+    }
+  };
+
+  try {
+    // false once all consumers gave up, or the end of the range was reached
+    bool delivering = true;
+
+    while (delivering) {
+      if (seek_pending_) {
+        seek_pending_ = false;
+
+        // lands on the keyframe starting the GOP of the next sample; on failure, decoding simply carries on
+        if (demuxer_->seek((sample_pts_[next_sample_] + sample_tolerance_ + demuxer_->start_time()) * AV_TIME_TO_SEC, true)) {
+          video_decoder_->flush();
+          video_filterer_->reinit();
+        }
+      }
+
+      std::unique_ptr<AVPacket, decltype(avpacket_deleter)> packet{new AVPacket, avpacket_deleter};
+      av_init_packet(packet.get());
+      packet->data = nullptr;
+
+      if (!(*demuxer_)(*packet)) {
+        // drain the decoder and the filter graph
+        video_decoder_->send(nullptr);
+
+        if (receive_frames()) {
+          video_filterer_->close_src();
+          filter_frames(nullptr);
+        }
+        break;
+      }
+      if (packet->stream_index != demuxer_->video_stream_index()) {
+        continue;
+      }
+
+      // receive frames until the packet is accepted
+      while (delivering && !video_decoder_->send(packet.get())) {
+        delivering = receive_frames();
+      }
+      delivering = delivering && receive_frames();
+    }
+  } catch (...) {
+    exception_ = std::current_exception();
+    quit();
+    return;
+  }
+
+  for (auto& consumer : consumers_) {
+    consumer->stop();
+  }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "core_types.h"
+#include "demuxer.h"
+#include "format_converter.h"
+#include "queue.h"
+#include "side_aware.h"
+#include "video_decoder.h"
+#include "video_filterer.h"
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Decodes and filters one input on a background thread for headless processing, delivering the frames in a given
+// pixel format and size. Every frame is handed to each consumer queue by reference, so several consumers can
+// share a single decode.
+class FrameSource : public SideAware {
+ public:
+  using FrameQueue = Queue<std::shared_ptr<AVFrame>>;
+
+  FrameSource(const Side side, const InputVideo& input, const VideoCompareConfig& config);
+  ~FrameSource() override;
+
+  // must be called before start(); as for display, the filter graph takes the other input into account
+  void create_filterer(const InputVideo& input, const InputVideo& other_input, const FrameSource& other, const VideoCompareConfig& config);
+
+  Demuxer* demuxer() const;
+  VideoDecoder* video_decoder() const;
+  VideoFilterer* video_filterer() const;
+
+  // must be called before start()
+  FrameQueue* add_consumer(const size_t queue_size);
+
+  // must be called before start(); only frames with a PTS in [start_pts, end_pts), in microseconds, are delivered.
+  // Decoding begins at the keyframe preceding the start, and ends with the first frame past the end.
+  void restrict_to(const int64_t start_pts, const int64_t end_pts);
+
+  // must be called before start(); only the first frame at or after each of the given PTS (in microseconds, and in
+  // ascending order) is delivered, once per sample, so a frame following a gap also stands in for the samples within
+  // it. Frames up to the tolerance early still count, for slightly irregular time stamps. Where the keyframe index
+  // shows that the next sample lies in a later GOP, the demuxer seeks instead of decoding everything in between.
+  void sample_at(const std::vector<int64_t>& sample_pts, const int64_t tolerance);
+
+  // frames are converted where their pixel format or size differ from the given ones
+  void start(const size_t width, const size_t height, const AVPixelFormat pixel_format);
+
+  // makes the background thread give up, e.g. after an error elsewhere
+  void quit();
+
+  // waits for the background thread, and rethrows its error, if any
+  void finish();
+
+ private:
+  void run();
+
+  bool deliver(std::shared_ptr<AVFrame> frame);
+
+  std::unique_ptr<Demuxer> demuxer_;
+  std::unique_ptr<VideoDecoder> video_decoder_;
+  std::unique_ptr<VideoFilterer> video_filterer_;
+  std::unique_ptr<FormatConverter> format_converter_;
+
+  size_t width_{0};
+  size_t height_{0};
+  AVPixelFormat pixel_format_{AV_PIX_FMT_NONE};
+
+  int64_t start_pts_{INT64_MIN};
+  int64_t end_pts_{INT64_MAX};
+
+  std::vector<int64_t> sample_pts_;
+  size_t next_sample_{0};
+  int64_t sample_tolerance_{0};
+  bool seek_pending_{false};
+
+  std::vector<std::unique_ptr<FrameQueue>> consumers_;
+
+  std::thread thread_;
+  std::exception_ptr exception_;
+};
@@ -0,0 +1,166 @@
+#include "image_sequence_decoder.h"
+#include <algorithm>
+#include "ffmpeg.h"
+
+static auto avframe_deleter = [](AVFrame* frame) { av_frame_free(&frame); };
+
+ImageSequenceDecoder::ImageSequenceDecoder(const Side side, const AVCodec* codec, const AVCodecParameters* codec_parameters, const size_t worker_count, const size_t lookahead)
+    : SideAware(side), lookahead_(std::max(lookahead, static_cast<size_t>(1))) {
+  ScopedLogSide scoped_log_side(side);
+
+  for (size_t i = 0; i < std::max(worker_count, static_cast<size_t>(1)); i++) {
+    AVCodecContext* codec_context = avcodec_alloc_context3(codec);
+
+    if (codec_context == nullptr) {
+      throw ffmpeg::Error{"Couldn't allocate video codec context"};
+    }
+
+    codec_contexts_.push_back(codec_context);
+
+    ffmpeg::check(avcodec_parameters_to_context(codec_context, codec_parameters));
+
+    // the parallelism comes from the pool
+    codec_context->thread_count = 1;
+
+    ffmpeg::check(avcodec_open2(codec_context, codec, nullptr));
+  }
+
+  for (auto codec_context : codec_contexts_) {
+    workers_.emplace_back(&ImageSequenceDecoder::work, this, codec_context);
+  }
+}
+
+ImageSequenceDecoder::~ImageSequenceDecoder() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  job_available_.notify_all();
+
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+
+  for (auto& codec_context : codec_contexts_) {
+    avcodec_free_context(&codec_context);
+  }
+}
+
+size_t ImageSequenceDecoder::worker_count() const {
+  return codec_contexts_.size();
+}
+
+size_t ImageSequenceDecoder::lookahead() const {
+  return lookahead_;
+}
+
+bool ImageSequenceDecoder::is_full() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return in_flight_.size() >= lookahead_;
+}
+
+void ImageSequenceDecoder::submit(AVPacketUniquePtr packet) {
+  auto job = std::make_shared<Job>();
+  job->packet = std::move(packet);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    in_flight_.push_back(job);
+    queued_.push_back(job);
+  }
+
+  job_available_.notify_one();
+}
+
+std::shared_ptr<AVFrame> ImageSequenceDecoder::receive(const bool wait) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  if (in_flight_.empty()) {
+    return nullptr;
+  }
+
+  std::shared_ptr<Job> job = in_flight_.front();
+
+  if (!job->done) {
+    if (!wait) {
+      return nullptr;
+    }
+
+    job_done_.wait(lock, [&]() { return job->done; });
+  }
+
+  in_flight_.pop_front();
+
+  if (job->error < 0) {
+    throw ffmpeg::Error{job->error};
+  }
+
+  return job->frame;
+}
+
+void ImageSequenceDecoder::flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // jobs being decoded complete unobserved
+  in_flight_.clear();
+  queued_.clear();
+}
+
+void ImageSequenceDecoder::work(AVCodecContext* codec_context) {
+  ScopedLogSide scoped_log_side(get_side());
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (true) {
+    job_available_.wait(lock, [this]() { return quit_ || !queued_.empty(); });
+
+    if (quit_) {
+      break;
+    }
+
+    std::shared_ptr<Job> job = queued_.front();
+    queued_.pop_front();
+
+    lock.unlock();
+
+    std::shared_ptr<AVFrame> frame{av_frame_alloc(), avframe_deleter};
+    const int error = decode(codec_context, job->packet.get(), frame.get());
+
+    lock.lock();
+
+    job->frame = frame;
+    job->error = error;
+    job->done = true;
+
+    job_done_.notify_all();
+  }
+}
+
+int ImageSequenceDecoder::decode(AVCodecContext* codec_context, AVPacket* packet, AVFrame* frame) {
+  int ret = avcodec_send_packet(codec_context, packet);
+
+  if (ret >= 0) {
+    ret = avcodec_receive_frame(codec_context, frame);
+
+    // drain codecs which hold on to the frame
+    if (ret == AVERROR(EAGAIN)) {
+      avcodec_send_packet(codec_context, nullptr);
+      ret = avcodec_receive_frame(codec_context, frame);
+    }
+  }
+
+  // ready for the next, unrelated image
+  avcodec_flush_buffers(codec_context);
+
+  if (ret < 0) {
+    return ret;
+  }
+
+  // decoded images carry no reliable timing of their own
+  frame->pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+  ffmpeg::frame_duration(frame) = packet->duration;
+
+  return 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "packet_queue.h"
+#include "side_aware.h"
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Decodes the images of a sequence on a pool of workers, each with its own single-threaded codec context, since
+// image codecs are independent per frame and rarely support frame threading. Images are decoded ahead out of
+// order, within a bounded look-ahead window, and handed out in submission order.
+class ImageSequenceDecoder : public SideAware {
+ public:
+  ImageSequenceDecoder(const Side side, const AVCodec* codec, const AVCodecParameters* codec_parameters, const size_t worker_count, const size_t lookahead);
+  ~ImageSequenceDecoder();
+
+  size_t worker_count() const;
+  size_t lookahead() const;
+
+  // true while the look-ahead window is full, in which case the next frame has to be received before submitting more
+  bool is_full() const;
+
+  void submit(AVPacketUniquePtr packet);
+
+  // the next frame in submission order, or null if nothing is in flight or, unless waiting, if it is not decoded yet;
+  // decoding errors are rethrown here
+  std::shared_ptr<AVFrame> receive(const bool wait);
+
+  // abandons all images in flight, e.g. when seeking
+  void flush();
+
+ private:
+  struct Job {
+    AVPacketUniquePtr packet;
+    std::shared_ptr<AVFrame> frame;
+    int error{0};
+    bool done{false};
+  };
+
+  void work(AVCodecContext* codec_context);
+  int decode(AVCodecContext* codec_context, AVPacket* packet, AVFrame* frame);
+
+  const size_t lookahead_;
+
+  std::vector<AVCodecContext*> codec_contexts_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable job_available_;
+  std::condition_variable job_done_;
+
+  // in submission order; queued_ holds the jobs not yet picked up by a worker
+  std::deque<std::shared_ptr<Job>> in_flight_;
+  std::deque<std::shared_ptr<Job>> queued_;
+
+  bool quit_{false};
+
+  std::vector<std::thread> workers_;
+};
@@ -0,0 +1,461 @@
+#include "input_io.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "ffmpeg.h"
+#include "string_utils.h"
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr int AVIO_BUFFER_SIZE = 64 * 1024;
+static constexpr size_t MAX_CHUNK_SIZE = 1024 * 1024;
+
+// seeks further than this are treated as random access
+static constexpr int64_t RANDOM_ACCESS_DISTANCE = 1024 * 1024;
+
+// contiguous reads after a seek needed to consider access sequential again
+static constexpr int64_t SEQUENTIAL_RUN_LENGTH = 4 * 1024 * 1024;
+
+static const std::string FILE_PROTOCOL_PREFIX = "file:";
+
+InputIO::InputIO(const int buffer_size) {
+  uint8_t* buffer = reinterpret_cast<uint8_t*>(av_malloc(buffer_size));
+
+  if (buffer == nullptr) {
+    throw ffmpeg::Error{"Failed to allocate I/O buffer"};
+  }
+
+  context_ = avio_alloc_context(buffer, buffer_size, 0, this, &InputIO::read_callback, nullptr, &InputIO::seek_callback);
+
+  if (context_ == nullptr) {
+    av_free(buffer);
+    throw ffmpeg::Error{"Failed to allocate I/O context"};
+  }
+}
+
+InputIO::~InputIO() {
+  av_freep(&context_->buffer);
+  avio_context_free(&context_);
+}
+
+AVIOContext* InputIO::context() const {
+  return context_;
+}
+
+std::string InputIO::statistics() const {
+  return "";
+}
+
+bool InputIO::is_local_file(const std::string& url) {
+  return url.find("://") == std::string::npos && (url.find(':') == std::string::npos || url.compare(0, FILE_PROTOCOL_PREFIX.size(), FILE_PROTOCOL_PREFIX) == 0 || (url.size() > 1 && url[1] == ':'));
+}
+
+std::string InputIO::local_path(const std::string& url) {
+  return url.compare(0, FILE_PROTOCOL_PREFIX.size(), FILE_PROTOCOL_PREFIX) == 0 ? url.substr(FILE_PROTOCOL_PREFIX.size()) : url;
+}
+
+int InputIO::read_callback(void* opaque, uint8_t* buffer, int size) {
+  return reinterpret_cast<InputIO*>(opaque)->read(buffer, size);
+}
+
+int64_t InputIO::seek_callback(void* opaque, int64_t offset, int whence) {
+  return reinterpret_cast<InputIO*>(opaque)->seek(offset, whence);
+}
+
+ReadAheadIO::ReadAheadIO(const std::string& url, const size_t ring_buffer_size)
+    : InputIO(AVIO_BUFFER_SIZE), ring_(std::max(ring_buffer_size, static_cast<size_t>(AVIO_BUFFER_SIZE))), chunk_size_(std::min(MAX_CHUNK_SIZE, ring_.size() / 4)) {
+  ffmpeg::check(url, avio_open2(&source_, url.c_str(), AVIO_FLAG_READ, nullptr, nullptr));
+
+  source_size_ = avio_size(source_);
+
+  fill_thread_ = std::thread(&ReadAheadIO::fill, this);
+}
+
+ReadAheadIO::~ReadAheadIO() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  space_available_.notify_all();
+
+  fill_thread_.join();
+
+  avio_closep(&source_);
+}
+
+void ReadAheadIO::fill() {
+  std::vector<uint8_t> chunk(chunk_size_);
+  int64_t source_position = 0;
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  while (!quit_) {
+    // do not overwrite data which has not been read yet
+    if (end_of_file_ || error_ != 0 || (ring_end_ - position_) > static_cast<int64_t>(ring_.size() - chunk_size_)) {
+      space_available_.wait(lock);
+      continue;
+    }
+
+    const int64_t offset = ring_end_;
+    const uint64_t generation = generation_;
+
+    lock.unlock();
+
+    int result = 0;
+
+    if (source_position != offset) {
+      const int64_t seek_result = avio_seek(source_, offset, SEEK_SET);
+      result = seek_result < 0 ? static_cast<int>(seek_result) : 0;
+    }
+    if (result == 0) {
+      result = avio_read(source_, chunk.data(), static_cast<int>(chunk_size_));
+    }
+
+    lock.lock();
+
+    // the buffered range was discarded by a seek in the meantime
+    if (generation != generation_) {
+      source_position = -1;
+      continue;
+    }
+
+    if (result <= 0) {
+      if (result == 0 || result == AVERROR_EOF) {
+        end_of_file_ = true;
+      } else {
+        error_ = result;
+      }
+    } else if (offset + result - static_cast<int64_t>(ring_.size()) > position_) {
+      // a backward seek within the buffered range in the meantime left no room for the chunk, which would overwrite
+      // data at the new read position
+      source_position = -1;
+      continue;
+    } else {
+      source_position = offset + result;
+
+      const size_t ring_offset = static_cast<size_t>(offset % static_cast<int64_t>(ring_.size()));
+      const size_t first_part = std::min(static_cast<size_t>(result), ring_.size() - ring_offset);
+
+      memcpy(ring_.data() + ring_offset, chunk.data(), first_part);
+      memcpy(ring_.data(), chunk.data() + first_part, result - first_part);
+
+      ring_end_ += result;
+      ring_start_ = std::max(ring_start_, ring_end_ - static_cast<int64_t>(ring_.size()));
+    }
+
+    data_available_.notify_all();
+  }
+}
+
+int ReadAheadIO::read(uint8_t* buffer, const int size) {
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  reads_++;
+
+  // the data at the read position is no longer buffered, so it must be read again
+  if (position_ < ring_start_) {
+    ring_start_ = position_;
+    ring_end_ = position_;
+    end_of_file_ = false;
+    error_ = 0;
+    generation_++;
+
+    space_available_.notify_all();
+  }
+
+  if (position_ >= ring_end_ && !end_of_file_ && error_ == 0) {
+    const auto stall_start = std::chrono::steady_clock::now();
+
+    data_available_.wait(lock, [this]() { return position_ < ring_end_ || end_of_file_ || error_ != 0 || quit_; });
+
+    stalled_reads_++;
+    stall_time_us_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - stall_start).count();
+  }
+
+  if (position_ >= ring_end_) {
+    return error_ != 0 ? error_ : AVERROR_EOF;
+  }
+
+  const int bytes = static_cast<int>(std::min(static_cast<int64_t>(size), ring_end_ - position_));
+  const size_t ring_offset = static_cast<size_t>(position_ % static_cast<int64_t>(ring_.size()));
+  const size_t first_part = std::min(static_cast<size_t>(bytes), ring_.size() - ring_offset);
+
+  memcpy(buffer, ring_.data() + ring_offset, first_part);
+  memcpy(buffer + first_part, ring_.data(), bytes - first_part);
+
+  position_ += bytes;
+  bytes_read_ += bytes;
+
+  lock.unlock();
+  space_available_.notify_all();
+
+  return bytes;
+}
+
+int64_t ReadAheadIO::seek(const int64_t offset, const int whence) {
+  if (whence & AVSEEK_SIZE) {
+    return source_size_ >= 0 ? source_size_ : AVERROR(ENOSYS);
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  int64_t target;
+
+  switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+      target = offset;
+      break;
+    case SEEK_CUR:
+      target = position_ + offset;
+      break;
+    case SEEK_END:
+      if (source_size_ < 0) {
+        return AVERROR(ENOSYS);
+      }
+      target = source_size_ + offset;
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+
+  if (target < 0) {
+    return AVERROR(EINVAL);
+  }
+
+  if (target >= ring_start_ && target <= ring_end_) {
+    reused_seeks_++;
+  } else {
+    ring_start_ = target;
+    ring_end_ = target;
+    end_of_file_ = false;
+    error_ = 0;
+    generation_++;
+
+    refilling_seeks_++;
+  }
+
+  position_ = target;
+
+  lock.unlock();
+  space_available_.notify_all();
+
+  return target;
+}
+
+std::string ReadAheadIO::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const float hit_rate = reads_ > 0 ? 100.0F * static_cast<float>(reads_ - stalled_reads_) / static_cast<float>(reads_) : 100.0F;
+
+  return string_sprintf("Read-ahead: %.1f MiB in %llu reads, %.1f%% served from the %.0f MiB buffer, stalled for %.1f ms in total, seeks: %llu within buffer, %llu refilling", static_cast<float>(bytes_read_) / (1024 * 1024),
+                        static_cast<unsigned long long>(reads_), hit_rate, static_cast<float>(ring_.size()) / (1024 * 1024), static_cast<float>(stall_time_us_) / 1000.0F, static_cast<unsigned long long>(reused_seeks_),
+                        static_cast<unsigned long long>(refilling_seeks_));
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& file_name) {
+  const int wide_length = MultiByteToWideChar(CP_UTF8, 0, file_name.c_str(), -1, nullptr, 0);
+  std::wstring wide_file_name(wide_length, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, file_name.c_str(), -1, &wide_file_name[0], wide_length);
+
+  HANDLE file_handle = CreateFileW(wide_file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+  if (file_handle == INVALID_HANDLE_VALUE) {
+    throw ffmpeg::Error{file_name, AVERROR(ENOENT)};
+  }
+
+  file_handle_ = file_handle;
+
+  LARGE_INTEGER file_size;
+
+  if (!GetFileSizeEx(file_handle, &file_size)) {
+    CloseHandle(file_handle);
+    throw ffmpeg::Error{file_name, AVERROR(EIO)};
+  }
+
+  size_ = static_cast<size_t>(file_size.QuadPart);
+
+  // empty files cannot be mapped
+  if (size_ == 0) {
+    return;
+  }
+
+  mapping_handle_ = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+  if (mapping_handle_ != nullptr) {
+    data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+  }
+
+  if (data_ == nullptr) {
+    if (mapping_handle_ != nullptr) {
+      CloseHandle(mapping_handle_);
+    }
+    CloseHandle(file_handle);
+    throw ffmpeg::Error{file_name, AVERROR(ENOMEM)};
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_handle_);
+  }
+  CloseHandle(file_handle_);
+}
+
+void MappedFile::advise_sequential() {
+}
+
+void MappedFile::advise_random() {
+}
+#else
+MappedFile::MappedFile(const std::string& file_name) {
+  const int fd = open(file_name.c_str(), O_RDONLY);
+
+  if (fd < 0) {
+    throw ffmpeg::Error{file_name, AVERROR(errno)};
+  }
+
+  struct stat file_stat;
+
+  if (fstat(fd, &file_stat) != 0) {
+    const int error = errno;
+    close(fd);
+    throw ffmpeg::Error{file_name, AVERROR(error)};
+  }
+
+  size_ = static_cast<size_t>(file_stat.st_size);
+
+  // empty files cannot be mapped
+  if (size_ > 0) {
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED) {
+      const int error = errno;
+      close(fd);
+      throw ffmpeg::Error{file_name, AVERROR(error)};
+    }
+
+    data_ = static_cast<const uint8_t*>(data);
+  }
+
+  // the mapping stays valid after closing the descriptor
+  close(fd);
+
+  advise_sequential();
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+}
+
+void MappedFile::advise_sequential() {
+  if (data_ != nullptr) {
+    madvise(const_cast<uint8_t*>(data_), size_, MADV_SEQUENTIAL);
+  }
+}
+
+void MappedFile::advise_random() {
+  if (data_ != nullptr) {
+    madvise(const_cast<uint8_t*>(data_), size_, MADV_RANDOM);
+  }
+}
+#endif
+
+const uint8_t* MappedFile::data() const {
+  return data_;
+}
+
+size_t MappedFile::size() const {
+  return size_;
+}
+
+MappedFileIO::MappedFileIO(const std::string& url) : InputIO(AVIO_BUFFER_SIZE), file_(local_path(url)) {}
+
+int MappedFileIO::read(uint8_t* buffer, const int size) {
+  const int64_t file_size = static_cast<int64_t>(file_.size());
+
+  if (position_ >= file_size) {
+    return AVERROR_EOF;
+  }
+
+  if (random_access_ && (position_ - sequential_run_start_) >= SEQUENTIAL_RUN_LENGTH) {
+    file_.advise_sequential();
+    random_access_ = false;
+  }
+
+  const int bytes = static_cast<int>(std::min(static_cast<int64_t>(size), file_size - position_));
+
+  memcpy(buffer, file_.data() + position_, bytes);
+
+  position_ += bytes;
+  bytes_read_ += bytes;
+
+  return bytes;
+}
+
+int64_t MappedFileIO::seek(const int64_t offset, const int whence) {
+  const int64_t file_size = static_cast<int64_t>(file_.size());
+
+  if (whence & AVSEEK_SIZE) {
+    return file_size;
+  }
+
+  int64_t target;
+
+  switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+      target = offset;
+      break;
+    case SEEK_CUR:
+      target = position_ + offset;
+      break;
+    case SEEK_END:
+      target = file_size + offset;
+      break;
+    default:
+      return AVERROR(EINVAL);
+  }
+
+  if (target < 0) {
+    return AVERROR(EINVAL);
+  }
+
+  seeks_++;
+
+  if (std::abs(target - position_) > RANDOM_ACCESS_DISTANCE) {
+    if (!random_access_) {
+      file_.advise_random();
+      random_access_ = true;
+      random_access_switches_++;
+    }
+
+    sequential_run_start_ = target;
+  }
+
+  position_ = target;
+
+  return target;
+}
+
+std::string MappedFileIO::statistics() const {
+  return string_sprintf("Memory-mapped input: %.1f MiB read from a %.1f MiB file, %llu seeks, %llu switches to random access", static_cast<float>(bytes_read_) / (1024 * 1024), static_cast<float>(file_.size()) / (1024 * 1024),
+                        static_cast<unsigned long long>(seeks_), static_cast<unsigned long long>(random_access_switches_));
+}
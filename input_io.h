@@ -0,0 +1,140 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+extern "C" {
+#include <libavformat/avio.h>
+}
+
+// Base class for custom demuxer input, exposing read and seek callbacks through an AVIOContext
+class InputIO {
+ public:
+  virtual ~InputIO();
+
+  AVIOContext* context() const;
+
+  // human-readable I/O statistics, empty if there are none
+  virtual std::string statistics() const;
+
+  // true for plain paths and file: URLs, which custom input implementations can open directly
+  static bool is_local_file(const std::string& url);
+  static std::string local_path(const std::string& url);
+
+ protected:
+  explicit InputIO(const int buffer_size);
+
+  // same contract as the AVIOContext callbacks
+  virtual int read(uint8_t* buffer, const int size) = 0;
+  virtual int64_t seek(const int64_t offset, const int whence) = 0;
+
+ private:
+  static int read_callback(void* opaque, uint8_t* buffer, int size);
+  static int64_t seek_callback(void* opaque, int64_t offset, int whence);
+
+  AVIOContext* context_{};
+};
+
+// Reads ahead of the demuxer on a background thread into a large ring buffer, to absorb the latency of network
+// storage. Seeks within the buffered range reuse it; other seeks restart reading at the new position.
+class ReadAheadIO : public InputIO {
+ public:
+  ReadAheadIO(const std::string& url, const size_t ring_buffer_size);
+  ~ReadAheadIO() override;
+
+  std::string statistics() const override;
+
+ protected:
+  int read(uint8_t* buffer, const int size) override;
+  int64_t seek(const int64_t offset, const int whence) override;
+
+ private:
+  void fill();
+
+  AVIOContext* source_{};
+  int64_t source_size_;
+
+  std::vector<uint8_t> ring_;
+  const size_t chunk_size_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable data_available_;
+  std::condition_variable space_available_;
+
+  // absolute file offsets; [ring_start_, ring_end_) is buffered, and position_ is the read position within it
+  int64_t ring_start_{0};
+  int64_t ring_end_{0};
+  int64_t position_{0};
+
+  // incremented whenever the buffered range is discarded, so in-flight reads of the fill thread are dropped
+  uint64_t generation_{0};
+
+  bool end_of_file_{false};
+  int error_{0};
+  bool quit_{false};
+
+  // statistics
+  uint64_t reads_{0};
+  uint64_t stalled_reads_{0};
+  int64_t stall_time_us_{0};
+  uint64_t bytes_read_{0};
+  uint64_t reused_seeks_{0};
+  uint64_t refilling_seeks_{0};
+
+  std::thread fill_thread_;
+};
+
+// Read-only memory mapping of a whole local file
+class MappedFile {
+ public:
+  explicit MappedFile(const std::string& file_name);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const uint8_t* data() const;
+  size_t size() const;
+
+  // access pattern hints for the kernel's read-ahead; no-ops where unsupported
+  void advise_sequential();
+  void advise_random();
+
+ private:
+  const uint8_t* data_{};
+  size_t size_{0};
+
+#ifdef _WIN32
+  void* file_handle_{};
+  void* mapping_handle_{};
+#endif
+};
+
+// Serves reads straight from a memory-mapped file, saving a read() syscall per buffer refill. The kernel is told
+// to read ahead aggressively while access is sequential, and to stop doing so after seeks until it is again.
+class MappedFileIO : public InputIO {
+ public:
+  explicit MappedFileIO(const std::string& url);
+
+  std::string statistics() const override;
+
+ protected:
+  int read(uint8_t* buffer, const int size) override;
+  int64_t seek(const int64_t offset, const int whence) override;
+
+ private:
+  MappedFile file_;
+
+  int64_t position_{0};
+
+  bool random_access_{false};
+  int64_t sequential_run_start_{0};
+
+  // statistics
+  uint64_t bytes_read_{0};
+  uint64_t seeks_{0};
+  uint64_t random_access_switches_{0};
+};
@@ -0,0 +1,328 @@
+#include "ladder_evaluator.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include "ffmpeg.h"
+#include "metrics_report.h"
+#include "string_utils.h"
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+struct RateQualityPoint {
+  double log_rate;
+  double psnr;
+};
+
+// least-squares cubic through the points, in terms of (x - center) / scale to keep the normal equations well
+// conditioned; returns false if they are singular
+static bool fit_cubic(const std::vector<double>& xs, const std::vector<double>& ys, const double center, const double scale, std::array<double, 4>& coefficients) {
+  std::array<std::array<double, 5>, 4> system{};
+
+  for (size_t i = 0; i < xs.size(); i++) {
+    const double t = (xs[i] - center) / scale;
+    std::array<double, 7> powers;
+
+    powers[0] = 1;
+    for (size_t p = 1; p < powers.size(); p++) {
+      powers[p] = powers[p - 1] * t;
+    }
+    for (size_t row = 0; row < 4; row++) {
+      for (size_t column = 0; column < 4; column++) {
+        system[row][column] += powers[row + column];
+      }
+      system[row][4] += powers[row] * ys[i];
+    }
+  }
+
+  // Gaussian elimination with partial pivoting
+  for (size_t column = 0; column < 4; column++) {
+    size_t pivot = column;
+
+    for (size_t row = column + 1; row < 4; row++) {
+      if (std::fabs(system[row][column]) > std::fabs(system[pivot][column])) {
+        pivot = row;
+      }
+    }
+    if (std::fabs(system[pivot][column]) < 1e-12) {
+      return false;
+    }
+    std::swap(system[column], system[pivot]);
+
+    for (size_t row = column + 1; row < 4; row++) {
+      const double factor = system[row][column] / system[column][column];
+
+      for (size_t k = column; k < 5; k++) {
+        system[row][k] -= factor * system[column][k];
+      }
+    }
+  }
+  for (size_t row = 4; row-- > 0;) {
+    double sum = system[row][4];
+
+    for (size_t k = row + 1; k < 4; k++) {
+      sum -= system[row][k] * coefficients[k];
+    }
+    coefficients[row] = sum / system[row][row];
+  }
+
+  return true;
+}
+
+// mean of the fitted cubic of ys over xs in [low, high]
+static bool mean_of_fit(const std::vector<double>& xs, const std::vector<double>& ys, const double low, const double high, double& mean) {
+  const auto x_range = std::minmax_element(xs.begin(), xs.end());
+  const double center = (*x_range.first + *x_range.second) / 2;
+  const double scale = std::max((*x_range.second - *x_range.first) / 2, 1e-9);
+
+  std::array<double, 4> coefficients;
+
+  if (!fit_cubic(xs, ys, center, scale, coefficients)) {
+    return false;
+  }
+
+  // the substitution's scale cancels out of the mean
+  auto integral = [&](const double x) {
+    const double t = (x - center) / scale;
+    return t * (coefficients[0] + t * (coefficients[1] / 2 + t * (coefficients[2] / 3 + t * coefficients[3] / 4)));
+  };
+
+  const double t_low = (low - center) / scale;
+  const double t_high = (high - center) / scale;
+
+  mean = (integral(high) - integral(low)) / (t_high - t_low);
+  return true;
+}
+
+// BD-rate as the mean bitrate difference in percent at equal quality, and BD-PSNR as the mean quality difference
+// in dB at equal bitrate, both over the overlap of the two curves
+static bool bjontegaard_deltas(const std::vector<RateQualityPoint>& anchor, const std::vector<RateQualityPoint>& test, double& bd_rate, double& bd_psnr) {
+  auto split = [](const std::vector<RateQualityPoint>& points, std::vector<double>& log_rates, std::vector<double>& psnrs) {
+    for (const auto& point : points) {
+      log_rates.push_back(point.log_rate);
+      psnrs.push_back(point.psnr);
+    }
+  };
+
+  std::vector<double> anchor_log_rates, anchor_psnrs, test_log_rates, test_psnrs;
+  split(anchor, anchor_log_rates, anchor_psnrs);
+  split(test, test_log_rates, test_psnrs);
+
+  const double psnr_low = std::max(*std::min_element(anchor_psnrs.begin(), anchor_psnrs.end()), *std::min_element(test_psnrs.begin(), test_psnrs.end()));
+  const double psnr_high = std::min(*std::max_element(anchor_psnrs.begin(), anchor_psnrs.end()), *std::max_element(test_psnrs.begin(), test_psnrs.end()));
+  const double rate_low = std::max(*std::min_element(anchor_log_rates.begin(), anchor_log_rates.end()), *std::min_element(test_log_rates.begin(), test_log_rates.end()));
+  const double rate_high = std::min(*std::max_element(anchor_log_rates.begin(), anchor_log_rates.end()), *std::max_element(test_log_rates.begin(), test_log_rates.end()));
+
+  if (psnr_high <= psnr_low || rate_high <= rate_low) {
+    return false;
+  }
+
+  double anchor_mean_log_rate, test_mean_log_rate, anchor_mean_psnr, test_mean_psnr;
+
+  if (!mean_of_fit(anchor_psnrs, anchor_log_rates, psnr_low, psnr_high, anchor_mean_log_rate) || !mean_of_fit(test_psnrs, test_log_rates, psnr_low, psnr_high, test_mean_log_rate) ||
+      !mean_of_fit(anchor_log_rates, anchor_psnrs, rate_low, rate_high, anchor_mean_psnr) || !mean_of_fit(test_log_rates, test_psnrs, rate_low, rate_high, test_mean_psnr)) {
+    return false;
+  }
+
+  bd_rate = (std::pow(10, test_mean_log_rate - anchor_mean_log_rate) - 1) * 100;
+  bd_psnr = test_mean_psnr - anchor_mean_psnr;
+  return true;
+}
+
+// in bits per second; falls back to the average over the file when the container does not tell
+static int64_t rendition_bit_rate(Demuxer* demuxer) {
+  const int64_t bit_rate = demuxer->bit_rate();
+
+  if (bit_rate > 0) {
+    return bit_rate;
+  }
+
+  const int64_t file_size = demuxer->file_size();
+  const int64_t duration = demuxer->duration();
+
+  return (file_size > 0 && duration > 0) ? static_cast<int64_t>(file_size * 8 * 1000000.0 / duration) : 0;
+}
+
+LadderEvaluator::LadderEvaluator(const VideoCompareConfig& config, const std::vector<std::string>& rendition_file_names, const std::string& ladder_file_name, const size_t anchor_count)
+    : reference_file_name_{config.left.file_name}, ladder_file_name_{ladder_file_name}, anchor_count_{anchor_count}, time_shift_(config.time_shift) {
+  reference_ = std::make_unique<FrameSource>(LEFT, config.left, config);
+
+  for (size_t i = 0; i < rendition_file_names.size(); i++) {
+    auto lane = std::make_unique<Lane>();
+
+    lane->input = config.right;
+    lane->input.file_name = rendition_file_names[i];
+    lane->input.side_description = string_sprintf("Rendition %zu", i + 1);
+
+    lane->source = std::make_unique<FrameSource>(RIGHT, lane->input, config);
+
+    lanes_.push_back(std::move(lane));
+  }
+
+  reference_->create_filterer(config.left, lanes_.front()->input, *lanes_.front()->source, config);
+
+  width_ = reference_->video_filterer()->dest_width();
+  height_ = reference_->video_filterer()->dest_height();
+  pixel_format_ = MetricsEngine::planar_equivalent(reference_->video_filterer()->dest_pixel_format());
+
+  for (auto& lane : lanes_) {
+    lane->source->create_filterer(lane->input, config.left, *reference_, config);
+
+    if (pixel_format_ != AV_PIX_FMT_NONE) {
+      pixel_format_ = MetricsEngine::common_planar_format(pixel_format_, lane->source->video_filterer()->dest_pixel_format());
+    }
+  }
+
+  metrics_report::check_measurable(pixel_format_, reference_->video_filterer()->dest_pixel_format());
+
+  // lanes run concurrently, so they split the cores between their row workers
+  const int threads_per_lane = std::max(1, static_cast<int>(std::thread::hardware_concurrency() / lanes_.size()));
+
+  for (auto& lane : lanes_) {
+    lane->reference_frames = reference_->add_consumer(metrics_report::QUEUE_SIZE);
+    lane->rendition_frames = lane->source->add_consumer(metrics_report::QUEUE_SIZE);
+    lane->metrics_engine = std::make_unique<MetricsEngine>(threads_per_lane);
+  }
+}
+
+void LadderEvaluator::compare(Lane& lane) {
+  FramePairer frame_pairer(lane.reference_frames, lane.rendition_frames, time_shift_);
+
+  try {
+    std::shared_ptr<AVFrame> reference_frame;
+    std::shared_ptr<AVFrame> rendition_frame;
+
+    while (frame_pairer.next(reference_frame, rendition_frame)) {
+      lane.accumulator.add(lane.metrics_engine->compute(reference_frame.get(), rendition_frame.get()));
+    }
+  } catch (...) {
+    lane.exception = std::current_exception();
+  }
+
+  lane.skipped_reference_frames = frame_pairer.skipped_left_frames();
+  lane.skipped_rendition_frames = frame_pairer.skipped_right_frames();
+
+  // lets the reference carry on with the other lanes, and the rendition stop decoding
+  lane.reference_frames->quit();
+  lane.source->quit();
+}
+
+bool LadderEvaluator::operator()() {
+  std::ofstream ladder_file;
+
+  if (ladder_file_name_ != "-") {
+    ladder_file.open(ladder_file_name_);
+
+    if (!ladder_file) {
+      throw std::runtime_error(string_sprintf("Could not open ladder file for writing: %s", ladder_file_name_.c_str()));
+    }
+  }
+
+  std::ostream& output = ladder_file_name_ != "-" ? ladder_file : std::cout;
+
+  const auto start_time = std::chrono::steady_clock::now();
+
+  reference_->start(width_, height_, pixel_format_);
+
+  for (auto& lane : lanes_) {
+    lane->source->start(width_, height_, pixel_format_);
+  }
+
+  std::vector<std::thread> lane_threads;
+
+  for (auto& lane : lanes_) {
+    lane_threads.emplace_back(&LadderEvaluator::compare, this, std::ref(*lane));
+  }
+  for (auto& thread : lane_threads) {
+    thread.join();
+  }
+
+  // the reference may be longer than every rendition
+  reference_->quit();
+  reference_->finish();
+
+  for (auto& lane : lanes_) {
+    lane->source->finish();
+
+    if (lane->exception != nullptr) {
+      std::rethrow_exception(lane->exception);
+    }
+  }
+
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  output << "rendition,file,width,height,bitrate_kbps,frames" << metrics_report::csv_header(pixel_format_) << std::endl;
+
+  std::ostream& summary = metrics_report::summary_stream(ladder_file_name_);
+
+  summary << string_sprintf("Ladder of %zu renditions against %s (%zux%zu, %s):", lanes_.size(), reference_file_name_.c_str(), width_, height_, av_get_pix_fmt_name(pixel_format_)) << std::endl;
+
+  bool all_measured = true;
+  std::vector<RateQualityPoint> anchor_points;
+  std::vector<RateQualityPoint> test_points;
+
+  for (size_t i = 0; i < lanes_.size(); i++) {
+    const Lane& lane = *lanes_[i];
+
+    const int64_t bit_rate = rendition_bit_rate(lane.source->demuxer());
+
+    if (lane.accumulator.frames() == 0) {
+      summary << string_sprintf("  %zu: %s: no frame pairs to compute metrics for", i + 1, lane.input.file_name.c_str()) << std::endl;
+      all_measured = false;
+      continue;
+    }
+
+    const FrameMetrics mean = lane.accumulator.mean();
+
+    output << (i + 1) << "," << lane.input.file_name << "," << lane.source->video_filterer()->dest_width() << "," << lane.source->video_filterer()->dest_height() << string_sprintf(",%.3f", bit_rate / 1000.0) << ","
+           << lane.accumulator.frames() << metrics_report::csv_values(mean) << "\n";
+
+    summary << string_sprintf("  %zu: %s (%zux%zu, %.0f kb/s, %zu frames): PSNR-W(%s) MS-SSIM(%.5f)", i + 1, lane.input.file_name.c_str(), lane.source->video_filterer()->dest_width(), lane.source->video_filterer()->dest_height(), bit_rate / 1000.0,
+                              lane.accumulator.frames(), metrics_report::format_psnr(mean.weighted_psnr).c_str(), mean.ms_ssim);
+
+    if (lane.skipped_reference_frames > 0 || lane.skipped_rendition_frames > 0) {
+      summary << string_sprintf(", skipped %llu reference and %llu rendition frames without a counterpart", static_cast<unsigned long long>(lane.skipped_reference_frames), static_cast<unsigned long long>(lane.skipped_rendition_frames));
+    }
+    summary << std::endl;
+
+    // lossless points and unknown bitrates have no place on a rate-quality curve
+    if (bit_rate > 0 && std::isfinite(mean.weighted_psnr)) {
+      (i < anchor_count_ ? anchor_points : test_points).push_back(RateQualityPoint{std::log10(static_cast<double>(bit_rate)), mean.weighted_psnr});
+    }
+  }
+
+  output.flush();
+
+  if (anchor_count_ > 0) {
+    double bd_rate, bd_psnr;
+
+    if (anchor_points.size() < MIN_BD_POINTS || test_points.size() < MIN_BD_POINTS) {
+      summary << string_sprintf("BD-rate needs at least %zu measured renditions with a known bitrate per curve (anchor: %zu, test: %zu)", MIN_BD_POINTS, anchor_points.size(), test_points.size()) << std::endl;
+    } else if (!bjontegaard_deltas(anchor_points, test_points, bd_rate, bd_psnr)) {
+      summary << "BD-rate is undefined, as the anchor and test curves do not overlap" << std::endl;
+    } else {
+      summary << string_sprintf("BD-rate of renditions %zu-%zu against %zu-%zu (PSNR-W): %+.2f%% (BD-PSNR %+.3f dB)", anchor_count_ + 1, lanes_.size(), size_t{1}, anchor_count_, bd_rate, bd_psnr) << std::endl;
+    }
+  }
+
+  const double video_fps = av_q2d(reference_->demuxer()->guess_frame_rate());
+  size_t frame_pairs = 0;
+
+  for (const auto& lane : lanes_) {
+    frame_pairs += lane->accumulator.frames();
+  }
+
+  const double evaluation_fps = frame_pairs / std::max(elapsed, 1e-6);
+
+  summary << string_sprintf("Evaluated %zu frame pairs at %.1f frames/s", frame_pairs, evaluation_fps);
+  if (video_fps > 0) {
+    summary << string_sprintf(" (%.2fx real time per rendition)", evaluation_fps / video_fps / lanes_.size());
+  }
+  summary << std::endl;
+
+  return all_measured;
+}
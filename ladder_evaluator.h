@@ -0,0 +1,58 @@
+#pragma once
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "frame_pairer.h"
+#include "frame_source.h"
+#include "metrics_engine.h"
+
+// Headless evaluation of an encoding ladder: one reference against any number of renditions. The reference is
+// decoded and filtered once, and each of its frames is shared by all comparison lanes, which run in parallel. Every
+// rendition is scaled to the reference resolution and measured as by MetricsEvaluator, including the pairing of frames by
+// their time-shifted PTS.
+class LadderEvaluator {
+ public:
+  // Bjøntegaard deltas need a cubic fit per curve
+  static constexpr size_t MIN_BD_POINTS = 4;
+
+  // the reference is config.left; rendition inputs take their settings from config.right
+  LadderEvaluator(const VideoCompareConfig& config, const std::vector<std::string>& rendition_file_names, const std::string& ladder_file_name, const size_t anchor_count);
+
+  // writes the per-rendition metrics as CSV and prints a summary, including the BD-rate of the renditions after
+  // the first anchor_count ones against those; returns false if any rendition had no frame pair to measure
+  bool operator()();
+
+ private:
+  struct Lane {
+    InputVideo input;
+
+    std::unique_ptr<FrameSource> source;
+
+    FrameSource::FrameQueue* reference_frames;
+    FrameSource::FrameQueue* rendition_frames;
+
+    std::unique_ptr<MetricsEngine> metrics_engine;
+    MetricsAccumulator accumulator;
+
+    uint64_t skipped_reference_frames{0};
+    uint64_t skipped_rendition_frames{0};
+
+    std::exception_ptr exception;
+  };
+
+  void compare(Lane& lane);
+
+  const std::string reference_file_name_;
+  const std::string ladder_file_name_;
+  const size_t anchor_count_;
+  const TimeShiftConfig time_shift_;
+
+  std::unique_ptr<FrameSource> reference_;
+  std::vector<std::unique_ptr<Lane>> lanes_;
+
+  size_t width_;
+  size_t height_;
+  AVPixelFormat pixel_format_;
+};
@@ -3,9 +3,15 @@
 #include <iostream>
 #include <regex>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 #include "argagg.h"
+#include "batch_runner.h"
+#include "bit_exact_verifier.h"
 #include "controls.h"
+#include "ladder_evaluator.h"
+#include "metrics_evaluator.h"
+#include "metrics_sampler.h"
 #include "side_aware_logger.h"
 #include "string_utils.h"
 #include "version.h"
@@ -270,10 +276,23 @@ AVDictionary* upsert_avdict_options(AVDictionary* dict, const std::string& optio
   return dict;
 }
 
-AVDictionary* create_default_demuxer_options() {
+AVDictionary* create_default_demuxer_options(const std::string& probe_preset) {
   AVDictionary* demuxer_options = nullptr;
-  av_dict_set(&demuxer_options, "analyzeduration", "100000000", 0);
-  av_dict_set(&demuxer_options, "probesize", "100000000", 0);
+
+  if (probe_preset.empty()) {
+    av_dict_set(&demuxer_options, "analyzeduration", "100000000", 0);
+    av_dict_set(&demuxer_options, "probesize", "100000000", 0);
+  } else if (probe_preset == "quick") {
+    // FFmpeg's own defaults
+    av_dict_set(&demuxer_options, "analyzeduration", "5000000", 0);
+    av_dict_set(&demuxer_options, "probesize", "5000000", 0);
+  } else if (probe_preset == "minimal") {
+    av_dict_set(&demuxer_options, "analyzeduration", "100000", 0);
+    av_dict_set(&demuxer_options, "probesize", "65536", 0);
+    av_dict_set(&demuxer_options, "fpsprobesize", "0", 0);
+  } else {
+    throw std::logic_error{"Cannot parse probe preset argument (valid options: quick, minimal)"};
+  }
 
   return demuxer_options;
 }
@@ -332,6 +351,7 @@ int main(int argc, char** argv) {
          {"high-dpi", {"-d", "--high-dpi"}, "allow high DPI mode for e.g. displaying UHD content on Retina displays", 0},
          {"10-bpc", {"-b", "--10-bpc"}, "use 10 bits per color component instead of 8", 0},
          {"fast-alignment", {"-F", "--fast-alignment"}, "toggle fast bilinear scaling for aligning input source resolutions, replacing high-quality bicubic and chroma-accurate interpolation", 0},
+         {"adaptive-resolution", {"--adaptive-resolution"}, "convert at the on-screen size with fast bilinear scaling during playback, switching to full resolution and high-quality scaling when paused, zoomed in or saving", 0},
          {"bilinear-texture", {"-I", "--bilinear-texture"}, "toggle bilinear video texture interpolation, replacing nearest-neighbor filtering", 0},
          {"display-number", {"-n", "--display-number"}, "open main window on specific display (e.g. 0, 1 or 2), default is 0", 1},
          {"display-mode", {"-m", "--mode"}, "display mode (layout), 'split' for split screen (default), 'vstack' for vertical stack, 'hstack' for horizontal stack", 1},
@@ -339,6 +359,21 @@ int main(int argc, char** argv) {
          {"window-fit-display", {"-W", "--window-fit-display"}, "calculate the window size to fit within the usable display bounds while maintaining the video aspect ratio", 0},
          {"auto-loop-mode", {"-a", "--auto-loop-mode"}, "auto-loop playback when buffer fills, 'off' for continuous streaming (default), 'on' for forward-only mode, 'pp' for ping-pong mode", 1},
          {"frame-buffer-size", {"-f", "--frame-buffer-size"}, "frame buffer size (e.g. 10, 70 or 150), default is 50", 1},
+         {"sequence-lookahead", {"--sequence-lookahead"}, "number of images decoded ahead in parallel for image sequences (e.g. 8 or 32), default is twice the number of decoder workers; 0 decodes sequences serially", 1},
+         {"read-ahead", {"--read-ahead"}, "read input files ahead of the demuxer on a background thread into a ring buffer of the given size in MiB (e.g. 64 or 256), for network storage; hit rate and stall time are reported in verbose mode", 1},
+         {"mmap", {"--mmap"}, "read local input files through a memory mapping instead of read() calls, for fast local storage; cannot be combined with --read-ahead", 0},
+         {"verify-bitexact", {"--verify-bitexact"}, "headless check whether both videos decode to identical frames, comparing the decoded planes without filtering or display; reports the first mismatching frame, plane and block, and exits with status 1 on a mismatch", 0},
+         {"metrics", {"--metrics"}, "headless evaluation of per-plane PSNR, weighted PSNR, per-plane SSIM and MS-SSIM over the whole videos, computed on the filtered frames at their native bit depth and paired by time stamp after any --time-shift; per-frame values are written as CSV to the given file ('-' for stdout) and the clip averages are printed", 1},
+         {"segments", {"--segments"}, "number of time segments the --metrics evaluation is split into, which are decoded and measured concurrently (e.g. 8 or 32), default is 1; each starts decoding at the keyframes preceding it, and frames are counted by the segment their time stamp falls into", 1},
+         {"sample", {"--sample"}, "estimate the --metrics values from a sample of the frames for quick triage, 'every:N' for every Nth frame, 'random:N[:SEED]' for N random frames (the same for the same seed, default 0) or 'keyframes' for the keyframes of the left video; seeks past unsampled frames, and reports means with 95% confidence intervals and percentiles of PSNR, SSIM, MS-SSIM and VMAF", 1},
+         {"metrics-db", {"--metrics-db"}, "keep per-frame metric scores in the given append-only database file and reuse the scores of earlier runs with the same inputs, time shift and filters instead of recomputing them; used by the M key, --metrics and --sample", 1},
+         {"resume", {"--resume"}, "continue an interrupted --metrics evaluation from the checkpoint written periodically next to its output file, appending to that file; starts from the beginning if there is no checkpoint", 0},
+         {"jobs", {"--jobs"}, "headless --metrics evaluation of many video pairs in one process, listed in the given file one job per line as the left file, the right file and optionally a file for the per-frame metrics, separated by tabs; the clip-level metrics of all jobs are written as CSV to the --metrics file ('-' for stdout), and other options apply to every job", 1},
+         {"parallel-jobs", {"--parallel-jobs"}, "number of --jobs evaluated at a time (e.g. 4 or 16), default is a quarter of the cores; each job gets an equal part of the cores, a third of which goes to each of its two decoders and the rest to its metric workers", 1},
+         {"jobs-memory", {"--jobs-memory"}, "budget in MiB for the frames held by concurrent --jobs (e.g. 2048 or 16384), default is 4096, 0 for no limit; jobs wait to start while the budget is exhausted", 1},
+         {"ladder", {"--ladder"}, "headless evaluation of an encoding ladder, taking FILE1 as the reference and any further files as renditions; the reference is decoded once and shared by parallel comparison lanes, which scale each rendition to the reference resolution; per-rendition bitrate and mean metrics are written as CSV to the given file ('-' for stdout) and summarized", 1},
+         {"anchor-count", {"--anchor-count"}, "number of leading ladder renditions (at least 4) forming the anchor curve, against which the BD-rate and BD-PSNR of the remaining renditions (at least 4) are reported, based on weighted PSNR", 1},
+         {"probe-fast", {"--probe-fast"}, "shorten input probing for faster startup, 'quick' for FFmpeg's default probe size and duration, 'minimal' for probing as little as possible; demuxer options take precedence", 1},
          {"time-shift", {"-t", "--time-shift"}, "shift the time stamps of the right video by a user-specified time offset, optionally with a multiplier (e.g. 0.150, -0.1, x1.04+0.1, x25.025/24-1:30.5)", 1},
          {"wheel-sensitivity", {"-s", "--wheel-sensitivity"}, "mouse wheel sensitivity (e.g. 0.5, -1 or 1.7), default is 1; negative values invert the input direction", 1},
          {"color-space", {"-C", "--color-space"}, "set the color space matrix, specified as [matrix] for the same on both sides, or [l-matrix?]:[r-matrix?] for different values (e.g. 'bt709' or 'bt2020nc:')", 1},
@@ -349,6 +384,7 @@ int main(int argc, char** argv) {
          {"left-peak-nits", {"-L", "--left-peak-nits"}, "left video peak luminance in nits (e.g. 850 or 1000), default is 100 for SDR and 500 for HDR", 1},
          {"right-peak-nits", {"-R", "--right-peak-nits"}, "right video peak luminance in nits; see --left-peak-nits", 1},
          {"boost-tone", {"-B", "--boost-tone"}, "adjust tone-mapping strength factor, specified as [factor] for the same on both sides, or [l-factor?]:[r-factor?] for different values (e.g. '0.6', ':3' or '2:1.5')", 1},
+         {"tone-map-lut", {"--tone-map-lut"}, "tone-map through a precomputed 3D LUT with tetrahedral interpolation instead of per-pixel zscale/tonemap filtering; faster with a small accuracy loss (reported in verbose mode)", 0},
          {"filters", {"-i", "--filters"}, "specify a comma-separated list of FFmpeg filters to be applied to both sides (e.g. scale=1920:-2,delogo=x=10:y=10:w=100:h=70)", 1},
          {"left-filters", {"-l", "--left-filters"}, "specify a comma-separated list of FFmpeg filters to be applied to the left video (e.g. format=gray,crop=iw:ih-240)", 1},
          {"right-filters", {"-r", "--right-filters"}, "specify a comma-separated list of FFmpeg filters to be applied to the right video (e.g. yadif,hqdn3d,pad=iw+320:ih:160:0)", 1},
@@ -393,7 +429,15 @@ int main(int argc, char** argv) {
     } else {
       VideoCompareConfig config;
 
-      if (args.pos.size() != 2) {
+      if (args["ladder"]) {
+        if (args.pos.size() < 2) {
+          throw std::logic_error{"A reference and at least one rendition must be supplied"};
+        }
+      } else if (args["jobs"]) {
+        if (!args.pos.empty()) {
+          throw std::logic_error{"No video files can be supplied together with --jobs, which lists them"};
+        }
+      } else if (args.pos.size() != 2) {
         throw std::logic_error{"Two FFmpeg compatible video files must be supplied"};
       }
 
@@ -402,8 +446,10 @@ int main(int argc, char** argv) {
       config.high_dpi_allowed = args["high-dpi"];
       config.use_10_bpc = args["10-bpc"];
       config.fast_input_alignment = args["fast-alignment"];
+      config.adaptive_resolution = args["adaptive-resolution"];
       config.bilinear_texture_filtering = args["bilinear-texture"];
       config.disable_auto_filters = args["disable-auto-filters"];
+      config.tone_map_lut = args["tone-map-lut"];
 
       if (args["display-number"]) {
         const std::string display_number_arg = args["display-number"];
@@ -502,6 +548,67 @@ int main(int argc, char** argv) {
           throw std::logic_error{"Frame buffer size must be at least 1"};
         }
       }
+      if (args["sequence-lookahead"]) {
+        const std::string sequence_lookahead_arg = args["sequence-lookahead"];
+        const std::regex sequence_lookahead_re("(\\d+)");
+
+        if (!std::regex_match(sequence_lookahead_arg, sequence_lookahead_re)) {
+          throw std::logic_error{"Cannot parse sequence look-ahead (required format: [number], e.g. 8 or 32)"};
+        }
+
+        config.sequence_lookahead = std::stoi(sequence_lookahead_arg);
+      }
+      if (args["read-ahead"]) {
+        const std::string read_ahead_arg = args["read-ahead"];
+        const std::regex read_ahead_re("(\\d+)");
+
+        if (!std::regex_match(read_ahead_arg, read_ahead_re)) {
+          throw std::logic_error{"Cannot parse read-ahead size (required format: [number], e.g. 64 or 256)"};
+        }
+
+        config.read_ahead_size = static_cast<size_t>(std::stoi(read_ahead_arg)) * 1024 * 1024;
+
+        if (config.read_ahead_size < 1) {
+          throw std::logic_error{"Read-ahead size must be at least 1 MiB"};
+        }
+      }
+      if (args["metrics"] && args["verify-bitexact"]) {
+        throw std::logic_error{"Options --metrics and --verify-bitexact cannot be used together"};
+      }
+      if (args["ladder"] && (args["metrics"] || args["verify-bitexact"])) {
+        throw std::logic_error{"Option --ladder cannot be used together with --metrics or --verify-bitexact"};
+      }
+      if (args["segments"] && !args["metrics"]) {
+        throw std::logic_error{"Option --segments requires --metrics"};
+      }
+      if (args["sample"] && (!args["metrics"] || args["segments"] || args["resume"])) {
+        throw std::logic_error{"Option --sample requires --metrics, and cannot be used together with --segments or --resume"};
+      }
+      if (args["resume"] && (!args["metrics"] || static_cast<const std::string&>(args["metrics"]) == "-")) {
+        throw std::logic_error{"Option --resume requires --metrics with an output file"};
+      }
+      if (args["metrics-db"] && (args["ladder"] || args["verify-bitexact"])) {
+        throw std::logic_error{"Option --metrics-db cannot be used together with --ladder or --verify-bitexact"};
+      }
+      if (args["metrics-db"]) {
+        config.metrics_database_file_name = static_cast<const std::string&>(args["metrics-db"]);
+      }
+      if (args["jobs"] && (!args["metrics"] || args["segments"] || args["sample"] || args["resume"] || args["ladder"] || args["verify-bitexact"])) {
+        throw std::logic_error{"Option --jobs requires --metrics for its report, and cannot be used together with --segments, --sample, --resume, --ladder or --verify-bitexact"};
+      }
+      if ((args["parallel-jobs"] || args["jobs-memory"]) && !args["jobs"]) {
+        throw std::logic_error{"Options --parallel-jobs and --jobs-memory require --jobs"};
+      }
+      if (args["anchor-count"] && !args["ladder"]) {
+        throw std::logic_error{"Option --anchor-count requires --ladder"};
+      }
+      if (args["mmap"]) {
+        if (args["read-ahead"]) {
+          throw std::logic_error{"Memory-mapped input cannot be combined with read-ahead"};
+        }
+
+        config.memory_mapped_input = true;
+      }
       if (args["time-shift"]) {
         const std::string time_shift_arg = args["time-shift"];
 
@@ -563,8 +670,10 @@ int main(int argc, char** argv) {
       resolve_mutual_placeholders(config.left.video_filters, config.right.video_filters, "filter specification");
 
       // demuxer
-      config.left.demuxer_options = create_default_demuxer_options();
-      config.right.demuxer_options = create_default_demuxer_options();
+      const std::string probe_preset = args["probe-fast"] ? static_cast<const std::string&>(args["probe-fast"]) : "";
+
+      config.left.demuxer_options = create_default_demuxer_options(probe_preset);
+      config.right.demuxer_options = create_default_demuxer_options(probe_preset);
 
       if (args["demuxer"]) {
         config.left.demuxer = static_cast<const std::string&>(args["demuxer"]);
@@ -678,10 +787,12 @@ int main(int argc, char** argv) {
         config.right.boost_tone = (boost_tone_spec == left_boost_tone) ? config.left.boost_tone : parse_boost_tone(get_nth_token_or_empty(boost_tone_spec, ':', 1), config.right);
       }
 
-      config.left.file_name = args.pos[0];
-      config.right.file_name = args.pos[1];
+      if (!args["jobs"]) {
+        config.left.file_name = args.pos[0];
+        config.right.file_name = args.pos[1];
 
-      resolve_mutual_placeholders(config.left.file_name, config.right.file_name, "video file", true);
+        resolve_mutual_placeholders(config.left.file_name, config.right.file_name, "video file", true);
+      }
 
       if (args["libvmaf-options"]) {
         VMAFCalculator::instance().set_libvmaf_options(args["libvmaf-options"]);
@@ -689,8 +800,109 @@ int main(int argc, char** argv) {
 
       av_log_set_callback(sa_av_log_callback);
 
-      VideoCompare compare{config};
-      compare();
+      if (args["verify-bitexact"]) {
+        BitExactVerifier verifier{config};
+        exit_code = verifier() ? 0 : 1;
+      } else if (args["ladder"]) {
+        const std::string ladder_file_name = args["ladder"];
+        const std::vector<std::string> rendition_file_names(args.pos.begin() + 1, args.pos.end());
+        size_t anchor_count = 0;
+
+        if (args["anchor-count"]) {
+          const std::string anchor_count_arg = args["anchor-count"];
+          const std::regex anchor_count_re("(\\d+)");
+
+          if (!std::regex_match(anchor_count_arg, anchor_count_re)) {
+            throw std::logic_error{"Cannot parse anchor count argument (required format: [number], e.g. 4 or 6)"};
+          }
+
+          anchor_count = std::stoul(anchor_count_arg);
+
+          if (anchor_count < LadderEvaluator::MIN_BD_POINTS || rendition_file_names.size() < anchor_count + LadderEvaluator::MIN_BD_POINTS) {
+            throw std::logic_error{string_sprintf("Anchor count must be at least %zu and leave at least %zu renditions on the test curve (%zu renditions given)", LadderEvaluator::MIN_BD_POINTS, LadderEvaluator::MIN_BD_POINTS,
+                                                  rendition_file_names.size())};
+          }
+        }
+
+        LadderEvaluator evaluator{config, rendition_file_names, ladder_file_name, anchor_count};
+        exit_code = evaluator() ? 0 : 1;
+      } else if (args["jobs"]) {
+        const std::string jobs_file_name = args["jobs"];
+        const std::string report_file_name = args["metrics"];
+        const std::regex number_re("(\\d+)");
+
+        size_t parallel_jobs = std::max(std::thread::hardware_concurrency() / 4, 1U);
+        size_t memory_budget_mib = BatchRunner::DEFAULT_MEMORY_BUDGET_MIB;
+
+        if (args["parallel-jobs"]) {
+          const std::string parallel_jobs_arg = args["parallel-jobs"];
+
+          if (!std::regex_match(parallel_jobs_arg, number_re) || std::stoul(parallel_jobs_arg) < 1) {
+            throw std::logic_error{"Cannot parse parallel jobs argument (required format: [number], e.g. 4 or 16)"};
+          }
+
+          parallel_jobs = std::stoul(parallel_jobs_arg);
+        }
+        if (args["jobs-memory"]) {
+          const std::string jobs_memory_arg = args["jobs-memory"];
+
+          if (!std::regex_match(jobs_memory_arg, number_re)) {
+            throw std::logic_error{"Cannot parse jobs memory argument (required format: [number], e.g. 2048 or 16384)"};
+          }
+
+          memory_budget_mib = std::stoul(jobs_memory_arg);
+        }
+
+        BatchRunner runner{config, jobs_file_name, report_file_name, parallel_jobs, memory_budget_mib * 1024 * 1024};
+        exit_code = runner() ? 0 : 1;
+      } else if (args["metrics"] && args["sample"]) {
+        const std::string metrics_file_name = args["metrics"];
+        const std::string sample_arg = args["sample"];
+        const std::regex sample_re("(every):(\\d+)|(random):(\\d+)(?::(\\d+))?|(keyframes)");
+
+        std::smatch match;
+        MetricsSampler::Sampling sampling;
+
+        if (!std::regex_match(sample_arg, match, sample_re)) {
+          throw std::logic_error{"Cannot parse sample argument (valid options: every:N, random:N[:SEED], keyframes)"};
+        }
+        if (match[1].matched) {
+          sampling.strategy = MetricsSampler::Strategy::EVERY_NTH;
+          sampling.count = std::stoull(match[2]);
+        } else if (match[3].matched) {
+          sampling.strategy = MetricsSampler::Strategy::RANDOM;
+          sampling.count = std::stoull(match[4]);
+          sampling.seed = match[5].matched ? std::stoull(match[5]) : 0;
+        } else {
+          sampling.strategy = MetricsSampler::Strategy::KEYFRAMES;
+        }
+        if (sampling.count < 1) {
+          throw std::logic_error{"The number of frames to sample must be at least 1"};
+        }
+
+        MetricsSampler sampler{config, metrics_file_name, sampling};
+        exit_code = sampler() ? 0 : 1;
+      } else if (args["metrics"]) {
+        const std::string metrics_file_name = args["metrics"];
+        size_t segment_count = 1;
+
+        if (args["segments"]) {
+          const std::string segments_arg = args["segments"];
+          const std::regex segments_re("(\\d+)");
+
+          if (!std::regex_match(segments_arg, segments_re) || std::stoul(segments_arg) < 1) {
+            throw std::logic_error{"Cannot parse segments argument (required format: [number], e.g. 8 or 32)"};
+          }
+
+          segment_count = std::stoul(segments_arg);
+        }
+
+        MetricsEvaluator evaluator{config, metrics_file_name, segment_count, args["resume"]};
+        exit_code = evaluator() ? 0 : 1;
+      } else {
+        VideoCompare compare{config};
+        compare();
+      }
     }
   } catch (const std::exception& e) {
     std::cerr << "Error: " << e.what() << std::endl;
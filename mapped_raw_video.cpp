@@ -0,0 +1,142 @@
+#include "mapped_raw_video.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <utility>
+#include "ffmpeg.h"
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+static const std::string Y4M_SIGNATURE = "YUV4MPEG2 ";
+static const std::string Y4M_FRAME_MARKER = "FRAME";
+
+// keeps the mapping alive for as long as packets or frames reference it
+static void release_mapping(void* opaque, uint8_t*) {
+  delete static_cast<std::shared_ptr<MappedFile>*>(opaque);
+}
+
+std::unique_ptr<MappedRawVideo> MappedRawVideo::create(const std::string& file_name,
+                                                       const std::string& format_name,
+                                                       const AVCodecParameters* codec_parameters,
+                                                       const AVRational frame_rate,
+                                                       const AVRational time_base,
+                                                       const int stream_index) {
+  const int frame_size = av_image_get_buffer_size(static_cast<AVPixelFormat>(codec_parameters->format), codec_parameters->width, codec_parameters->height, 1);
+
+  if (frame_size <= 0 || frame_rate.num <= 0 || frame_rate.den <= 0) {
+    return nullptr;
+  }
+
+  auto file = std::make_shared<MappedFile>(file_name);
+
+  const size_t file_size = file->size();
+  std::vector<size_t> frame_offsets;
+
+  if (format_name == "yuv4mpegpipe") {
+    const char* data = reinterpret_cast<const char*>(file->data());
+
+    if (file_size < Y4M_SIGNATURE.size() || memcmp(data, Y4M_SIGNATURE.data(), Y4M_SIGNATURE.size()) != 0) {
+      return nullptr;
+    }
+
+    const char* header_end = static_cast<const char*>(memchr(data, '\n', file_size));
+
+    if (header_end == nullptr) {
+      return nullptr;
+    }
+
+    // frame headers may carry parameters, which are skipped up to their newline
+    for (size_t offset = header_end - data + 1; offset < file_size; offset += frame_size) {
+      if (file_size - offset < Y4M_FRAME_MARKER.size() || memcmp(data + offset, Y4M_FRAME_MARKER.data(), Y4M_FRAME_MARKER.size()) != 0) {
+        return nullptr;
+      }
+
+      const char* frame_header_end = static_cast<const char*>(memchr(data + offset, '\n', file_size - offset));
+
+      if (frame_header_end == nullptr) {
+        return nullptr;
+      }
+
+      offset = frame_header_end - data + 1;
+
+      if (file_size - offset < static_cast<size_t>(frame_size)) {
+        return nullptr;
+      }
+
+      frame_offsets.push_back(offset);
+    }
+  } else if (format_name == "rawvideo") {
+    if (file_size % frame_size != 0) {
+      return nullptr;
+    }
+
+    for (size_t offset = 0; offset < file_size; offset += frame_size) {
+      frame_offsets.push_back(offset);
+    }
+  } else {
+    return nullptr;
+  }
+
+  return std::unique_ptr<MappedRawVideo>(new MappedRawVideo(file, std::move(frame_offsets), frame_size, frame_rate, time_base, stream_index));
+}
+
+MappedRawVideo::MappedRawVideo(std::shared_ptr<MappedFile> file, std::vector<size_t> frame_offsets, const size_t frame_size, const AVRational frame_rate, const AVRational time_base, const int stream_index)
+    : file_(file),
+      frame_offsets_(std::move(frame_offsets)),
+      frame_size_(frame_size),
+      frame_count_(static_cast<int64_t>(frame_offsets_.size())),
+      frame_rate_(frame_rate),
+      time_base_(time_base),
+      stream_index_(stream_index) {}
+
+bool MappedRawVideo::read(AVPacket& packet) {
+  if (next_frame_ >= frame_count_) {
+    return false;
+  }
+
+  const uint8_t* frame_start = file_->data() + frame_offsets_[next_frame_];
+
+  auto mapping_reference = new std::shared_ptr<MappedFile>(file_);
+
+  packet.buf = av_buffer_create(const_cast<uint8_t*>(frame_start), frame_size_, release_mapping, mapping_reference, AV_BUFFER_FLAG_READONLY);
+
+  if (packet.buf == nullptr) {
+    delete mapping_reference;
+    throw ffmpeg::Error{"Failed to reference mapped frame"};
+  }
+
+  packet.data = packet.buf->data;
+  packet.size = frame_size_;
+  packet.stream_index = stream_index_;
+  packet.pts = av_rescale_q(next_frame_, av_inv_q(frame_rate_), time_base_);
+  packet.dts = packet.pts;
+  packet.duration = av_rescale_q(1, av_inv_q(frame_rate_), time_base_);
+  packet.flags |= AV_PKT_FLAG_KEY;
+
+  next_frame_++;
+
+  return true;
+}
+
+bool MappedRawVideo::seek(const float position, const bool backward) {
+  if (frame_count_ == 0) {
+    return false;
+  }
+
+  const double frame = position * av_q2d(frame_rate_);
+  const int64_t target_frame = std::max(static_cast<int64_t>(backward ? std::floor(frame) : std::ceil(frame)), static_cast<int64_t>(0));
+
+  // like av_seek_frame(), a forward seek fails if there is no frame at or after the position
+  if (!backward && target_frame >= frame_count_) {
+    return false;
+  }
+
+  next_frame_ = std::min(target_frame, frame_count_ - 1);
+
+  return true;
+}
+
+int64_t MappedRawVideo::frame_count() const {
+  return frame_count_;
+}
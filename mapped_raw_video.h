@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "input_io.h"
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+// Serves the frames of a local raw video or Y4M file as packets which reference a read-only memory mapping of the
+// file, so frames reach the rawvideo decoder (which references packet data instead of copying it) without a copy.
+// Frame offsets are indexed when opening, so seeking is a lookup.
+class MappedRawVideo {
+ public:
+  // returns null if the file does not consist of whole frames, e.g. if it was truncated
+  static std::unique_ptr<MappedRawVideo> create(const std::string& file_name,
+                                                const std::string& format_name,
+                                                const AVCodecParameters* codec_parameters,
+                                                const AVRational frame_rate,
+                                                const AVRational time_base,
+                                                const int stream_index);
+
+  bool read(AVPacket& packet);
+
+  // position in seconds
+  bool seek(const float position, const bool backward);
+
+  int64_t frame_count() const;
+
+ private:
+  MappedRawVideo(std::shared_ptr<MappedFile> file, std::vector<size_t> frame_offsets, const size_t frame_size, const AVRational frame_rate, const AVRational time_base, const int stream_index);
+
+  const std::shared_ptr<MappedFile> file_;
+
+  // of each frame's data, past any frame header
+  const std::vector<size_t> frame_offsets_;
+  const size_t frame_size_;
+  const int64_t frame_count_;
+
+  const AVRational frame_rate_;
+  const AVRational time_base_;
+  const int stream_index_;
+
+  int64_t next_frame_{0};
+};
@@ -0,0 +1,146 @@
+#include "metrics_checkpoint.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "string_utils.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+static constexpr const char* CHECKPOINT_HEADER = "video-compare metrics checkpoint 1";
+
+#ifdef _WIN32
+static std::wstring to_wide(const std::string& file_name) {
+  const int wide_length = MultiByteToWideChar(CP_UTF8, 0, file_name.c_str(), -1, nullptr, 0);
+  std::wstring wide_file_name(wide_length, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, file_name.c_str(), -1, &wide_file_name[0], wide_length);
+
+  return wide_file_name;
+}
+
+static bool replace_file(const std::string& from, const std::string& to) {
+  return MoveFileExW(to_wide(from).c_str(), to_wide(to).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+static bool truncate_file(const std::string& file_name, const int64_t size) {
+  HANDLE file_handle = CreateFileW(to_wide(file_name).c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+  if (file_handle == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER position;
+  position.QuadPart = size;
+
+  const bool truncated = SetFilePointerEx(file_handle, position, nullptr, FILE_BEGIN) && SetEndOfFile(file_handle);
+  CloseHandle(file_handle);
+
+  return truncated;
+}
+#else
+static bool replace_file(const std::string& from, const std::string& to) {
+  return std::rename(from.c_str(), to.c_str()) == 0;
+}
+
+static bool truncate_file(const std::string& file_name, const int64_t size) {
+  return truncate(file_name.c_str(), static_cast<off_t>(size)) == 0;
+}
+#endif
+
+std::string MetricsCheckpoint::file_name_for(const std::string& output_file_name) {
+  return output_file_name + ".checkpoint";
+}
+
+void MetricsCheckpoint::write(const std::string& file_name) const {
+  const std::string temporary_file_name = file_name + ".tmp";
+
+  {
+    std::ofstream file(temporary_file_name, std::ios::trunc);
+
+    file << CHECKPOINT_HEADER << '\n';
+    file << "left " << left_file_name << '\n';
+    file << "right " << right_file_name << '\n';
+    file << "settings " << settings << '\n';
+    file << "segment_starts";
+    for (const int64_t segment_start : segment_starts) {
+      file << ' ' << segment_start;
+    }
+    file << '\n';
+    file << "position " << segment << ' ' << left_pts << ' ' << right_pts << '\n';
+    file << "output " << frames_written << ' ' << output_size << '\n';
+    file << "accumulator " << accumulator_state << '\n';
+
+    if (!file.flush()) {
+      throw std::runtime_error(string_sprintf("Could not write checkpoint file: %s", temporary_file_name.c_str()));
+    }
+  }
+
+  if (!replace_file(temporary_file_name, file_name)) {
+    throw std::runtime_error(string_sprintf("Could not replace checkpoint file: %s", file_name.c_str()));
+  }
+}
+
+bool MetricsCheckpoint::read(const std::string& file_name, MetricsCheckpoint& checkpoint) {
+  std::ifstream file(file_name);
+
+  if (!file) {
+    return false;
+  }
+
+  std::string line;
+
+  if (!std::getline(file, line) || line != CHECKPOINT_HEADER) {
+    throw std::runtime_error(string_sprintf("Not a checkpoint file: %s", file_name.c_str()));
+  }
+
+  bool has_position = false;
+  bool has_output = false;
+
+  while (std::getline(file, line)) {
+    const size_t separator = line.find(' ');
+    const std::string key = line.substr(0, separator);
+    const std::string value = separator != std::string::npos ? line.substr(separator + 1) : "";
+
+    std::istringstream stream(value);
+
+    if (key == "left") {
+      checkpoint.left_file_name = value;
+    } else if (key == "right") {
+      checkpoint.right_file_name = value;
+    } else if (key == "settings") {
+      stream >> checkpoint.settings;
+    } else if (key == "segment_starts") {
+      int64_t segment_start;
+
+      while (stream >> segment_start) {
+        checkpoint.segment_starts.push_back(segment_start);
+      }
+    } else if (key == "position") {
+      has_position = static_cast<bool>(stream >> checkpoint.segment >> checkpoint.left_pts >> checkpoint.right_pts);
+    } else if (key == "output") {
+      has_output = static_cast<bool>(stream >> checkpoint.frames_written >> checkpoint.output_size);
+    } else if (key == "accumulator") {
+      checkpoint.accumulator_state = value;
+    }
+  }
+
+  if (!has_position || !has_output || checkpoint.segment >= checkpoint.segment_starts.size()) {
+    throw std::runtime_error(string_sprintf("Malformed checkpoint file: %s", file_name.c_str()));
+  }
+
+  return true;
+}
+
+void MetricsCheckpoint::truncate_output(const std::string& output_file_name) const {
+  if (!truncate_file(output_file_name, output_size)) {
+    throw std::runtime_error(string_sprintf("Could not truncate the output to resume from: %s", output_file_name.c_str()));
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Progress of a headless metrics evaluation, written periodically next to its output so an interrupted run can be
+// resumed where the output ends
+struct MetricsCheckpoint {
+  std::string left_file_name;
+  std::string right_file_name;
+
+  // a hash of the settings which determine the measured frames and their order, e.g. the time shift and filters
+  uint64_t settings{0};
+
+  // in microseconds; segment i spans [segment_starts[i], segment_starts[i + 1]), and the last one is open-ended
+  std::vector<int64_t> segment_starts;
+
+  // the segment being written, and the PTS of its last written frame per side, if any
+  size_t segment{0};
+  int64_t left_pts{INT64_MIN};
+  int64_t right_pts{INT64_MIN};
+
+  uint64_t frames_written{0};
+  int64_t output_size{0};
+
+  // see MetricsAccumulator::to_string()
+  std::string accumulator_state;
+
+  static std::string file_name_for(const std::string& output_file_name);
+
+  // replaces the previous checkpoint in one step, so an interruption never leaves a partial one behind
+  void write(const std::string& file_name) const;
+
+  // returns false if there is no checkpoint; throws if it cannot be parsed
+  static bool read(const std::string& file_name, MetricsCheckpoint& checkpoint);
+
+  // cuts the output back to what had been written when the checkpoint was taken
+  void truncate_output(const std::string& output_file_name) const;
+};
@@ -0,0 +1,255 @@
+#include "metrics_database.h"
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "input_io.h"
+#include "string_utils.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static constexpr char MAGIC[8] = {'V', 'C', 'M', 'E', 'T', 'R', 'D', 'B'};
+static constexpr uint32_t VERSION = 1;
+
+// bytes hashed at either end of local files
+static constexpr size_t IDENTITY_SAMPLE_SIZE = 64 * 1024;
+
+static constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+static constexpr uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+// written in native byte order, with no padding between the fields
+struct Record {
+  uint64_t context;
+  int64_t left_pts;
+  int64_t right_pts;
+  uint32_t kind;
+  uint32_t value_count;
+  double values[MetricsDatabase::MAX_VALUES];
+};
+
+static_assert(sizeof(Record) == 32 + 8 * MetricsDatabase::MAX_VALUES, "Record must not be padded");
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+};
+
+static uint64_t fnv1a(const void* data, const size_t size, uint64_t hash = FNV_OFFSET_BASIS) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * FNV_PRIME;
+  }
+
+  return hash;
+}
+
+static uint64_t fnv1a(const std::string& string, const uint64_t hash) {
+  // the terminating NUL separates consecutive strings
+  return fnv1a(string.c_str(), string.size() + 1, hash);
+}
+
+// in platform-specific units, or -1 if unavailable
+static int64_t modification_time(const std::string& path) {
+#ifdef _WIN32
+  const int wide_length = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+  std::wstring wide_path(wide_length, L'\0');
+  MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, &wide_path[0], wide_length);
+
+  WIN32_FILE_ATTRIBUTE_DATA attributes;
+
+  if (!GetFileAttributesExW(wide_path.c_str(), GetFileExInfoStandard, &attributes)) {
+    return -1;
+  }
+
+  return (static_cast<int64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+#else
+  struct stat status;
+
+  if (stat(path.c_str(), &status) != 0) {
+    return -1;
+  }
+
+  return static_cast<int64_t>(status.st_mtime);
+#endif
+}
+
+static std::string file_identity(const std::string& file_name) {
+  if (!InputIO::is_local_file(file_name)) {
+    return file_name;
+  }
+
+  std::ifstream file(InputIO::local_path(file_name), std::ios::binary | std::ios::ate);
+
+  if (!file) {
+    return file_name;
+  }
+
+  const int64_t file_size = static_cast<int64_t>(file.tellg());
+  std::vector<char> buffer(static_cast<size_t>(std::min<int64_t>(file_size, IDENTITY_SAMPLE_SIZE)));
+
+  file.seekg(0);
+  file.read(buffer.data(), buffer.size());
+  uint64_t hash = fnv1a(buffer.data(), buffer.size());
+
+  file.seekg(file_size - static_cast<int64_t>(buffer.size()));
+  file.read(buffer.data(), buffer.size());
+  hash = fnv1a(buffer.data(), buffer.size(), hash);
+
+  return string_sprintf("%lld:%lld:%016llx", static_cast<long long>(file_size), static_cast<long long>(modification_time(InputIO::local_path(file_name))), static_cast<unsigned long long>(hash));
+}
+
+MetricsDatabase::MetricsDatabase(const std::string& file_name) : file_name_{file_name} {
+  file_ = fopen(file_name_.c_str(), "r+b");
+
+  if (file_ == nullptr) {
+    file_ = fopen(file_name_.c_str(), "w+b");
+  }
+  if (file_ == nullptr) {
+    throw std::runtime_error(string_sprintf("Could not open metrics database: %s", file_name_.c_str()));
+  }
+
+  Header header;
+
+  if (fread(&header, sizeof(header), 1, file_) != 1) {
+    // new (or empty) database
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.record_size = sizeof(Record);
+
+    fseek(file_, 0, SEEK_SET);
+
+    if (fwrite(&header, sizeof(header), 1, file_) != 1 || fflush(file_) != 0) {
+      fclose(file_);
+      throw std::runtime_error(string_sprintf("Could not write metrics database: %s", file_name_.c_str()));
+    }
+  } else if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.record_size != sizeof(Record)) {
+    fclose(file_);
+    throw std::runtime_error(string_sprintf("Not a compatible metrics database: %s", file_name_.c_str()));
+  }
+
+  long end_of_records = static_cast<long>(sizeof(header));
+  Record record;
+
+  while (fread(&record, sizeof(record), 1, file_) == 1) {
+    Values values{};
+    std::copy(record.values, record.values + std::min<size_t>(record.value_count, MAX_VALUES), values.begin());
+
+    records_[Key{record.context, static_cast<Kind>(record.kind), record.left_pts, record.right_pts}] = values;
+    end_of_records += sizeof(record);
+  }
+
+  // a record cut short by an interruption is overwritten by the next one
+  fseek(file_, end_of_records, SEEK_SET);
+}
+
+MetricsDatabase::~MetricsDatabase() {
+  fclose(file_);
+}
+
+std::shared_ptr<MetricsDatabase> MetricsDatabase::open(const std::string& file_name) {
+  static std::mutex open_mutex;
+  static std::map<std::string, std::weak_ptr<MetricsDatabase>> open_databases;
+
+  std::lock_guard<std::mutex> lock(open_mutex);
+
+  std::shared_ptr<MetricsDatabase> database = open_databases[file_name].lock();
+
+  if (database == nullptr) {
+    database = std::make_shared<MetricsDatabase>(file_name);
+    open_databases[file_name] = database;
+  }
+
+  return database;
+}
+
+uint64_t MetricsDatabase::context(const std::string& left_file_name,
+                                  const std::string& right_file_name,
+                                  const AVRational time_shift_multiplier,
+                                  const int64_t time_shift_offset_ms,
+                                  const std::string& left_filter_description,
+                                  const std::string& right_filter_description) {
+  uint64_t hash = FNV_OFFSET_BASIS;
+
+  hash = fnv1a(file_identity(left_file_name), hash);
+  hash = fnv1a(file_identity(right_file_name), hash);
+  hash = fnv1a(string_sprintf("%d/%d%+lld", time_shift_multiplier.num, time_shift_multiplier.den, static_cast<long long>(time_shift_offset_ms)), hash);
+  hash = fnv1a(left_filter_description, hash);
+  hash = fnv1a(right_filter_description, hash);
+
+  return hash;
+}
+
+uint64_t MetricsDatabase::with_domain(const uint64_t context, const std::string& domain) {
+  return fnv1a(domain, context);
+}
+
+bool MetricsDatabase::lookup(const uint64_t context, const Kind kind, const int64_t left_pts, const int64_t right_pts, Values& values) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  const auto it = records_.find(Key{context, kind, left_pts, right_pts});
+
+  if (it == records_.end()) {
+    return false;
+  }
+
+  values = it->second;
+  return true;
+}
+
+void MetricsDatabase::store(const uint64_t context, const Kind kind, const int64_t left_pts, const int64_t right_pts, const Values& values) {
+  Record record;
+  record.context = context;
+  record.left_pts = left_pts;
+  record.right_pts = right_pts;
+  record.kind = static_cast<uint32_t>(kind);
+  record.value_count = MAX_VALUES;
+  std::copy(values.begin(), values.end(), record.values);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  records_[Key{context, kind, left_pts, right_pts}] = values;
+
+  // flushed record by record, so an interruption loses at most the one being written
+  if (fwrite(&record, sizeof(record), 1, file_) != 1 || fflush(file_) != 0) {
+    throw std::runtime_error(string_sprintf("Could not write metrics database: %s", file_name_.c_str()));
+  }
+}
+
+size_t MetricsDatabase::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return records_.size();
+}
+
+MetricsDatabase::Values MetricsDatabase::pack(const FrameMetrics& metrics) {
+  return Values{static_cast<double>(metrics.planes), static_cast<double>(metrics.bit_depth), metrics.mse[0], metrics.mse[1], metrics.mse[2], metrics.ssim[0], metrics.ssim[1], metrics.ssim[2], metrics.ms_ssim, 0};
+}
+
+FrameMetrics MetricsDatabase::unpack(const Values& values) {
+  FrameMetrics metrics;
+  metrics.planes = static_cast<int>(values[0]);
+  metrics.bit_depth = static_cast<int>(values[1]);
+
+  for (int plane = 0; plane < metrics.planes; plane++) {
+    metrics.mse[plane] = values[2 + plane];
+    metrics.psnr[plane] = MetricsEngine::psnr(metrics.mse[plane], metrics.bit_depth);
+    metrics.ssim[plane] = values[5 + plane];
+  }
+  metrics.ms_ssim = values[8];
+
+  // as computed by MetricsEngine
+  metrics.weighted_psnr = metrics.planes == 3 ? (6.0 * metrics.psnr[0] + metrics.psnr[1] + metrics.psnr[2]) / 8.0 : metrics.psnr[0];
+
+  return metrics;
+}
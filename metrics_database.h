@@ -0,0 +1,68 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include "metrics_engine.h"
+extern "C" {
+#include <libavutil/rational.h>
+}
+
+// Per-frame metric scores persisted across sessions in a compact append-only binary log, so they need not be
+// recomputed. Scores are keyed by a comparison context (the identities of both input files, the time shift, the
+// filters and the domain the metrics are computed in), the kind of scores and the PTS of both frames. The log is
+// loaded into memory on opening; later records for the same key supersede earlier ones. Safe to use from several
+// threads, but not from several processes at once.
+class MetricsDatabase {
+ public:
+  enum class Kind : uint32_t {
+    DISPLAY = 1,  // PSNR, SSIM and VMAF of the displayed frames, as printed by the M key
+    NATIVE = 2,   // FrameMetrics of the frames at their native bit depth
+    VMAF = 3,     // the first VMAF score of the frames at their native bit depth
+  };
+
+  static constexpr size_t MAX_VALUES = 10;
+  using Values = std::array<double, MAX_VALUES>;
+
+  explicit MetricsDatabase(const std::string& file_name);
+  ~MetricsDatabase();
+
+  // the same instance for the same file name while it is in use, so concurrent evaluations append to one log
+  static std::shared_ptr<MetricsDatabase> open(const std::string& file_name);
+
+  MetricsDatabase(const MetricsDatabase&) = delete;
+  MetricsDatabase& operator=(const MetricsDatabase&) = delete;
+
+  // local files are identified by their size, modification time and a hash of their first and last bytes, so
+  // renaming or moving them keeps their scores while rewriting them does not; other inputs by their URL
+  static uint64_t context(const std::string& left_file_name,
+                          const std::string& right_file_name,
+                          const AVRational time_shift_multiplier,
+                          const int64_t time_shift_offset_ms,
+                          const std::string& left_filter_description,
+                          const std::string& right_filter_description);
+
+  // e.g. the size and pixel format of the measured frames
+  static uint64_t with_domain(const uint64_t context, const std::string& domain);
+
+  bool lookup(const uint64_t context, const Kind kind, const int64_t left_pts, const int64_t right_pts, Values& values) const;
+  void store(const uint64_t context, const Kind kind, const int64_t left_pts, const int64_t right_pts, const Values& values);
+
+  size_t size() const;
+
+  static Values pack(const FrameMetrics& metrics);
+  static FrameMetrics unpack(const Values& values);
+
+ private:
+  using Key = std::tuple<uint64_t, Kind, int64_t, int64_t>;
+
+  const std::string file_name_;
+  FILE* file_{};
+
+  mutable std::mutex mutex_;
+  std::map<Key, Values> records_;
+};
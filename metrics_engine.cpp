@@ -0,0 +1,507 @@
+#include "metrics_engine.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <initializer_list>
+#include <limits>
+#include <sstream>
+#include <vector>
+#include "ffmpeg.h"
+#include "string_utils.h"
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+// SSIM is computed over 8x8 windows which overlap by 4 pixels in each direction, assembled from 4x4 block sums
+static constexpr int SSIM_BLOCK_SIZE = 4;
+
+static constexpr int ROWS_PER_TASK = 64;
+
+// bounds the score cache, which is cleared once full
+static constexpr size_t MAX_CACHED_METRICS = 256;
+
+struct BlockSums {
+  uint64_t left;
+  uint64_t right;
+  uint64_t squares;  // of both sides
+  uint64_t products;
+};
+
+MetricsEngine::MetricsEngine(const int threads) : row_workers_{threads} {}
+
+bool MetricsEngine::is_supported(const AVPixelFormat pixel_format) {
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(pixel_format);
+
+  if (descriptor == nullptr || (descriptor->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_BE | AV_PIX_FMT_FLAG_FLOAT))) {
+    return false;
+  }
+
+  const int components = descriptor->nb_components >= 3 ? 3 : 1;
+
+  if (components == 3 && !(descriptor->flags & AV_PIX_FMT_FLAG_PLANAR)) {
+    return false;
+  }
+
+  const int depth = descriptor->comp[0].depth;
+
+  if (depth < 8 || depth > 16) {
+    return false;
+  }
+
+  for (int c = 0; c < components; c++) {
+    const AVComponentDescriptor& component = descriptor->comp[c];
+
+    if (component.plane != c || component.depth != depth || component.shift != 0 || component.offset != 0 || component.step != (depth > 8 ? 2 : 1)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+AVPixelFormat MetricsEngine::planar_equivalent(const AVPixelFormat pixel_format) {
+  if (is_supported(pixel_format)) {
+    return pixel_format;
+  }
+
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(pixel_format);
+
+  if (descriptor == nullptr || (descriptor->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM))) {
+    return AV_PIX_FMT_NONE;
+  }
+
+  const bool is_rgb = descriptor->flags & AV_PIX_FMT_FLAG_RGB;
+  const bool is_gray = descriptor->nb_components < 3;
+  const int depth = std::max<int>(descriptor->comp[0].depth, 8);
+
+  for (const AVPixFmtDescriptor* candidate = av_pix_fmt_desc_next(nullptr); candidate != nullptr; candidate = av_pix_fmt_desc_next(candidate)) {
+    const AVPixelFormat candidate_format = av_pix_fmt_desc_get_id(candidate);
+
+    // no alpha, which would not be measured anyway
+    if (candidate->nb_components != (is_gray ? 1 : 3) || static_cast<bool>(candidate->flags & AV_PIX_FMT_FLAG_RGB) != is_rgb || (candidate->flags & AV_PIX_FMT_FLAG_ALPHA) ||
+        candidate->comp[0].depth != depth || candidate->log2_chroma_w != descriptor->log2_chroma_w || candidate->log2_chroma_h != descriptor->log2_chroma_h || !is_supported(candidate_format)) {
+      continue;
+    }
+
+    return candidate_format;
+  }
+
+  return AV_PIX_FMT_NONE;
+}
+
+AVPixelFormat MetricsEngine::common_planar_format(const AVPixelFormat left_pixel_format, const AVPixelFormat right_pixel_format) {
+  const AVPixFmtDescriptor* left_descriptor = av_pix_fmt_desc_get(left_pixel_format);
+  const AVPixFmtDescriptor* right_descriptor = av_pix_fmt_desc_get(right_pixel_format);
+
+  if (left_descriptor == nullptr || right_descriptor == nullptr) {
+    return AV_PIX_FMT_NONE;
+  }
+
+  return planar_equivalent(right_descriptor->comp[0].depth > left_descriptor->comp[0].depth ? right_pixel_format : left_pixel_format);
+}
+
+std::array<std::string, 3> MetricsEngine::plane_names(const AVPixelFormat pixel_format) {
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(pixel_format);
+
+  if (descriptor != nullptr && (descriptor->flags & AV_PIX_FMT_FLAG_RGB)) {
+    return {"G", "B", "R"};
+  }
+
+  return {"Y", "U", "V"};
+}
+
+double MetricsEngine::psnr(const double mse, const int bit_depth) {
+  if (mse <= 0) {
+    return std::numeric_limits<double>::infinity();
+  }
+
+  const double peak = static_cast<double>((1 << bit_depth) - 1);
+
+  return 10.0 * std::log10(peak * peak / mse);
+}
+
+template <typename S>
+uint64_t MetricsEngine::sum_squared_errors(const AVFrame* left_frame, const AVFrame* right_frame, const int plane, const int width, const int height) const {
+  std::vector<uint64_t> worker_sums(row_workers_.size(), 0);
+
+  row_workers_.run_dynamic_indexed(
+      height,
+      [&](const int start_row, const int end_row, const int worker_index) {
+        uint64_t sum = 0;
+
+        for (int y = start_row; y < end_row; y++) {
+          const S* row_left = reinterpret_cast<const S*>(left_frame->data[plane] + static_cast<ptrdiff_t>(y) * left_frame->linesize[plane]);
+          const S* row_right = reinterpret_cast<const S*>(right_frame->data[plane] + static_cast<ptrdiff_t>(y) * right_frame->linesize[plane]);
+
+          // a row of 16-bit samples cannot overflow 64 bits, so the inner loop is free to vectorize
+          uint64_t row_sum = 0;
+
+          for (int x = 0; x < width; x++) {
+            const int64_t d = static_cast<int64_t>(row_left[x]) - static_cast<int64_t>(row_right[x]);
+            row_sum += static_cast<uint64_t>(d * d);
+          }
+
+          sum += row_sum;
+        }
+
+        worker_sums[worker_index] += sum;
+      },
+      ROWS_PER_TASK);
+
+  uint64_t total = 0;
+
+  for (const uint64_t sum : worker_sums) {
+    total += sum;
+  }
+
+  return total;
+}
+
+template <typename S>
+MetricsEngine::SsimStatistics MetricsEngine::ssim_statistics(const S* left, const ptrdiff_t left_stride, const S* right, const ptrdiff_t right_stride, const int width, const int height, const int bit_depth) const {
+  const int block_columns = width / SSIM_BLOCK_SIZE;
+  const int block_rows = height / SSIM_BLOCK_SIZE;
+
+  const double peak = static_cast<double>((1 << bit_depth) - 1);
+  const double c1 = (0.01 * peak) * (0.01 * peak);
+  const double c2 = (0.03 * peak) * (0.03 * peak);
+
+  // adds the SSIM and its contrast-structure term of a window
+  auto add_window = [c1, c2](const BlockSums& sums, const double count, SsimStatistics& statistics) {
+    const double mean_left = sums.left / count;
+    const double mean_right = sums.right / count;
+    const double variance_sum = sums.squares / count - mean_left * mean_left - mean_right * mean_right;
+    const double covariance = sums.products / count - mean_left * mean_right;
+
+    const double luminance = (2.0 * mean_left * mean_right + c1) / (mean_left * mean_left + mean_right * mean_right + c1);
+    const double contrast_structure = (2.0 * covariance + c2) / (variance_sum + c2);
+
+    statistics.ssim += luminance * contrast_structure;
+    statistics.contrast_structure += contrast_structure;
+  };
+
+  auto sum_block_row = [&](const int block_y, std::vector<BlockSums>& sums, const int columns) {
+    std::fill(sums.begin(), sums.end(), BlockSums{0, 0, 0, 0});
+
+    for (int y = block_y * SSIM_BLOCK_SIZE; y < (block_y + 1) * SSIM_BLOCK_SIZE; y++) {
+      const S* row_left = left + y * left_stride;
+      const S* row_right = right + y * right_stride;
+
+      for (int block_x = 0; block_x < columns; block_x++) {
+        BlockSums& block = sums[block_x];
+
+        for (int x = block_x * SSIM_BLOCK_SIZE; x < (block_x + 1) * SSIM_BLOCK_SIZE; x++) {
+          const uint64_t a = row_left[x];
+          const uint64_t b = row_right[x];
+
+          block.left += a;
+          block.right += b;
+          block.squares += a * a + b * b;
+          block.products += a * b;
+        }
+      }
+    }
+  };
+
+  SsimStatistics statistics{0.0, 0.0};
+
+  // too small for a single window: treat the whole plane as one
+  if (block_columns < 2 || block_rows < 2) {
+    if (width * height == 0) {
+      return {1.0, 1.0};
+    }
+
+    BlockSums sums{0, 0, 0, 0};
+
+    for (int y = 0; y < height; y++) {
+      const S* row_left = left + y * left_stride;
+      const S* row_right = right + y * right_stride;
+
+      for (int x = 0; x < width; x++) {
+        sums.left += row_left[x];
+        sums.right += row_right[x];
+        sums.squares += static_cast<uint64_t>(row_left[x]) * row_left[x] + static_cast<uint64_t>(row_right[x]) * row_right[x];
+        sums.products += static_cast<uint64_t>(row_left[x]) * row_right[x];
+      }
+    }
+
+    add_window(sums, static_cast<double>(width) * height, statistics);
+
+    return statistics;
+  }
+
+  const int window_rows = block_rows - 1;
+  const int window_columns = block_columns - 1;
+
+  std::vector<SsimStatistics> worker_statistics(row_workers_.size(), SsimStatistics{0.0, 0.0});
+
+  row_workers_.run_dynamic_indexed(
+      window_rows,
+      [&](const int start_row, const int end_row, const int worker_index) {
+        std::vector<BlockSums> upper(block_columns);
+        std::vector<BlockSums> lower(block_columns);
+
+        sum_block_row(start_row, upper, block_columns);
+
+        SsimStatistics partial{0.0, 0.0};
+
+        for (int window_y = start_row; window_y < end_row; window_y++) {
+          sum_block_row(window_y + 1, lower, block_columns);
+
+          for (int window_x = 0; window_x < window_columns; window_x++) {
+            const BlockSums window{upper[window_x].left + upper[window_x + 1].left + lower[window_x].left + lower[window_x + 1].left,
+                                   upper[window_x].right + upper[window_x + 1].right + lower[window_x].right + lower[window_x + 1].right,
+                                   upper[window_x].squares + upper[window_x + 1].squares + lower[window_x].squares + lower[window_x + 1].squares,
+                                   upper[window_x].products + upper[window_x + 1].products + lower[window_x].products + lower[window_x + 1].products};
+
+            add_window(window, 4 * SSIM_BLOCK_SIZE * SSIM_BLOCK_SIZE, partial);
+          }
+
+          std::swap(upper, lower);
+        }
+
+        worker_statistics[worker_index].ssim += partial.ssim;
+        worker_statistics[worker_index].contrast_structure += partial.contrast_structure;
+      },
+      ROWS_PER_TASK / SSIM_BLOCK_SIZE);
+
+  for (const SsimStatistics& partial : worker_statistics) {
+    statistics.ssim += partial.ssim;
+    statistics.contrast_structure += partial.contrast_structure;
+  }
+
+  const double windows = static_cast<double>(window_rows) * window_columns;
+
+  return {statistics.ssim / windows, statistics.contrast_structure / windows};
+}
+
+template <typename S>
+void MetricsEngine::downsample(const S* source, const ptrdiff_t source_stride, const int width, const int height, std::vector<uint16_t>& destination) const {
+  const int destination_width = width / 2;
+  const int destination_height = height / 2;
+
+  destination.resize(static_cast<size_t>(destination_width) * destination_height);
+
+  uint16_t* destination_data = destination.data();
+
+  row_workers_.run_dynamic(
+      destination_height,
+      [=](const int start_row, const int end_row) {
+        for (int y = start_row; y < end_row; y++) {
+          const S* upper = source + (2 * y) * source_stride;
+          const S* lower = upper + source_stride;
+          uint16_t* out = destination_data + static_cast<ptrdiff_t>(y) * destination_width;
+
+          for (int x = 0; x < destination_width; x++) {
+            out[x] = static_cast<uint16_t>((upper[2 * x] + upper[2 * x + 1] + lower[2 * x] + lower[2 * x + 1] + 2) >> 2);
+          }
+        }
+      },
+      ROWS_PER_TASK);
+}
+
+template <typename S>
+double MetricsEngine::ms_ssim(const AVFrame* left_frame, const AVFrame* right_frame, const SsimStatistics& full_resolution_statistics, const int bit_depth) const {
+  // exponents of the five scales as given by Wang et al.
+  static constexpr std::array<double, MS_SSIM_SCALES> SCALE_WEIGHTS{0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+
+  const ptrdiff_t left_stride = left_frame->linesize[0] / static_cast<ptrdiff_t>(sizeof(S));
+  const ptrdiff_t right_stride = right_frame->linesize[0] / static_cast<ptrdiff_t>(sizeof(S));
+
+  std::array<SsimStatistics, MS_SSIM_SCALES> scale_statistics;
+  scale_statistics[0] = full_resolution_statistics;
+
+  std::vector<uint16_t> left_level;
+  std::vector<uint16_t> right_level;
+  std::vector<uint16_t> left_next_level;
+  std::vector<uint16_t> right_next_level;
+
+  int width = left_frame->width;
+  int height = left_frame->height;
+  int scales = 1;
+
+  for (; scales < MS_SSIM_SCALES && (width / 2) >= 2 * SSIM_BLOCK_SIZE && (height / 2) >= 2 * SSIM_BLOCK_SIZE; scales++) {
+    if (scales == 1) {
+      downsample(reinterpret_cast<const S*>(left_frame->data[0]), left_stride, width, height, left_next_level);
+      downsample(reinterpret_cast<const S*>(right_frame->data[0]), right_stride, width, height, right_next_level);
+    } else {
+      downsample(left_level.data(), width, width, height, left_next_level);
+      downsample(right_level.data(), width, width, height, right_next_level);
+    }
+
+    std::swap(left_level, left_next_level);
+    std::swap(right_level, right_next_level);
+    width /= 2;
+    height /= 2;
+
+    scale_statistics[scales] = ssim_statistics(left_level.data(), width, right_level.data(), width, width, height, bit_depth);
+  }
+
+  // scales dropped for small frames are left out, and the remaining weights renormalized
+  double weight_sum = 0.0;
+
+  for (int scale = 0; scale < scales; scale++) {
+    weight_sum += SCALE_WEIGHTS[scale];
+  }
+
+  double result = 1.0;
+
+  for (int scale = 0; scale < scales; scale++) {
+    // the luminance term only counts at the coarsest scale
+    const double term = scale == scales - 1 ? scale_statistics[scale].ssim : scale_statistics[scale].contrast_structure;
+
+    result *= std::pow(std::max(term, 0.0), SCALE_WEIGHTS[scale] / weight_sum);
+  }
+
+  return result;
+}
+
+FrameMetrics MetricsEngine::compute(const AVFrame* left_frame, const AVFrame* right_frame) const {
+  // hashing both frames takes a fraction of the time measuring them does
+  const std::pair<uint64_t, uint64_t> key{ffmpeg::compute_content_hash(left_frame, row_workers_), ffmpeg::compute_content_hash(right_frame, row_workers_)};
+  const bool known_contents = key.first != 0 && key.second != 0;
+
+  if (known_contents) {
+    const auto cached = cached_metrics_.find(key);
+
+    if (cached != cached_metrics_.end()) {
+      return cached->second;
+    }
+  }
+
+  const FrameMetrics metrics = measure(left_frame, right_frame);
+
+  if (known_contents) {
+    if (cached_metrics_.size() >= MAX_CACHED_METRICS) {
+      cached_metrics_.clear();
+    }
+    cached_metrics_[key] = metrics;
+  }
+
+  return metrics;
+}
+
+FrameMetrics MetricsEngine::measure(const AVFrame* left_frame, const AVFrame* right_frame) const {
+  const AVPixelFormat pixel_format = static_cast<AVPixelFormat>(left_frame->format);
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(pixel_format);
+
+  FrameMetrics metrics;
+  metrics.planes = descriptor->nb_components >= 3 ? 3 : 1;
+  metrics.bit_depth = descriptor->comp[0].depth;
+
+  const bool has_chroma_planes = !(descriptor->flags & AV_PIX_FMT_FLAG_RGB);
+
+  for (int plane = 0; plane < metrics.planes; plane++) {
+    const bool is_chroma_plane = plane > 0 && has_chroma_planes;
+    const int width = is_chroma_plane ? -((-left_frame->width) >> descriptor->log2_chroma_w) : left_frame->width;
+    const int height = is_chroma_plane ? -((-left_frame->height) >> descriptor->log2_chroma_h) : left_frame->height;
+
+    uint64_t sse;
+
+    auto measure = [&](const auto sample) {
+      using S = decltype(sample);
+
+      sse = sum_squared_errors<S>(left_frame, right_frame, plane, width, height);
+
+      const SsimStatistics statistics = ssim_statistics(reinterpret_cast<const S*>(left_frame->data[plane]), left_frame->linesize[plane] / static_cast<ptrdiff_t>(sizeof(S)),
+                                                        reinterpret_cast<const S*>(right_frame->data[plane]), right_frame->linesize[plane] / static_cast<ptrdiff_t>(sizeof(S)), width, height, metrics.bit_depth);
+      metrics.ssim[plane] = statistics.ssim;
+
+      // MS-SSIM of the first plane, reusing its full-resolution statistics as the finest scale
+      if (plane == 0) {
+        metrics.ms_ssim = ms_ssim<S>(left_frame, right_frame, statistics, metrics.bit_depth);
+      }
+    };
+
+    if (metrics.bit_depth > 8) {
+      measure(uint16_t{});
+    } else {
+      measure(uint8_t{});
+    }
+
+    metrics.mse[plane] = static_cast<double>(sse) / (static_cast<double>(width) * height);
+    metrics.psnr[plane] = psnr(metrics.mse[plane], metrics.bit_depth);
+  }
+
+  metrics.weighted_psnr = metrics.planes == 3 ? (6.0 * metrics.psnr[0] + metrics.psnr[1] + metrics.psnr[2]) / 8.0 : metrics.psnr[0];
+
+  return metrics;
+}
+
+void MetricsAccumulator::add(const FrameMetrics& metrics) {
+  sums_.planes = metrics.planes;
+  sums_.bit_depth = metrics.bit_depth;
+
+  for (int plane = 0; plane < metrics.planes; plane++) {
+    sums_.mse[plane] += metrics.mse[plane];
+    sums_.ssim[plane] += metrics.ssim[plane];
+  }
+  sums_.ms_ssim += metrics.ms_ssim;
+
+  frames_++;
+}
+
+size_t MetricsAccumulator::frames() const {
+  return frames_;
+}
+
+FrameMetrics MetricsAccumulator::mean() const {
+  FrameMetrics mean;
+  mean.planes = sums_.planes;
+  mean.bit_depth = sums_.bit_depth;
+
+  if (frames_ == 0) {
+    return mean;
+  }
+
+  for (int plane = 0; plane < mean.planes; plane++) {
+    mean.mse[plane] = sums_.mse[plane] / frames_;
+    mean.psnr[plane] = MetricsEngine::psnr(mean.mse[plane], mean.bit_depth);
+    mean.ssim[plane] = sums_.ssim[plane] / frames_;
+  }
+  mean.ms_ssim = sums_.ms_ssim / frames_;
+
+  mean.weighted_psnr = mean.planes == 3 ? (6.0 * mean.psnr[0] + mean.psnr[1] + mean.psnr[2]) / 8.0 : mean.psnr[0];
+
+  return mean;
+}
+
+std::string MetricsAccumulator::to_string() const {
+  // hexadecimal floating point, so the sums are restored bit for bit
+  std::string state = string_sprintf("%zu %d %d", frames_, sums_.planes, sums_.bit_depth);
+
+  for (const double sum : {sums_.mse[0], sums_.mse[1], sums_.mse[2], sums_.ssim[0], sums_.ssim[1], sums_.ssim[2], sums_.ms_ssim}) {
+    state += string_sprintf(" %a", sum);
+  }
+
+  return state;
+}
+
+bool MetricsAccumulator::from_string(const std::string& state) {
+  std::istringstream stream(state);
+  std::string token;
+
+  size_t frames;
+  FrameMetrics sums;
+
+  if (!(stream >> frames >> sums.planes >> sums.bit_depth) || sums.planes < 0 || sums.planes > 3) {
+    return false;
+  }
+
+  for (double* sum : {&sums.mse[0], &sums.mse[1], &sums.mse[2], &sums.ssim[0], &sums.ssim[1], &sums.ssim[2], &sums.ms_ssim}) {
+    char* end;
+
+    if (!(stream >> token)) {
+      return false;
+    }
+    *sum = std::strtod(token.c_str(), &end);
+
+    if (*end != '\0') {
+      return false;
+    }
+  }
+
+  frames_ = frames;
+  sums_ = sums;
+  return true;
+}
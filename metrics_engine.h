@@ -0,0 +1,111 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "row_workers.h"
+extern "C" {
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+}
+
+struct FrameMetrics {
+  int planes{0};
+  int bit_depth{8};
+
+  // in squared code values at the native bit depth
+  std::array<double, 3> mse{};
+
+  // in dB, infinite for identical planes
+  std::array<double, 3> psnr{};
+  // (6 Y + U + V) / 8, as commonly reported for YUV codecs; equal to the Y PSNR for gray frames
+  double weighted_psnr{0};
+
+  std::array<double, 3> ssim{};
+
+  // multi-scale SSIM of the first (luma or green) plane
+  double ms_ssim{0};
+};
+
+// Per-plane PSNR and SSIM computed directly on planar YUV, RGB or gray frames at their native bit depth (8 to
+// 16 bits), so neither chroma errors nor the low bits of high bit-depth sources are lost to an RGB or gray
+// intermediate. Sums are accumulated as integers, and planes are split into row stripes across worker threads.
+// MS-SSIM uses a 2x2 box pyramid of the first plane, with each level downsampled in parallel.
+class MetricsEngine {
+ public:
+  explicit MetricsEngine(const int threads = 0);
+
+  // true for planar formats of 8 to 16 bits in native byte order with at most one component per plane
+  static bool is_supported(const AVPixelFormat pixel_format);
+
+  // a supported format with the same components, bit depth and subsampling (e.g. yuv420p for nv12); returns
+  // AV_PIX_FMT_NONE if there is none
+  static AVPixelFormat planar_equivalent(const AVPixelFormat pixel_format);
+
+  // the format two inputs are measured in: the planar equivalent of the one with the higher bit depth, so no
+  // precision is lost; returns AV_PIX_FMT_NONE if there is none
+  static AVPixelFormat common_planar_format(const AVPixelFormat left_pixel_format, const AVPixelFormat right_pixel_format);
+
+  // e.g. Y, U and V, or G, B and R
+  static std::array<std::string, 3> plane_names(const AVPixelFormat pixel_format);
+
+  // both frames must share a supported pixel format and their dimensions; pairs whose contents were measured
+  // recently are not measured again
+  FrameMetrics compute(const AVFrame* left_frame, const AVFrame* right_frame) const;
+
+  static double psnr(const double mse, const int bit_depth);
+
+ private:
+  FrameMetrics measure(const AVFrame* left_frame, const AVFrame* right_frame) const;
+
+  template <typename S>
+  uint64_t sum_squared_errors(const AVFrame* left_frame, const AVFrame* right_frame, const int plane, const int width, const int height) const;
+
+  // means over all windows of a plane
+  struct SsimStatistics {
+    double ssim;
+    double contrast_structure;
+  };
+
+  static constexpr int MS_SSIM_SCALES = 5;
+
+  // strides are in samples
+  template <typename S>
+  SsimStatistics ssim_statistics(const S* left, const ptrdiff_t left_stride, const S* right, const ptrdiff_t right_stride, const int width, const int height, const int bit_depth) const;
+
+  // 2x2 box filter, halving both dimensions
+  template <typename S>
+  void downsample(const S* source, const ptrdiff_t source_stride, const int width, const int height, std::vector<uint16_t>& destination) const;
+
+  // continues the pyramid of the first plane from its full-resolution statistics
+  template <typename S>
+  double ms_ssim(const AVFrame* left_frame, const AVFrame* right_frame, const SsimStatistics& full_resolution_statistics, const int bit_depth) const;
+
+  RowWorkers row_workers_;
+
+  // scores of recently measured frame pairs, keyed by their content hashes, so repeated content such as static
+  // scenes, slates or duplicated frames is measured once
+  mutable std::map<std::pair<uint64_t, uint64_t>, FrameMetrics> cached_metrics_;
+};
+
+// Combines per-frame results into clip-level ones: PSNR is derived from the mean squared error over all frames,
+// which keeps identical frames from making the mean infinite, while SSIM is averaged
+class MetricsAccumulator {
+ public:
+  void add(const FrameMetrics& metrics);
+
+  size_t frames() const;
+
+  FrameMetrics mean() const;
+
+  // the exact state as a line of text, for checkpoints; from_string() returns false if it is malformed
+  std::string to_string() const;
+  bool from_string(const std::string& state);
+
+ private:
+  size_t frames_{0};
+  FrameMetrics sums_;
+};
@@ -0,0 +1,430 @@
+#include "metrics_evaluator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <thread>
+#include "ffmpeg.h"
+#include "metrics_report.h"
+#include "string_utils.h"
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+// writing a checkpoint takes well under a millisecond, so this keeps its cost negligible
+static constexpr std::chrono::seconds CHECKPOINT_INTERVAL{10};
+
+std::unique_ptr<MetricsEvaluator::Segment> MetricsEvaluator::create_segment(const VideoCompareConfig& config, const int decoder_threads) {
+  // decoders get their part of the segment's share of the cores unless their threads are set explicitly
+  VideoCompareConfig segment_config = config;
+  AVDictionary* left_decoder_options = nullptr;
+  AVDictionary* right_decoder_options = nullptr;
+
+  if (decoder_threads > 0) {
+    av_dict_copy(&left_decoder_options, config.left.decoder_options, 0);
+    av_dict_copy(&right_decoder_options, config.right.decoder_options, 0);
+    av_dict_set_int(&left_decoder_options, "threads", decoder_threads, AV_DICT_DONT_OVERWRITE);
+    av_dict_set_int(&right_decoder_options, "threads", decoder_threads, AV_DICT_DONT_OVERWRITE);
+
+    segment_config.left.decoder_options = left_decoder_options;
+    segment_config.right.decoder_options = right_decoder_options;
+  }
+
+  auto segment = std::make_unique<Segment>();
+
+  try {
+    segment->left_source = std::make_unique<FrameSource>(LEFT, segment_config.left, segment_config);
+    segment->right_source = std::make_unique<FrameSource>(RIGHT, segment_config.right, segment_config);
+  } catch (...) {
+    av_dict_free(&left_decoder_options);
+    av_dict_free(&right_decoder_options);
+    throw;
+  }
+
+  // the sources made their own copies
+  av_dict_free(&left_decoder_options);
+  av_dict_free(&right_decoder_options);
+
+  segment->left_source->create_filterer(config.left, config.right, *segment->right_source, config);
+  segment->right_source->create_filterer(config.right, config.left, *segment->left_source, config);
+
+  segment->left_frames = segment->left_source->add_consumer(metrics_report::QUEUE_SIZE);
+  segment->right_frames = segment->right_source->add_consumer(metrics_report::QUEUE_SIZE);
+
+  return segment;
+}
+
+MetricsEvaluator::MetricsEvaluator(const VideoCompareConfig& config, const std::string& metrics_file_name, const size_t segment_count, const bool resume, const int threads) : metrics_file_name_{metrics_file_name}, time_shift_(config.time_shift) {
+  // segments run concurrently, so like --jobs they split the threads between their decoders and row workers
+  const int available_threads = threads > 0 ? threads : static_cast<int>(std::thread::hardware_concurrency());
+  int decoder_threads = segment_count > 1 ? std::max(1, available_threads / static_cast<int>(segment_count) / 3) : 0;
+
+  auto first_segment = create_segment(config, decoder_threads);
+
+  const VideoFilterer* left_filterer = first_segment->left_source->video_filterer();
+  const VideoFilterer* right_filterer = first_segment->right_source->video_filterer();
+
+  width_ = std::max(left_filterer->dest_width(), right_filterer->dest_width());
+  height_ = std::max(left_filterer->dest_height(), right_filterer->dest_height());
+  pixel_format_ = MetricsEngine::common_planar_format(left_filterer->dest_pixel_format(), right_filterer->dest_pixel_format());
+
+  metrics_report::check_measurable(pixel_format_, left_filterer->dest_pixel_format());
+
+  if (!config.metrics_database_file_name.empty()) {
+    metrics_database_ = MetricsDatabase::open(config.metrics_database_file_name);
+    metrics_context_ = MetricsDatabase::with_domain(MetricsDatabase::context(config.left.file_name, config.right.file_name, config.time_shift.multiplier, config.time_shift.offset_ms, left_filterer->filter_description(),
+                                                                             right_filterer->filter_description()),
+                                                    string_sprintf("native %zux%zu %s", width_, height_, av_get_pix_fmt_name(pixel_format_)));
+  }
+
+  // segments and resumed runs start decoding part-way, which only yields the same frames if the filters preserve
+  // their timing
+  const bool preserves_timing = left_filterer->preserves_timing() && right_filterer->preserves_timing();
+
+  checkpoint_file_name_ = (!metrics_file_name_.empty() && metrics_file_name_ != "-" && preserves_timing) ? MetricsCheckpoint::file_name_for(metrics_file_name_) : "";
+  checkpoint_.left_file_name = config.left.file_name;
+  checkpoint_.right_file_name = config.right.file_name;
+  checkpoint_.settings = MetricsDatabase::with_domain(MetricsDatabase::context(config.left.file_name, config.right.file_name, config.time_shift.multiplier, config.time_shift.offset_ms, left_filterer->filter_description(),
+                                                                               right_filterer->filter_description()),
+                                                      string_sprintf("native %zux%zu %s in %zu segments", width_, height_, av_get_pix_fmt_name(pixel_format_), segment_count));
+
+  if (resume) {
+    if (checkpoint_file_name_.empty()) {
+      throw std::runtime_error("Cannot resume, as the filters may drop, duplicate or retime frames");
+    }
+
+    MetricsCheckpoint saved_checkpoint;
+
+    if (MetricsCheckpoint::read(checkpoint_file_name_, saved_checkpoint)) {
+      if (saved_checkpoint.left_file_name != checkpoint_.left_file_name || saved_checkpoint.right_file_name != checkpoint_.right_file_name) {
+        throw std::runtime_error(string_sprintf("Checkpoint %s was written for other input files", checkpoint_file_name_.c_str()));
+      }
+      // rows measured under other settings must not be mixed with new ones
+      if (saved_checkpoint.settings != checkpoint_.settings) {
+        throw std::runtime_error(string_sprintf("Checkpoint %s was written with another time shift, filters or segment count", checkpoint_file_name_.c_str()));
+      }
+
+      checkpoint_ = saved_checkpoint;
+      resuming_ = true;
+    } else {
+      std::cerr << "No checkpoint to resume from, starting from the beginning" << std::endl;
+    }
+  }
+
+  if (!resuming_) {
+    const int64_t common_duration = std::min(first_segment->left_source->demuxer()->duration(), first_segment->right_source->demuxer()->duration());
+    size_t actual_segment_count = segment_count;
+
+    if (segment_count > 1) {
+      if (!preserves_timing) {
+        std::cerr << "Evaluating as a single segment, as the filters may drop, duplicate or retime frames" << std::endl;
+        actual_segment_count = 1;
+      } else if (common_duration <= 0) {
+        std::cerr << "Evaluating as a single segment, as the duration is unknown" << std::endl;
+        actual_segment_count = 1;
+      }
+
+      // a single segment's decoders may use all the cores again
+      if (actual_segment_count == 1) {
+        decoder_threads = 0;
+        first_segment = create_segment(config, decoder_threads);
+      }
+    }
+
+    // the first segment includes any frames before zero
+    checkpoint_.segment_starts.push_back(INT64_MIN);
+
+    for (size_t i = 1; i < actual_segment_count; i++) {
+      checkpoint_.segment_starts.push_back(common_duration * static_cast<int64_t>(i) / static_cast<int64_t>(actual_segment_count));
+    }
+  }
+
+  const std::vector<int64_t>& segment_starts = checkpoint_.segment_starts;
+
+  // segments before the one being written when the checkpoint was taken are complete
+  for (size_t i = checkpoint_.segment; i < segment_starts.size(); i++) {
+    auto segment = i == checkpoint_.segment ? std::move(first_segment) : create_segment(config, decoder_threads);
+    segment->index = i;
+
+    // the last segment is left open, so both sides are read to their ends
+    const int64_t end_pts = i + 1 < segment_starts.size() ? segment_starts[i + 1] : INT64_MAX;
+
+    // segment bounds are on the left timeline; the right side covers the time-shifted range
+    const int64_t right_start_pts = FramePairer::left_to_right_time(time_shift_, segment_starts[i]);
+    const int64_t right_end_pts = FramePairer::left_to_right_time(time_shift_, end_pts);
+
+    if (i == checkpoint_.segment) {
+      segment->left_source->restrict_to(std::max(segment_starts[i], checkpoint_.left_pts + 1), end_pts);
+      segment->right_source->restrict_to(std::max(right_start_pts, checkpoint_.right_pts + 1), right_end_pts);
+    } else {
+      segment->left_source->restrict_to(segment_starts[i], end_pts);
+      segment->right_source->restrict_to(right_start_pts, right_end_pts);
+    }
+
+    segments_.push_back(std::move(segment));
+  }
+
+  // row workers get what is left of each segment's share once its two decoders are accounted for
+  const int threads_per_segment = (segments_.size() > 1 || threads > 0) ? std::max(1, available_threads / static_cast<int>(segments_.size()) - 2 * decoder_threads) : 0;
+
+  for (auto& segment : segments_) {
+    segment->metrics_engine = std::make_unique<MetricsEngine>(threads_per_segment);
+    segment->measured_frames = std::make_unique<Queue<MeasuredFrame>>(std::numeric_limits<size_t>::max());
+  }
+}
+
+void MetricsEvaluator::measure(Segment& segment) {
+  FramePairer frame_pairer(segment.left_frames, segment.right_frames, time_shift_);
+
+  try {
+    while (true) {
+      std::shared_ptr<AVFrame> left_frame;
+      std::shared_ptr<AVFrame> right_frame;
+
+      if (!frame_pairer.next(left_frame, right_frame)) {
+        segment.unpaired_frames_side = frame_pairer.remaining_frames_side();
+        break;
+      }
+
+      FrameMetrics metrics;
+      MetricsDatabase::Values cached_values;
+
+      if (metrics_database_ != nullptr && metrics_database_->lookup(metrics_context_, MetricsDatabase::Kind::NATIVE, left_frame->pts, right_frame->pts, cached_values)) {
+        metrics = MetricsDatabase::unpack(cached_values);
+      } else {
+        metrics = segment.metrics_engine->compute(left_frame.get(), right_frame.get());
+
+        if (metrics_database_ != nullptr) {
+          metrics_database_->store(metrics_context_, MetricsDatabase::Kind::NATIVE, left_frame->pts, right_frame->pts, MetricsDatabase::pack(metrics));
+        }
+      }
+
+      if (!segment.measured_frames->push(MeasuredFrame{left_frame->pts, right_frame->pts, metrics})) {
+        break;
+      }
+    }
+  } catch (...) {
+    segment.exception = std::current_exception();
+  }
+
+  segment.skipped_left_frames = frame_pairer.skipped_left_frames();
+  segment.skipped_right_frames = frame_pairer.skipped_right_frames();
+
+  segment.measured_frames->stop();
+
+  // the longer side may still be decoding
+  segment.left_source->quit();
+  segment.right_source->quit();
+}
+
+void MetricsEvaluator::set_print_summary(const bool print_summary) {
+  print_summary_ = print_summary;
+}
+
+AVPixelFormat MetricsEvaluator::pixel_format() const {
+  return pixel_format_;
+}
+
+const MetricsAccumulator& MetricsEvaluator::accumulator() const {
+  return accumulator_;
+}
+
+size_t MetricsEvaluator::estimated_frame_memory(const size_t decoder_frames) const {
+  const size_t frame_size = static_cast<size_t>(std::max(av_image_get_buffer_size(pixel_format_, static_cast<int>(width_), static_cast<int>(height_), 1), 0));
+
+  // per side: the consumer queue, the frame being measured, and those held by the decoder and filters
+  return segments_.size() * 2 * (metrics_report::QUEUE_SIZE + 1 + decoder_frames) * frame_size;
+}
+
+bool MetricsEvaluator::operator()() {
+  std::ofstream metrics_file;
+  std::ostream discarded_output(nullptr);
+
+  if (!metrics_file_name_.empty() && metrics_file_name_ != "-") {
+    if (resuming_) {
+      checkpoint_.truncate_output(metrics_file_name_);
+      metrics_file.open(metrics_file_name_, std::ios::binary | std::ios::app);
+    } else {
+      metrics_file.open(metrics_file_name_, std::ios::binary | std::ios::trunc);
+
+      // a checkpoint of an earlier run no longer matches the output
+      if (!checkpoint_file_name_.empty()) {
+        std::remove(checkpoint_file_name_.c_str());
+      }
+    }
+
+    if (!metrics_file) {
+      throw std::runtime_error(string_sprintf("Could not open metrics file for writing: %s", metrics_file_name_.c_str()));
+    }
+  }
+
+  std::ostream& output = metrics_file_name_.empty() ? discarded_output : metrics_file_name_ != "-" ? metrics_file : std::cout;
+
+  const std::array<std::string, 3> plane_names = MetricsEngine::plane_names(pixel_format_);
+
+  MetricsAccumulator& accumulator = accumulator_;
+  uint64_t frame_number = checkpoint_.frames_written;
+  const uint64_t resumed_frames = frame_number;
+  int64_t output_size = checkpoint_.output_size;
+
+  if (resuming_) {
+    if (!accumulator.from_string(checkpoint_.accumulator_state)) {
+      throw std::runtime_error(string_sprintf("Malformed checkpoint file: %s", checkpoint_file_name_.c_str()));
+    }
+
+    std::cerr << string_sprintf("Resuming after frame %llu", static_cast<unsigned long long>(frame_number)) << std::endl;
+  } else {
+    const std::string header = "frame,left_pts,right_pts" + metrics_report::csv_header(pixel_format_) + "\n";
+
+    output << header;
+    output_size += header.size();
+  }
+
+  const auto start_time = std::chrono::steady_clock::now();
+
+  std::vector<std::thread> segment_threads;
+
+  for (auto& segment : segments_) {
+    segment->left_source->start(width_, height_, pixel_format_);
+    segment->right_source->start(width_, height_, pixel_format_);
+
+    segment_threads.emplace_back(&MetricsEvaluator::measure, this, std::ref(*segment));
+  }
+
+  auto finish = [&]() {
+    for (auto& thread : segment_threads) {
+      thread.join();
+    }
+    for (auto& segment : segments_) {
+      segment->left_source->finish();
+      segment->right_source->finish();
+
+      if (segment->exception != nullptr) {
+        std::rethrow_exception(segment->exception);
+      }
+    }
+  };
+
+  auto last_checkpoint_time = std::chrono::steady_clock::now();
+
+  try {
+    // segments are written in order, each as soon as its frames are measured
+    for (auto& segment : segments_) {
+      if (segment->index != checkpoint_.segment) {
+        checkpoint_.segment = segment->index;
+        checkpoint_.left_pts = INT64_MIN;
+        checkpoint_.right_pts = INT64_MIN;
+      }
+
+      MeasuredFrame measured_frame;
+
+      while (segment->measured_frames->pop(measured_frame)) {
+        const FrameMetrics& metrics = measured_frame.metrics;
+        accumulator.add(metrics);
+
+        const std::string row = string_sprintf("%llu,%.6f,%.6f", static_cast<unsigned long long>(frame_number++), measured_frame.left_pts * AV_TIME_TO_SEC, measured_frame.right_pts * AV_TIME_TO_SEC) + metrics_report::csv_values(metrics) + "\n";
+
+        output << row;
+        output_size += row.size();
+
+        checkpoint_.left_pts = measured_frame.left_pts;
+        checkpoint_.right_pts = measured_frame.right_pts;
+
+        const auto now = std::chrono::steady_clock::now();
+
+        if (!checkpoint_file_name_.empty() && now - last_checkpoint_time >= CHECKPOINT_INTERVAL) {
+          // the output must hold every frame the checkpoint accounts for
+          output.flush();
+
+          checkpoint_.frames_written = frame_number;
+          checkpoint_.output_size = output_size;
+          checkpoint_.accumulator_state = accumulator.to_string();
+          checkpoint_.write(checkpoint_file_name_);
+
+          last_checkpoint_time = now;
+        }
+      }
+    }
+  } catch (...) {
+    for (auto& segment : segments_) {
+      segment->measured_frames->quit();
+    }
+    finish();
+    throw;
+  }
+
+  output.flush();
+
+  finish();
+
+  // the run is complete, so there is nothing left to resume
+  if (!checkpoint_file_name_.empty()) {
+    std::remove(checkpoint_file_name_.c_str());
+  }
+
+  if (accumulator.frames() == 0) {
+    std::cerr << "No frame pairs to compute metrics for" << std::endl;
+    return false;
+  }
+  uint64_t skipped_left_frames = 0;
+  uint64_t skipped_right_frames = 0;
+
+  for (const auto& segment : segments_) {
+    skipped_left_frames += segment->skipped_left_frames;
+    skipped_right_frames += segment->skipped_right_frames;
+  }
+  if (skipped_left_frames > 0 || skipped_right_frames > 0) {
+    std::cerr << string_sprintf("Skipped %llu left and %llu right frames without a counterpart at the same (time-shifted) time", static_cast<unsigned long long>(skipped_left_frames), static_cast<unsigned long long>(skipped_right_frames))
+              << std::endl;
+  }
+
+  for (const auto& segment : segments_) {
+    const std::string& unpaired_frames_side = segment->unpaired_frames_side;
+
+    if (unpaired_frames_side.empty()) {
+      continue;
+    }
+    if (segment->index + 1 == checkpoint_.segment_starts.size()) {
+      std::cerr << "Ignoring the remaining frames of the " << unpaired_frames_side << " video, which is longer" << std::endl;
+    } else {
+      std::cerr << "Ignoring unpaired frames of the " << unpaired_frames_side << " video at the end of segment " << (segment->index + 1) << std::endl;
+    }
+  }
+
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  const double evaluation_fps = (frame_number - resumed_frames) / std::max(elapsed, 1e-6);
+  const double video_fps = av_q2d(segments_.front()->left_source->demuxer()->guess_frame_rate());
+
+  if (!print_summary_) {
+    return true;
+  }
+
+  const FrameMetrics mean = accumulator.mean();
+
+  std::ostream& summary = metrics_report::summary_stream(metrics_file_name_);
+
+  summary << string_sprintf("Metrics over %zu frames (%s, %d-bit):", accumulator.frames(), av_get_pix_fmt_name(pixel_format_), mean.bit_depth);
+
+  for (int plane = 0; plane < mean.planes; plane++) {
+    summary << " PSNR-" << plane_names[plane] << "(" << metrics_report::format_psnr(mean.psnr[plane]) << ")";
+  }
+  summary << " PSNR-W(" << metrics_report::format_psnr(mean.weighted_psnr) << ")";
+  for (int plane = 0; plane < mean.planes; plane++) {
+    summary << string_sprintf(" SSIM-%s(%.5f)", plane_names[plane].c_str(), mean.ssim[plane]);
+  }
+  summary << string_sprintf(" MS-SSIM(%.5f)", mean.ms_ssim) << std::endl;
+
+  summary << string_sprintf("Evaluated at %.1f frames/s", evaluation_fps);
+  if (segments_.size() > 1) {
+    summary << string_sprintf(" in %zu segments", segments_.size());
+  }
+  if (video_fps > 0) {
+    summary << string_sprintf(" (%.2fx real time)", evaluation_fps / video_fps);
+  }
+  summary << std::endl;
+
+  return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "frame_pairer.h"
+#include "frame_source.h"
+#include "metrics_checkpoint.h"
+#include "metrics_database.h"
+#include "metrics_engine.h"
+#include "queue.h"
+
+// Headless evaluation of per-frame quality metrics over the whole clips. Frames are decoded and filtered as for
+// display, but measured in their native planar format; frames of both sides are paired by their time-shifted PTS.
+// The clips can be split into time segments which are decoded and measured concurrently, each starting from the
+// keyframes preceding its start; frames are owned by the segment their PTS falls into.
+class MetricsEvaluator {
+ public:
+  // when resuming, the output is cut back to the last checkpoint, and evaluation continues from there. An empty
+  // file name discards the per-frame metrics. The metric workers of all segments share the given number of threads
+  // (0 for one per core).
+  MetricsEvaluator(const VideoCompareConfig& config, const std::string& metrics_file_name, const size_t segment_count = 1, const bool resume = false, const int threads = 0);
+
+  // writes the per-frame metrics as CSV and prints the clip-level ones; returns false if no frame pair was measured
+  bool operator()();
+
+  // e.g. when several evaluations report together
+  void set_print_summary(const bool print_summary);
+
+  AVPixelFormat pixel_format() const;
+
+  // the clip-level metrics, once evaluated
+  const MetricsAccumulator& accumulator() const;
+
+  // a rough upper bound of the memory taken by frames in flight, given the number of frames each decoder holds
+  size_t estimated_frame_memory(const size_t decoder_frames) const;
+
+ private:
+  struct MeasuredFrame {
+    // in microseconds
+    int64_t left_pts;
+    int64_t right_pts;
+    FrameMetrics metrics;
+  };
+
+  struct Segment {
+    size_t index;
+
+    std::unique_ptr<FrameSource> left_source;
+    std::unique_ptr<FrameSource> right_source;
+
+    FrameSource::FrameQueue* left_frames;
+    FrameSource::FrameQueue* right_frames;
+
+    std::unique_ptr<MetricsEngine> metrics_engine;
+
+    // unbounded, so later segments need not wait for the earlier ones to be written
+    std::unique_ptr<Queue<MeasuredFrame>> measured_frames;
+
+    std::string unpaired_frames_side;
+    uint64_t skipped_left_frames{0};
+    uint64_t skipped_right_frames{0};
+    std::exception_ptr exception;
+  };
+
+  // decoder_threads > 0 sets the decoders' thread count unless their options already do
+  static std::unique_ptr<Segment> create_segment(const VideoCompareConfig& config, const int decoder_threads);
+
+  void measure(Segment& segment);
+
+  const std::string metrics_file_name_;
+  const TimeShiftConfig time_shift_;
+
+  size_t width_;
+  size_t height_;
+  AVPixelFormat pixel_format_;
+
+  // scores cached by earlier runs are reused, and new ones added
+  std::shared_ptr<MetricsDatabase> metrics_database_;
+  uint64_t metrics_context_{0};
+
+  bool print_summary_{true};
+  MetricsAccumulator accumulator_;
+
+  // segments already complete in a resumed run are skipped
+  std::vector<std::unique_ptr<Segment>> segments_;
+
+  // written periodically unless the output goes to stdout, or the run cannot be resumed
+  std::string checkpoint_file_name_;
+  MetricsCheckpoint checkpoint_;
+  bool resuming_{false};
+};
@@ -0,0 +1,59 @@
+#include "metrics_report.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include "string_utils.h"
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+namespace metrics_report {
+std::string format_psnr(const double psnr) {
+  return std::isinf(psnr) ? "inf" : string_sprintf("%.4f", psnr);
+}
+
+void check_measurable(const AVPixelFormat measured_pixel_format, const AVPixelFormat input_pixel_format) {
+  if (measured_pixel_format == AV_PIX_FMT_NONE) {
+    throw std::runtime_error(string_sprintf("Cannot compute metrics for the pixel format %s", av_get_pix_fmt_name(input_pixel_format)));
+  }
+}
+
+std::string csv_header(const AVPixelFormat pixel_format) {
+  const std::array<std::string, 3> plane_names = MetricsEngine::plane_names(pixel_format);
+  const int planes = av_pix_fmt_desc_get(pixel_format)->nb_components >= 3 ? 3 : 1;
+
+  std::string header;
+
+  for (int plane = 0; plane < planes; plane++) {
+    header += ",psnr_" + to_lower_case(plane_names[plane]);
+  }
+  header += ",psnr_weighted";
+  for (int plane = 0; plane < planes; plane++) {
+    header += ",ssim_" + to_lower_case(plane_names[plane]);
+  }
+
+  return header + ",ms_ssim";
+}
+
+std::string csv_values(const FrameMetrics& metrics, const int padded_planes) {
+  const int planes = std::max(metrics.planes, padded_planes);
+
+  std::string values;
+
+  for (int plane = 0; plane < planes; plane++) {
+    values += "," + (plane < metrics.planes ? format_psnr(metrics.psnr[plane]) : "");
+  }
+  values += "," + format_psnr(metrics.weighted_psnr);
+  for (int plane = 0; plane < planes; plane++) {
+    values += "," + (plane < metrics.planes ? string_sprintf("%.6f", metrics.ssim[plane]) : "");
+  }
+
+  return values + string_sprintf(",%.6f", metrics.ms_ssim);
+}
+
+std::ostream& summary_stream(const std::string& csv_file_name) {
+  return csv_file_name != "-" ? std::cout : std::cerr;
+}
+}  // namespace metrics_report
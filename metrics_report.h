@@ -0,0 +1,31 @@
+#pragma once
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include "metrics_engine.h"
+extern "C" {
+#include <libavutil/pixfmt.h>
+}
+
+// Shared by the headless metric evaluations (--metrics, --sample, --ladder and --jobs), so their CSV columns,
+// number formats and summaries stay consistent
+namespace metrics_report {
+// frames queued per consumer of a FrameSource
+constexpr size_t QUEUE_SIZE = 8;
+
+// "inf" for identical frames
+std::string format_psnr(const double psnr);
+
+// throws if no format was found in which to measure an input of the given pixel format
+void check_measurable(const AVPixelFormat measured_pixel_format, const AVPixelFormat input_pixel_format);
+
+// ",psnr_<plane>...,psnr_weighted,ssim_<plane>...,ms_ssim" with the plane names of the pixel format
+std::string csv_header(const AVPixelFormat pixel_format);
+
+// the values of the csv_header() columns; with padded_planes > 0, absent planes are written as empty fields up to
+// that many planes
+std::string csv_values(const FrameMetrics& metrics, const int padded_planes = 0);
+
+// keeps the summary apart from CSV data written to stdout
+std::ostream& summary_stream(const std::string& csv_file_name);
+}  // namespace metrics_report
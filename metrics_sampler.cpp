@@ -0,0 +1,349 @@
+#include "metrics_sampler.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include "ffmpeg.h"
+#include "metrics_report.h"
+#include "string_utils.h"
+#include "vmaf_calculator.h"
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+// two-sided 95% quantiles of Student's t-distribution for 1 to 30 degrees of freedom; the normal one beyond
+static constexpr std::array<double, 30> T_QUANTILES_95 = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131,
+                                                          2.120,  2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+static constexpr double NORMAL_QUANTILE_95 = 1.960;
+
+static std::string describe(const MetricsSampler::Sampling& sampling) {
+  switch (sampling.strategy) {
+    case MetricsSampler::Strategy::EVERY_NTH:
+      return string_sprintf("every %llu frames", static_cast<unsigned long long>(sampling.count));
+    case MetricsSampler::Strategy::RANDOM:
+      return string_sprintf("%llu random frames, seed %llu", static_cast<unsigned long long>(sampling.count), static_cast<unsigned long long>(sampling.seed));
+    default:
+      return "keyframes";
+  }
+}
+
+struct Estimate {
+  size_t count{0};
+  double mean{0};
+  double ci_low{0};
+  double ci_high{0};
+  double p5{0};
+  double p50{0};
+  double p95{0};
+};
+
+// percentiles by linear interpolation, and the confidence interval of the mean with the finite population
+// correction, as the sample is drawn without replacement
+static Estimate estimate(std::vector<double> values, const uint64_t population) {
+  Estimate result;
+  result.count = values.size();
+
+  if (values.empty()) {
+    return result;
+  }
+
+  std::sort(values.begin(), values.end());
+
+  auto percentile = [&](const double p) {
+    const double position = p * (values.size() - 1);
+    const size_t below = static_cast<size_t>(position);
+    const size_t above = std::min(below + 1, values.size() - 1);
+
+    return values[below] + (values[above] - values[below]) * (position - below);
+  };
+
+  result.p5 = percentile(0.05);
+  result.p50 = percentile(0.50);
+  result.p95 = percentile(0.95);
+
+  double sum = 0;
+  for (const double value : values) {
+    sum += value;
+  }
+  result.mean = sum / values.size();
+
+  double half_width = 0;
+
+  if (values.size() > 1) {
+    double squared_deviations = 0;
+    for (const double value : values) {
+      squared_deviations += (value - result.mean) * (value - result.mean);
+    }
+
+    const double n = static_cast<double>(values.size());
+    const double standard_error = std::sqrt(squared_deviations / (n - 1) / n);
+    const double correction = population > values.size() ? std::sqrt((population - n) / (population - 1.0)) : 0.0;
+    const double quantile = values.size() - 1 <= T_QUANTILES_95.size() ? T_QUANTILES_95[values.size() - 2] : NORMAL_QUANTILE_95;
+
+    half_width = quantile * standard_error * correction;
+  }
+
+  result.ci_low = result.mean - half_width;
+  result.ci_high = result.mean + half_width;
+
+  return result;
+}
+
+MetricsSampler::MetricsSampler(const VideoCompareConfig& config, const std::string& metrics_file_name, const Sampling& sampling)
+    : metrics_file_name_{metrics_file_name}, strategy_description_{describe(sampling)}, left_source_{LEFT, config.left, config}, right_source_{RIGHT, config.right, config} {
+  left_source_.create_filterer(config.left, config.right, right_source_, config);
+  right_source_.create_filterer(config.right, config.left, left_source_, config);
+
+  const VideoFilterer* left_filterer = left_source_.video_filterer();
+  const VideoFilterer* right_filterer = right_source_.video_filterer();
+
+  // sampled frames are found by seeking, which only yields the same frames if the filters preserve their timing
+  if (!left_filterer->preserves_timing() || !right_filterer->preserves_timing()) {
+    throw std::runtime_error("Cannot sample frames, as the filters may drop, duplicate or retime frames");
+  }
+
+  width_ = std::max(left_filterer->dest_width(), right_filterer->dest_width());
+  height_ = std::max(left_filterer->dest_height(), right_filterer->dest_height());
+  pixel_format_ = MetricsEngine::common_planar_format(left_filterer->dest_pixel_format(), right_filterer->dest_pixel_format());
+
+  metrics_report::check_measurable(pixel_format_, left_filterer->dest_pixel_format());
+
+  if (!config.metrics_database_file_name.empty()) {
+    metrics_database_ = MetricsDatabase::open(config.metrics_database_file_name);
+    metrics_context_ = MetricsDatabase::with_domain(MetricsDatabase::context(config.left.file_name, config.right.file_name, config.time_shift.multiplier, config.time_shift.offset_ms, left_filterer->filter_description(),
+                                                                             right_filterer->filter_description()),
+                                                    string_sprintf("native %zux%zu %s", width_, height_, av_get_pix_fmt_name(pixel_format_)));
+  }
+
+  const std::vector<int64_t> sample_pts = select_sample_pts(sampling);
+
+  if (sample_pts.empty()) {
+    throw std::runtime_error("No frames to sample");
+  }
+
+  // samples are on the left timeline, and mapped onto the right one by the time shift
+  std::vector<int64_t> right_sample_pts;
+
+  for (const int64_t pts : sample_pts) {
+    right_sample_pts.push_back(FramePairer::left_to_right_time(config.time_shift, pts));
+  }
+
+  left_source_.sample_at(sample_pts, sample_tolerance(left_source_.demuxer()));
+  right_source_.sample_at(right_sample_pts, sample_tolerance(right_source_.demuxer()));
+
+  left_frames_ = left_source_.add_consumer(metrics_report::QUEUE_SIZE);
+  right_frames_ = right_source_.add_consumer(metrics_report::QUEUE_SIZE);
+}
+
+int64_t MetricsSampler::sample_tolerance(const Demuxer* demuxer) {
+  const AVRational frame_rate = demuxer->guess_frame_rate();
+
+  // half a frame, so slightly irregular time stamps still select the intended frame
+  return (frame_rate.num > 0 && frame_rate.den > 0) ? av_rescale_q(1, av_inv_q(frame_rate), AV_R_MICROSECONDS) / 2 : 0;
+}
+
+std::vector<int64_t> MetricsSampler::select_sample_pts(const Sampling& sampling) {
+  const Demuxer* left_demuxer = left_source_.demuxer();
+  const Demuxer* right_demuxer = right_source_.demuxer();
+
+  const int64_t common_duration = std::min(left_demuxer->duration(), right_demuxer->duration());
+  const AVRational frame_rate = left_demuxer->guess_frame_rate();
+
+  if (common_duration <= 0 || frame_rate.num <= 0 || frame_rate.den <= 0) {
+    throw std::runtime_error("Sampling requires inputs of known duration and frame rate");
+  }
+
+  const int64_t frame_duration = av_rescale_q(1, av_inv_q(frame_rate), AV_R_MICROSECONDS);
+  total_frames_ = std::max<uint64_t>(1, common_duration / std::max<int64_t>(frame_duration, 1));
+
+  auto frame_pts = [&](const uint64_t frame) { return av_rescale_q(frame, av_inv_q(frame_rate), AV_R_MICROSECONDS); };
+
+  std::vector<int64_t> sample_pts;
+
+  switch (sampling.strategy) {
+    case Strategy::EVERY_NTH:
+      for (uint64_t frame = 0; frame < total_frames_; frame += sampling.count) {
+        sample_pts.push_back(frame_pts(frame));
+      }
+      break;
+    case Strategy::RANDOM: {
+      std::mt19937_64 generator(sampling.seed);
+      std::uniform_int_distribution<uint64_t> distribution(0, total_frames_ - 1);
+      std::set<uint64_t> frames;
+
+      while (frames.size() < std::min(sampling.count, total_frames_)) {
+        frames.insert(distribution(generator));
+      }
+      for (const uint64_t frame : frames) {
+        sample_pts.push_back(frame_pts(frame));
+      }
+      break;
+    }
+    case Strategy::KEYFRAMES: {
+      const std::vector<int64_t> keyframes = left_source_.demuxer()->keyframes();
+
+      if (keyframes.empty()) {
+        throw std::runtime_error("Sampling keyframes requires an input with a keyframe index (e.g. MP4 or Matroska)");
+      }
+      for (const int64_t keyframe : keyframes) {
+        if (keyframe < common_duration && (sample_pts.empty() || keyframe > sample_pts.back())) {
+          sample_pts.push_back(keyframe);
+        }
+      }
+      break;
+    }
+  }
+
+  return sample_pts;
+}
+
+bool MetricsSampler::operator()() {
+  std::ofstream metrics_file;
+
+  if (metrics_file_name_ != "-") {
+    metrics_file.open(metrics_file_name_);
+
+    if (!metrics_file) {
+      throw std::runtime_error(string_sprintf("Could not open metrics file for writing: %s", metrics_file_name_.c_str()));
+    }
+  }
+
+  std::ostream& output = metrics_file_name_ != "-" ? metrics_file : std::cout;
+
+  const std::array<std::string, 3> plane_names = MetricsEngine::plane_names(pixel_format_);
+
+  output << "sample,left_pts,right_pts" << metrics_report::csv_header(pixel_format_) << ",vmaf" << std::endl;
+
+  const auto start_time = std::chrono::steady_clock::now();
+
+  left_source_.start(width_, height_, pixel_format_);
+  right_source_.start(width_, height_, pixel_format_);
+
+  std::vector<double> psnr_first_plane_values, weighted_psnr_values, ssim_first_plane_values, ms_ssim_values, vmaf_values;
+  size_t identical_frames = 0;
+  std::string unpaired_frames_side;
+
+  try {
+    for (uint64_t sample = 0;; sample++) {
+      std::shared_ptr<AVFrame> left_frame;
+      std::shared_ptr<AVFrame> right_frame;
+
+      const bool has_left_frame = left_frames_->pop(left_frame);
+      const bool has_right_frame = right_frames_->pop(right_frame);
+
+      if (!has_left_frame || !has_right_frame) {
+        if (has_left_frame != has_right_frame) {
+          unpaired_frames_side = has_left_frame ? "left" : "right";
+        }
+        break;
+      }
+
+      FrameMetrics metrics;
+      MetricsDatabase::Values cached_values;
+
+      if (metrics_database_ != nullptr && metrics_database_->lookup(metrics_context_, MetricsDatabase::Kind::NATIVE, left_frame->pts, right_frame->pts, cached_values)) {
+        metrics = MetricsDatabase::unpack(cached_values);
+      } else {
+        metrics = metrics_engine_.compute(left_frame.get(), right_frame.get());
+
+        if (metrics_database_ != nullptr) {
+          metrics_database_->store(metrics_context_, MetricsDatabase::Kind::NATIVE, left_frame->pts, right_frame->pts, MetricsDatabase::pack(metrics));
+        }
+      }
+
+      // the first score if there are several models; libvmaf may be unavailable
+      std::string vmaf;
+
+      if (metrics_database_ != nullptr && metrics_database_->lookup(metrics_context_, MetricsDatabase::Kind::VMAF, left_frame->pts, right_frame->pts, cached_values)) {
+        vmaf = string_sprintf("%.6f", cached_values[0]);
+      } else {
+        vmaf = VMAFCalculator::instance().compute(left_frame.get(), right_frame.get());
+        vmaf = vmaf.substr(0, vmaf.find('|'));
+
+        if (metrics_database_ != nullptr && vmaf != "n/a") {
+          metrics_database_->store(metrics_context_, MetricsDatabase::Kind::VMAF, left_frame->pts, right_frame->pts, MetricsDatabase::Values{std::stod(vmaf)});
+        }
+      }
+
+      const bool has_vmaf = vmaf != "n/a";
+
+      if (std::isfinite(metrics.weighted_psnr)) {
+        weighted_psnr_values.push_back(metrics.weighted_psnr);
+      } else {
+        identical_frames++;
+      }
+      if (std::isfinite(metrics.psnr[0])) {
+        psnr_first_plane_values.push_back(metrics.psnr[0]);
+      }
+      ssim_first_plane_values.push_back(metrics.ssim[0]);
+      ms_ssim_values.push_back(metrics.ms_ssim);
+
+      if (has_vmaf) {
+        vmaf_values.push_back(std::stod(vmaf));
+      }
+
+      output << sample << string_sprintf(",%.6f,%.6f", ffmpeg::pts_in_secs(left_frame.get()), ffmpeg::pts_in_secs(right_frame.get())) << metrics_report::csv_values(metrics) << "," << (has_vmaf ? vmaf : "") << "\n";
+    }
+  } catch (...) {
+    left_source_.quit();
+    right_source_.quit();
+    throw;
+  }
+
+  output.flush();
+
+  left_source_.quit();
+  right_source_.quit();
+
+  left_source_.finish();
+  right_source_.finish();
+
+  const size_t sampled_frames = ssim_first_plane_values.size();
+
+  if (sampled_frames == 0) {
+    std::cerr << "No frame pairs to compute metrics for" << std::endl;
+    return false;
+  }
+  if (!unpaired_frames_side.empty()) {
+    std::cerr << "Ignoring the remaining samples of the " << unpaired_frames_side << " video, which is longer" << std::endl;
+  }
+
+  const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+  std::ostream& summary = metrics_report::summary_stream(metrics_file_name_);
+
+  summary << string_sprintf("Estimates from %zu of %llu frames (%s; %s, %d-bit), in %.1f s:", sampled_frames, static_cast<unsigned long long>(total_frames_), strategy_description_.c_str(), av_get_pix_fmt_name(pixel_format_),
+                            av_pix_fmt_desc_get(pixel_format_)->comp[0].depth, elapsed)
+          << std::endl;
+
+  auto print_estimate = [&](const std::string& name, const std::vector<double>& values, const char* format) {
+    if (values.empty()) {
+      return;
+    }
+
+    const Estimate result = estimate(values, total_frames_);
+    const std::string value_format = string_sprintf("  %%-8s mean %s (95%% CI %s to %s), p5 %s, median %s, p95 %s", format, format, format, format, format, format);
+
+    summary << string_sprintf(value_format.c_str(), name.c_str(), result.mean, result.ci_low, result.ci_high, result.p5, result.p50, result.p95);
+    if (result.count < sampled_frames) {
+      summary << string_sprintf(" [%zu frames]", result.count);
+    }
+    summary << std::endl;
+  };
+
+  print_estimate("PSNR-" + plane_names[0], psnr_first_plane_values, "%.3f");
+  print_estimate("PSNR-W", weighted_psnr_values, "%.3f");
+  print_estimate("SSIM-" + plane_names[0], ssim_first_plane_values, "%.5f");
+  print_estimate("MS-SSIM", ms_ssim_values, "%.5f");
+  print_estimate("VMAF", vmaf_values, "%.3f");
+
+  if (identical_frames > 0) {
+    summary << string_sprintf("  %zu identical frames are left out of the PSNR estimates", identical_frames) << std::endl;
+  }
+
+  return true;
+}
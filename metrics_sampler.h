@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "frame_pairer.h"
+#include "frame_source.h"
+#include "metrics_database.h"
+#include "metrics_engine.h"
+
+// Headless estimation of the clip-level metrics from a sample of the frames, for quick triage. Both sides seek to
+// each sampled frame where the keyframe index shows that skipping ahead is cheaper than decoding. Each side delivers
+// one frame per sample, so frames are paired by sample; right sample times follow the time shift. Besides the means,
+// percentiles and confidence intervals of per-frame PSNR, SSIM, MS-SSIM and VMAF are reported.
+class MetricsSampler {
+ public:
+  enum class Strategy { EVERY_NTH, RANDOM, KEYFRAMES };
+
+  struct Sampling {
+    Strategy strategy{Strategy::EVERY_NTH};
+
+    // the N of every Nth frame, or the number of random frames
+    uint64_t count{1};
+
+    // random frames are the same for the same seed
+    uint64_t seed{0};
+  };
+
+  MetricsSampler(const VideoCompareConfig& config, const std::string& metrics_file_name, const Sampling& sampling);
+
+  // writes the metrics of the sampled frames as CSV and prints the estimates; returns false if no frame pair was
+  // sampled
+  bool operator()();
+
+ private:
+  // on the left timeline, at the nominal times of the sampled frames
+  std::vector<int64_t> select_sample_pts(const Sampling& sampling);
+
+  static int64_t sample_tolerance(const Demuxer* demuxer);
+
+  const std::string metrics_file_name_;
+  const std::string strategy_description_;
+
+  FrameSource left_source_;
+  FrameSource right_source_;
+
+  FrameSource::FrameQueue* left_frames_;
+  FrameSource::FrameQueue* right_frames_;
+
+  size_t width_;
+  size_t height_;
+  AVPixelFormat pixel_format_;
+
+  // frames in the common duration, as the population the sample is drawn from
+  uint64_t total_frames_{0};
+
+  MetricsEngine metrics_engine_;
+
+  // scores cached by earlier runs are reused, and new ones added
+  std::shared_ptr<MetricsDatabase> metrics_database_;
+  uint64_t metrics_context_{0};
+};
@@ -0,0 +1,66 @@
+#include "packet_queue.h"
+#include <algorithm>
+
+// amount of playback time to prefetch, in microseconds
+static constexpr int64_t PREFETCH_DURATION = 1000000;
+
+// headroom over the average bit rate for peaks in variable bit rate streams
+static constexpr double BIT_RATE_HEADROOM = 1.5;
+
+static constexpr size_t MIN_PACKETS = 5;
+static constexpr size_t MAX_PACKETS = 240;
+static constexpr size_t MIN_BYTES = 4 * 1024 * 1024;
+static constexpr size_t MAX_BYTES = 128 * 1024 * 1024;
+static constexpr size_t DEFAULT_BYTES = 16 * 1024 * 1024;
+static constexpr double DEFAULT_FRAME_RATE = 30.0;
+
+static size_t derive_max_packets(const AVRational frame_rate) {
+  const double frames_per_second = frame_rate.num > 0 && frame_rate.den > 0 ? av_q2d(frame_rate) : DEFAULT_FRAME_RATE;
+
+  return std::min(std::max(static_cast<size_t>(frames_per_second * PREFETCH_DURATION / AV_TIME_BASE), MIN_PACKETS), MAX_PACKETS);
+}
+
+static size_t derive_max_bytes(const int64_t bit_rate) {
+  if (bit_rate <= 0) {
+    return DEFAULT_BYTES;
+  }
+
+  const double bytes = static_cast<double>(bit_rate) / 8 * BIT_RATE_HEADROOM * PREFETCH_DURATION / AV_TIME_BASE;
+
+  return static_cast<size_t>(std::min(std::max(bytes, static_cast<double>(MIN_BYTES)), static_cast<double>(MAX_BYTES)));
+}
+
+PacketQueue::PacketQueue(const int64_t bit_rate, const AVRational frame_rate, const AVRational time_base)
+    : Queue<AVPacketUniquePtr>(derive_max_packets(frame_rate)), time_base_(time_base), max_bytes_(derive_max_bytes(bit_rate)), max_duration_(PREFETCH_DURATION) {}
+
+size_t PacketQueue::max_packets() const {
+  return size_max_;
+}
+
+size_t PacketQueue::max_bytes() const {
+  return max_bytes_;
+}
+
+bool PacketQueue::is_full() const {
+  // always accept a packet into an empty queue, however large it is
+  return !queue_.empty() && (queue_.size() >= size_max_ || bytes_ >= max_bytes_ || duration_ >= max_duration_);
+}
+
+void PacketQueue::on_pushed(const AVPacketUniquePtr& packet) {
+  bytes_ += packet->size;
+  duration_ += packet_duration(packet);
+}
+
+void PacketQueue::on_popped(const AVPacketUniquePtr& packet) {
+  bytes_ -= packet->size;
+  duration_ -= packet_duration(packet);
+}
+
+void PacketQueue::on_emptied() {
+  bytes_ = 0;
+  duration_ = 0;
+}
+
+int64_t PacketQueue::packet_duration(const AVPacketUniquePtr& packet) const {
+  return packet->duration > 0 ? av_rescale_q(packet->duration, time_base_, AV_TIME_BASE_Q) : 0;
+}
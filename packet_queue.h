@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include "queue.h"
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+using AVPacketUniquePtr = std::unique_ptr<AVPacket, std::function<void(AVPacket*)>>;
+
+// Packet queue bounded by total size and duration as well as by count, so that roughly the same amount of
+// playback time is buffered for high-bitrate intra-only content as for low-bitrate long-GOP content
+class PacketQueue : public Queue<AVPacketUniquePtr> {
+ public:
+  // limits are derived from the stream bit rate and frame rate, either of which may be unknown (0)
+  PacketQueue(const int64_t bit_rate, const AVRational frame_rate, const AVRational time_base);
+
+  size_t max_packets() const;
+  size_t max_bytes() const;
+
+ protected:
+  bool is_full() const override;
+  void on_pushed(const AVPacketUniquePtr& packet) override;
+  void on_popped(const AVPacketUniquePtr& packet) override;
+  void on_emptied() override;
+
+ private:
+  int64_t packet_duration(const AVPacketUniquePtr& packet) const;
+
+  const AVRational time_base_;
+  size_t max_bytes_;
+
+  // both in microseconds
+  int64_t max_duration_;
+  int64_t duration_{0};
+
+  size_t bytes_{0};
+};
@@ -0,0 +1,134 @@
+#include "png_exporter.h"
+#include <iostream>
+#include <stdexcept>
+#include "png_saver.h"
+#include "string_utils.h"
+
+PngExporter::PngExporter(const size_t max_pending_exports, const size_t threads) : max_pending_exports_{max_pending_exports} {
+  for (size_t i = 0; i < threads; i++) {
+    workers_.emplace_back(&PngExporter::work, this);
+  }
+}
+
+PngExporter::~PngExporter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+
+  task_available_.notify_all();
+
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+std::shared_ptr<AVFrame> PngExporter::reference(const AVFrame* frame) {
+  AVFrame* frame_reference = av_frame_clone(frame);
+
+  if (frame_reference == nullptr) {
+    throw std::runtime_error("Could not reference frame for saving");
+  }
+
+  return std::shared_ptr<AVFrame>(frame_reference, [](AVFrame* frame_to_free) { av_frame_free(&frame_to_free); });
+}
+
+bool PngExporter::submit(const std::vector<Image>& images) {
+  if (images.empty()) {
+    return true;
+  }
+
+  auto image_export = std::make_shared<Export>();
+  image_export->images = images;
+  image_export->remaining = images.size();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (pending_exports_ >= max_pending_exports_) {
+      return false;
+    }
+
+    pending_exports_++;
+    pending_images_ += images.size();
+
+    for (size_t i = 0; i < images.size(); i++) {
+      tasks_.push_back(Task{image_export, i});
+    }
+  }
+
+  task_available_.notify_all();
+
+  return true;
+}
+
+size_t PngExporter::pending_images() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  return pending_images_;
+}
+
+void PngExporter::work() {
+  while (true) {
+    Task task;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+
+      // queued exports are still written when quitting
+      task_available_.wait(lock, [this]() { return quit_ || !tasks_.empty(); });
+
+      if (tasks_.empty()) {
+        return;
+      }
+
+      task = tasks_.front();
+      tasks_.pop_front();
+    }
+
+    Export& image_export = *task.image_export;
+    Image& image = image_export.images[task.image_index];
+
+    bool error_occurred = false;
+
+    try {
+      PngSaver::save(image.frame.get(), image.file_name);
+    } catch (const PngSaver::IOException& e) {
+      std::cerr << "Error saving video PNG image to file: " << image.file_name << std::endl;
+      error_occurred = true;
+    } catch (const std::runtime_error& e) {
+      std::cerr << "Unexpected while error saving PNG: " << e.what() << std::endl;
+      error_occurred = true;
+    }
+
+    // written, so the frame is no longer needed
+    image.frame.reset();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    image_export.error_occurred = image_export.error_occurred || error_occurred;
+    pending_images_--;
+
+    if (--image_export.remaining == 0) {
+      finish(image_export);
+      pending_exports_--;
+    }
+  }
+}
+
+void PngExporter::finish(Export& image_export) {
+  if (image_export.error_occurred) {
+    return;
+  }
+
+  std::string file_names;
+
+  for (size_t i = 0; i < image_export.images.size(); i++) {
+    if (i > 0) {
+      file_names += (i + 1 == image_export.images.size()) ? " and " : ", ";
+    }
+    file_names += image_export.images[i].file_name;
+  }
+
+  std::cout << "Saved " << file_names << std::endl;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Writes sets of PNG images on background threads, so saving does not hold up rendering. The images of an export
+// are encoded in parallel, and each frame is kept alive by its reference until written. At most a fixed number of
+// exports can be pending; further ones are refused instead of blocking the caller.
+class PngExporter {
+ public:
+  struct Image {
+    std::shared_ptr<AVFrame> frame;
+    std::string file_name;
+  };
+
+  PngExporter(const size_t max_pending_exports, const size_t threads);
+
+  // pending exports are completed first
+  ~PngExporter();
+
+  // the frame is referenced, or copied where it is not reference counted
+  static std::shared_ptr<AVFrame> reference(const AVFrame* frame);
+
+  // the images are reported as saved once all are written; returns false if too many exports are pending
+  bool submit(const std::vector<Image>& images);
+
+  // images queued or being written
+  size_t pending_images() const;
+
+ private:
+  struct Export {
+    std::vector<Image> images;
+    size_t remaining;
+    bool error_occurred{false};
+  };
+
+  struct Task {
+    std::shared_ptr<Export> image_export;
+    size_t image_index;
+  };
+
+  void work();
+  void finish(Export& image_export);
+
+  const size_t max_pending_exports_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable task_available_;
+  std::deque<Task> tasks_;
+  size_t pending_exports_{0};
+  size_t pending_images_{0};
+  bool quit_{false};
+
+  std::vector<std::thread> workers_;
+};
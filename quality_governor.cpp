@@ -0,0 +1,55 @@
+#include "quality_governor.h"
+
+static constexpr float BEHIND_FPS_RATIO = 0.95F;
+static constexpr float HEADROOM_FPS_RATIO = 0.99F;
+static constexpr float HEADROOM_QUEUE_FILL = 0.6F;
+static constexpr float HEADROOM_REFRESH_LOAD = 0.5F;
+
+// restoring quality is deliberately slower than degrading it, to avoid oscillating between two levels
+static constexpr int HEADROOM_UPDATES_BEFORE_RESTORE = 3;
+
+bool QualityGovernor::update(const float achieved_fps, const float target_fps, const float queue_fill, const float refresh_load) {
+  if (target_fps <= 0.0F) {
+    return false;
+  }
+
+  if (achieved_fps < target_fps * BEHIND_FPS_RATIO) {
+    headroom_streak_ = 0;
+
+    if (level_ < DROP_NON_REFERENCE_FRAMES) {
+      level_ = static_cast<Level>(level_ + 1);
+      return true;
+    }
+  } else if (achieved_fps >= target_fps * HEADROOM_FPS_RATIO && queue_fill >= HEADROOM_QUEUE_FILL && refresh_load <= HEADROOM_REFRESH_LOAD) {
+    if (level_ > FULL_QUALITY && ++headroom_streak_ >= HEADROOM_UPDATES_BEFORE_RESTORE) {
+      headroom_streak_ = 0;
+      level_ = static_cast<Level>(level_ - 1);
+      return true;
+    }
+  } else {
+    headroom_streak_ = 0;
+  }
+
+  return false;
+}
+
+QualityGovernor::Level QualityGovernor::level() const {
+  return level_;
+}
+
+std::string QualityGovernor::describe(const Level level) {
+  switch (level) {
+    case FULL_QUALITY:
+      return "full quality";
+    case FAST_SCALING:
+      return "fast scaling";
+    case FIXED_DIFF_SCALE:
+      return "fixed difference scale";
+    case REDUCED_DIFF_RESOLUTION:
+      return "reduced difference resolution";
+    case DROP_NON_REFERENCE_FRAMES:
+      return "dropping non-reference frames";
+  }
+
+  return "unknown";
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+
+// Sheds rendering and decoding work step by step while playback cannot keep up with the target frame rate,
+// and restores it again once there is consistent headroom.
+class QualityGovernor {
+ public:
+  enum Level { FULL_QUALITY, FAST_SCALING, FIXED_DIFF_SCALE, REDUCED_DIFF_RESOLUTION, DROP_NON_REFERENCE_FRAMES };
+
+  // achieved and target are in frames per second, queue_fill is the average converted frame queue occupancy in [0, 1],
+  // and refresh_load is the average display refresh time relative to the target frame interval; returns true on a level change
+  bool update(const float achieved_fps, const float target_fps, const float queue_fill, const float refresh_load);
+
+  Level level() const;
+
+  static std::string describe(const Level level);
+
+ private:
+  Level level_{FULL_QUALITY};
+
+  // number of consecutive updates with headroom
+  int headroom_streak_{0};
+};
@@ -24,6 +24,7 @@ class Queue {
 
  public:
   explicit Queue(size_t size_max);
+  virtual ~Queue() = default;
 
   bool push(T&& data);
   bool push(const T& data);
@@ -41,6 +42,13 @@ class Queue {
   void empty();
   int size();
 
+ protected:
+  // Hooks for queues bounded by more than the element count, called with the mutex held
+  virtual bool is_full() const { return queue_.size() >= size_max_; }
+  virtual void on_pushed(const T&) {}
+  virtual void on_popped(const T&) {}
+  virtual void on_emptied() {}
+
  private:
   template <typename U>
   bool push_impl(U&& data);
@@ -67,8 +75,9 @@ bool Queue<T>::push_impl(U&& data) {
   std::unique_lock<std::mutex> lock(mutex_);
 
   while (!quit_ && !stopped_) {
-    if (queue_.size() < size_max_) {
+    if (!is_full()) {
       queue_.push(std::forward<U>(data));
+      on_pushed(queue_.back());
 
       empty_.notify_all();
       return true;
@@ -85,6 +94,7 @@ bool Queue<T>::pop(T& data) {
 
   while (!quit_) {
     if (!queue_.empty()) {
+      on_popped(queue_.front());
       data = std::move(queue_.front());
       queue_.pop();
 
@@ -148,6 +158,7 @@ void Queue<T>::empty() {
   while (!queue_.empty()) {
     queue_.pop();
   }
+  on_emptied();
 
   full_.notify_all();
 }
@@ -0,0 +1,304 @@
+#include "tone_map_lut.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include "ffmpeg.h"
+#include "string_utils.h"
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/pixdesc.h>
+}
+
+static constexpr int DEVIATION_SAMPLES_PER_AXIS = 16;
+static constexpr float MAX_CODE_VALUE = 65535.0F;
+
+using AVFilterGraphUniquePtr = std::unique_ptr<AVFilterGraph, std::function<void(AVFilterGraph*)>>;
+using AVFrameUniquePtr = std::unique_ptr<AVFrame, std::function<void(AVFrame*)>>;
+
+std::shared_ptr<const ToneMapLut> ToneMapLut::get(const std::string& color_primaries, const std::string& color_trc, const std::string& tone_mapping_filters) {
+  static std::mutex cache_mutex;
+  static std::map<std::string, std::shared_ptr<const ToneMapLut>> cache;
+
+  const std::string key = color_primaries + "|" + color_trc + "|" + tone_mapping_filters;
+
+  // baking holds the lock so that both sides requesting the same LUT only bake it once
+  std::lock_guard<std::mutex> lock(cache_mutex);
+
+  auto it = cache.find(key);
+
+  if (it == cache.end()) {
+    it = cache.emplace(key, std::shared_ptr<const ToneMapLut>(new ToneMapLut(color_primaries, color_trc, tone_mapping_filters))).first;
+  }
+
+  return it->second;
+}
+
+ToneMapLut::ToneMapLut(const std::string& color_primaries, const std::string& color_trc, const std::string& tone_mapping_filters)
+    : color_primaries_(color_primaries), color_trc_(color_trc), tone_mapping_filters_(tone_mapping_filters) {
+  const int nodes = LATTICE_SIZE * LATTICE_SIZE * LATTICE_SIZE;
+
+  std::vector<float> rgb_samples(nodes * 3);
+
+  for (int r = 0, i = 0; r < LATTICE_SIZE; r++) {
+    for (int g = 0; g < LATTICE_SIZE; g++) {
+      for (int b = 0; b < LATTICE_SIZE; b++, i += 3) {
+        rgb_samples[i] = static_cast<float>(r) / (LATTICE_SIZE - 1);
+        rgb_samples[i + 1] = static_cast<float>(g) / (LATTICE_SIZE - 1);
+        rgb_samples[i + 2] = static_cast<float>(b) / (LATTICE_SIZE - 1);
+      }
+    }
+  }
+
+  const std::vector<float> mapped = run_filter_chain(rgb_samples, LATTICE_SIZE * LATTICE_SIZE, LATTICE_SIZE);
+
+  lattice_.resize(mapped.size());
+
+  std::transform(mapped.begin(), mapped.end(), lattice_.begin(), [](const float value) { return static_cast<uint16_t>(std::lrint(std::min(std::max(value, 0.0F), 1.0F) * MAX_CODE_VALUE)); });
+}
+
+std::vector<float> ToneMapLut::run_filter_chain(const std::vector<float>& rgb_samples, const int width, const int height) const {
+  const AVFilter* buffersrc = avfilter_get_by_name("buffer");
+  const AVFilter* buffersink = avfilter_get_by_name("buffersink");
+
+  AVFilterGraphUniquePtr filter_graph(avfilter_graph_alloc(), [](AVFilterGraph* graph) { avfilter_graph_free(&graph); });
+
+  if (!filter_graph) {
+    throw std::runtime_error("Failed to allocate filter graph");
+  }
+
+  const std::string args =
+#if (LIBAVFILTER_VERSION_INT < AV_VERSION_INT(10, 1, 100))
+      string_sprintf("video_size=%dx%d:pix_fmt=%d:time_base=1/25:pixel_aspect=1/1", width, height, AV_PIX_FMT_GBRPF32);
+#else
+      string_sprintf("video_size=%dx%d:pix_fmt=%d:time_base=1/25:pixel_aspect=1/1:colorspace=%d:range=%d", width, height, AV_PIX_FMT_GBRPF32, AVCOL_SPC_RGB, AVCOL_RANGE_JPEG);
+#endif
+
+  AVFilterContext* buffersrc_ctx;
+  AVFilterContext* buffersink_ctx;
+
+  if (avfilter_graph_create_filter(&buffersrc_ctx, buffersrc, "in", args.c_str(), nullptr, filter_graph.get()) < 0) {
+    throw ffmpeg::Error{"Cannot create buffer source for tone-mapping LUT"};
+  }
+  if (avfilter_graph_create_filter(&buffersink_ctx, buffersink, "out", nullptr, nullptr, filter_graph.get()) < 0) {
+    throw ffmpeg::Error{"Cannot create buffer sink for tone-mapping LUT"};
+  }
+
+  // the samples are non-linear RGB carrying the colorimetry of the filtered input
+  std::vector<std::string> setparams_options{"colorspace=gbr", "range=pc"};
+
+  if (!color_primaries_.empty()) {
+    setparams_options.push_back("color_primaries=" + color_primaries_);
+  }
+  if (!color_trc_.empty()) {
+    setparams_options.push_back("color_trc=" + color_trc_);
+  }
+
+  const std::string filters = string_sprintf("setparams=%s,%s,format=%s", string_join(setparams_options, ":").c_str(), tone_mapping_filters_.c_str(), av_get_pix_fmt_name(AV_PIX_FMT_GBRPF32));
+
+  AVFilterInOut* outputs = avfilter_inout_alloc();
+  AVFilterInOut* inputs = avfilter_inout_alloc();
+
+  int ret = AVERROR(ENOMEM);
+
+  if ((outputs != nullptr) && (inputs != nullptr)) {
+    outputs->name = av_strdup("in");
+    outputs->filter_ctx = buffersrc_ctx;
+    outputs->pad_idx = 0;
+    outputs->next = nullptr;
+
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = buffersink_ctx;
+    inputs->pad_idx = 0;
+    inputs->next = nullptr;
+
+    if ((ret = avfilter_graph_parse_ptr(filter_graph.get(), filters.c_str(), &inputs, &outputs, nullptr)) >= 0) {
+      ret = avfilter_graph_config(filter_graph.get(), nullptr);
+    }
+  }
+
+  avfilter_inout_free(&inputs);
+  avfilter_inout_free(&outputs);
+
+  ffmpeg::check(ret);
+
+  AVFrameUniquePtr frame(av_frame_alloc(), [](AVFrame* frame) { av_frame_free(&frame); });
+
+  frame->format = AV_PIX_FMT_GBRPF32;
+  frame->width = width;
+  frame->height = height;
+  frame->colorspace = AVCOL_SPC_RGB;
+  frame->color_range = AVCOL_RANGE_JPEG;
+  frame->pts = 0;
+
+  ffmpeg::check(av_frame_get_buffer(frame.get(), 0));
+
+  // GBRP plane order
+  for (int y = 0, i = 0; y < height; y++) {
+    float* g = reinterpret_cast<float*>(frame->data[0] + y * frame->linesize[0]);
+    float* b = reinterpret_cast<float*>(frame->data[1] + y * frame->linesize[1]);
+    float* r = reinterpret_cast<float*>(frame->data[2] + y * frame->linesize[2]);
+
+    for (int x = 0; x < width; x++, i += 3) {
+      r[x] = rgb_samples[i];
+      g[x] = rgb_samples[i + 1];
+      b[x] = rgb_samples[i + 2];
+    }
+  }
+
+  ffmpeg::check(av_buffersrc_add_frame(buffersrc_ctx, frame.get()));
+  ffmpeg::check(av_buffersrc_close(buffersrc_ctx, 1, AV_BUFFERSRC_FLAG_PUSH));
+  ffmpeg::check(av_buffersink_get_frame(buffersink_ctx, frame.get()));
+
+  if (frame->width != width || frame->height != height || frame->format != AV_PIX_FMT_GBRPF32) {
+    throw ffmpeg::Error{"Unexpected frame returned by tone-mapping filter chain"};
+  }
+
+  std::vector<float> result(rgb_samples.size());
+
+  for (int y = 0, i = 0; y < height; y++) {
+    const float* g = reinterpret_cast<const float*>(frame->data[0] + y * frame->linesize[0]);
+    const float* b = reinterpret_cast<const float*>(frame->data[1] + y * frame->linesize[1]);
+    const float* r = reinterpret_cast<const float*>(frame->data[2] + y * frame->linesize[2]);
+
+    for (int x = 0; x < width; x++, i += 3) {
+      result[i] = r[x];
+      result[i + 1] = g[x];
+      result[i + 2] = b[x];
+    }
+  }
+
+  return result;
+}
+
+// maps [0, 65535] to a lattice cell index and a 16-bit fraction within the cell (up to and including 1.0)
+static inline void locate_in_lattice(const uint16_t value, int& index, int64_t& fraction) {
+  const int64_t position = (static_cast<int64_t>(value) * (ToneMapLut::LATTICE_SIZE - 1) * 65537) >> 16;
+
+  index = std::min(static_cast<int>(position >> 16), ToneMapLut::LATTICE_SIZE - 2);
+  fraction = position - (static_cast<int64_t>(index) << 16);
+}
+
+void ToneMapLut::interpolate(const uint16_t r, const uint16_t g, const uint16_t b, uint16_t& out_r, uint16_t& out_g, uint16_t& out_b) const {
+  static constexpr int STRIDE_B = 3;
+  static constexpr int STRIDE_G = STRIDE_B * LATTICE_SIZE;
+  static constexpr int STRIDE_R = STRIDE_G * LATTICE_SIZE;
+
+  int ir, ig, ib;
+  int64_t fr, fg, fb;
+
+  locate_in_lattice(r, ir, fr);
+  locate_in_lattice(g, ig, fg);
+  locate_in_lattice(b, ib, fb);
+
+  // pick the tetrahedron containing the point by ordering the fractions; the walk from the
+  // origin to the opposite corner of the cell visits the axes in descending fraction order
+  int step1, step2;
+  int64_t f1, f2, f3;
+
+  if (fr >= fg) {
+    if (fg >= fb) {
+      step1 = STRIDE_R, step2 = STRIDE_R + STRIDE_G, f1 = fr, f2 = fg, f3 = fb;
+    } else if (fr >= fb) {
+      step1 = STRIDE_R, step2 = STRIDE_R + STRIDE_B, f1 = fr, f2 = fb, f3 = fg;
+    } else {
+      step1 = STRIDE_B, step2 = STRIDE_B + STRIDE_R, f1 = fb, f2 = fr, f3 = fg;
+    }
+  } else {
+    if (fb >= fg) {
+      step1 = STRIDE_B, step2 = STRIDE_B + STRIDE_G, f1 = fb, f2 = fg, f3 = fr;
+    } else if (fb >= fr) {
+      step1 = STRIDE_G, step2 = STRIDE_G + STRIDE_B, f1 = fg, f2 = fb, f3 = fr;
+    } else {
+      step1 = STRIDE_G, step2 = STRIDE_G + STRIDE_R, f1 = fg, f2 = fr, f3 = fb;
+    }
+  }
+
+  const uint16_t* c0 = lattice_.data() + ir * STRIDE_R + ig * STRIDE_G + ib * STRIDE_B;
+  const uint16_t* c1 = c0 + step1;
+  const uint16_t* c2 = c0 + step2;
+  const uint16_t* c3 = c0 + STRIDE_R + STRIDE_G + STRIDE_B;
+
+  auto blend = [&](const int channel) -> uint16_t {
+    const int64_t v0 = c0[channel], v1 = c1[channel], v2 = c2[channel], v3 = c3[channel];
+    const int64_t value = (v0 << 16) + f1 * (v1 - v0) + f2 * (v2 - v1) + f3 * (v3 - v2);
+
+    return static_cast<uint16_t>(std::min(std::max((value + 32768) >> 16, int64_t(0)), int64_t(65535)));
+  };
+
+  out_r = blend(0);
+  out_g = blend(1);
+  out_b = blend(2);
+}
+
+void ToneMapLut::apply(AVFrame* frame, const RowWorkers& row_workers) const {
+  if (frame->format != AV_PIX_FMT_GBRP16) {
+    throw ffmpeg::Error{string_sprintf("Tone-mapping LUT cannot be applied to pixel format %s", av_get_pix_fmt_name(static_cast<AVPixelFormat>(frame->format)))};
+  }
+
+  ffmpeg::check(av_frame_make_writable(frame));
+
+  const int width = frame->width;
+
+  auto process_rows = [&](const int start_row, const int end_row) {
+    for (int y = start_row; y < end_row; y++) {
+      uint16_t* g = reinterpret_cast<uint16_t*>(frame->data[0] + y * frame->linesize[0]);
+      uint16_t* b = reinterpret_cast<uint16_t*>(frame->data[1] + y * frame->linesize[1]);
+      uint16_t* r = reinterpret_cast<uint16_t*>(frame->data[2] + y * frame->linesize[2]);
+
+      for (int x = 0; x < width; x++) {
+        interpolate(r[x], g[x], b[x], r[x], g[x], b[x]);
+      }
+    }
+  };
+
+  row_workers.run_dynamic(frame->height, process_rows, suggest_block_rows_by_bytes(width, frame->height, sizeof(uint16_t)));
+}
+
+ToneMapLut::Deviation ToneMapLut::measure_deviation() const {
+  const int samples = DEVIATION_SAMPLES_PER_AXIS * DEVIATION_SAMPLES_PER_AXIS * DEVIATION_SAMPLES_PER_AXIS;
+
+  // sample at cell centers of a coarser grid, which never coincide with the lattice nodes
+  std::vector<uint16_t> quantized(samples * 3);
+
+  for (int r = 0, i = 0; r < DEVIATION_SAMPLES_PER_AXIS; r++) {
+    for (int g = 0; g < DEVIATION_SAMPLES_PER_AXIS; g++) {
+      for (int b = 0; b < DEVIATION_SAMPLES_PER_AXIS; b++, i += 3) {
+        quantized[i] = static_cast<uint16_t>(std::lrint((r + 0.5F) / DEVIATION_SAMPLES_PER_AXIS * MAX_CODE_VALUE));
+        quantized[i + 1] = static_cast<uint16_t>(std::lrint((g + 0.5F) / DEVIATION_SAMPLES_PER_AXIS * MAX_CODE_VALUE));
+        quantized[i + 2] = static_cast<uint16_t>(std::lrint((b + 0.5F) / DEVIATION_SAMPLES_PER_AXIS * MAX_CODE_VALUE));
+      }
+    }
+  }
+
+  std::vector<float> rgb_samples(quantized.size());
+
+  std::transform(quantized.begin(), quantized.end(), rgb_samples.begin(), [](const uint16_t value) { return value / MAX_CODE_VALUE; });
+
+  const std::vector<float> reference = run_filter_chain(rgb_samples, DEVIATION_SAMPLES_PER_AXIS * DEVIATION_SAMPLES_PER_AXIS, DEVIATION_SAMPLES_PER_AXIS);
+
+  Deviation deviation{0.0F, 0.0F};
+  double sum = 0.0;
+
+  for (size_t i = 0; i < quantized.size(); i += 3) {
+    uint16_t out[3];
+
+    interpolate(quantized[i], quantized[i + 1], quantized[i + 2], out[0], out[1], out[2]);
+
+    for (int c = 0; c < 3; c++) {
+      const float expected = std::min(std::max(reference[i + c], 0.0F), 1.0F) * MAX_CODE_VALUE;
+      const float error = std::fabs(out[c] - expected);
+
+      deviation.max = std::max(deviation.max, error);
+      sum += error;
+    }
+  }
+
+  deviation.mean = static_cast<float>(sum / quantized.size());
+
+  return deviation;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "row_workers.h"
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Tone-mapping chain (zscale/tonemap/zscale) baked into a 3D LUT which is applied to planar 16-bit RGB
+// frames using integer tetrahedral interpolation. LUTs are cached per input colorimetry and chain, so
+// each (peak nits, boost, mode) combination is only baked once.
+class ToneMapLut {
+ public:
+  static constexpr int LATTICE_SIZE = 65;
+
+  struct Deviation {
+    float max;   // in 16-bit code values
+    float mean;  // in 16-bit code values
+  };
+
+  static std::shared_ptr<const ToneMapLut> get(const std::string& color_primaries, const std::string& color_trc, const std::string& tone_mapping_filters);
+
+  // the frame must be in the native-endian GBRP16 pixel format
+  void apply(AVFrame* frame, const RowWorkers& row_workers) const;
+
+  // compares against running the filter chain per pixel at points in-between the lattice nodes
+  Deviation measure_deviation() const;
+
+ private:
+  ToneMapLut(const std::string& color_primaries, const std::string& color_trc, const std::string& tone_mapping_filters);
+
+  void interpolate(const uint16_t r, const uint16_t g, const uint16_t b, uint16_t& out_r, uint16_t& out_g, uint16_t& out_b) const;
+
+  // runs interleaved, normalized RGB samples through the filter chain and returns the result in the same layout
+  std::vector<float> run_filter_chain(const std::vector<float>& rgb_samples, const int width, const int height) const;
+
+ private:
+  const std::string color_primaries_;
+  const std::string color_trc_;
+  const std::string tone_mapping_filters_;
+
+  // interleaved RGB nodes, indexed by ((r * LATTICE_SIZE + g) * LATTICE_SIZE + b) * 3
+  std::vector<uint16_t> lattice_;
+};
@@ -2,9 +2,11 @@
 #include <algorithm>
 #include <chrono>
 #include <deque>
+#include <future>
 #include <iostream>
 #include <thread>
 #include "ffmpeg.h"
+#include "quality_governor.h"
 #include "side_aware_logger.h"
 #include "sorted_flat_deque.h"
 #include "string_utils.h"
@@ -21,6 +23,15 @@ static constexpr uint32_t SLEEP_PERIOD_MS = 10;
 static constexpr uint32_t ONE_SECOND_US = 1000 * 1000;
 static constexpr uint32_t RESYNC_UPDATE_RATE_US = ONE_SECOND_US / 10;
 static constexpr uint32_t NOMINAL_FPS_UPDATE_RATE_US = 1 * ONE_SECOND_US;
+static constexpr uint32_t REFINEMENT_IDLE_DELAY_US = ONE_SECOND_US / 4;
+static constexpr int STILL_IMAGE_INPUT_TIMEOUT_MS = 500;
+
+// the most recent full-size buffered frames which keep their source for re-conversion at full quality, bounding the memory taken
+static constexpr size_t MAX_BUFFERED_SOURCE_FRAMES = 8;
+
+// playback speeds at which the decoders start skipping non-reference frames and all but keyframes, respectively
+static constexpr float SKIP_NON_REFERENCE_FRAMES_SPEED = 4.0F;
+static constexpr float SKIP_NON_KEY_FRAMES_SPEED = 16.0F;
 
 static auto avpacket_deleter = [](AVPacket* packet) {
   av_packet_unref(packet);
@@ -29,11 +40,6 @@ static auto avpacket_deleter = [](AVPacket* packet) {
 
 static auto avframe_deleter = [](AVFrame* frame) { av_frame_free(&frame); };
 
-static auto avframe_and_data_deleter = [](AVFrame* frame) {
-  av_freep(&frame->data[0]);
-  avframe_deleter(frame);
-};
-
 static inline bool is_behind(int64_t frame1_pts, int64_t frame2_pts, int64_t delta_pts) {
   const float t1 = static_cast<float>(frame1_pts) * AV_TIME_TO_SEC;
   const float t2 = static_cast<float>(frame2_pts) * AV_TIME_TO_SEC;
@@ -105,6 +111,12 @@ static inline int determine_sws_flags(const bool fast) {
   return fast ? SWS_FAST_BILINEAR : (SWS_BICUBIC | SWS_FULL_CHR_H_INT | SWS_ACCURATE_RND);
 }
 
+static inline int get_sws_flags(const AVFrame* frame) {
+  const AVDictionaryEntry* entry = av_dict_get(frame->metadata, "sws_flags", nullptr, 0);
+
+  return entry != nullptr ? std::atoi(entry->value) : 0;
+}
+
 static inline bool use_fast_input_alignment(const VideoCompareConfig& config) {
   return config.fast_input_alignment;
 }
@@ -114,48 +126,81 @@ static void sleep_for_ms(const uint32_t ms) {
   std::this_thread::sleep_for(sleep);
 }
 
+// creates the right side on a separate thread while the left side is created on the calling one
+template <class T>
+static std::array<std::unique_ptr<T>, Side::Count> create_per_side_in_parallel(const std::function<std::unique_ptr<T>(const Side)>& create) {
+  auto right_future = std::async(std::launch::async, create, RIGHT);
+  auto left = create(LEFT);
+
+  return {std::move(left), right_future.get()};
+}
+
+template <class F>
+static auto time_startup_phase(std::vector<std::pair<std::string, int64_t>>& startup_timings, const std::string& phase, F&& create) -> decltype(create()) {
+  const auto start_time = std::chrono::steady_clock::now();
+  auto result = create();
+
+  startup_timings.emplace_back(phase, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count());
+
+  return result;
+}
+
 VideoCompare::VideoCompare(const VideoCompareConfig& config)
     : same_decoded_video_both_sides_(produces_same_decoded_video(config)),
       auto_loop_mode_(config.auto_loop_mode),
       frame_buffer_size_(config.frame_buffer_size),
       time_shift_(config.time_shift),
       time_shift_offset_av_time_(time_ms_to_av_time(static_cast<double>(config.time_shift.offset_ms))),
-      demuxers_{std::make_unique<Demuxer>(LEFT, config.left.demuxer, config.left.file_name, config.left.demuxer_options, config.left.decoder_options),
-                std::make_unique<Demuxer>(RIGHT, config.right.demuxer, config.right.file_name, config.right.demuxer_options, config.right.decoder_options)},
-      video_decoders_{
-          std::make_unique<VideoDecoder>(LEFT, config.left.decoder, config.left.hw_accel_spec, demuxers_[LEFT]->video_codec_parameters(), config.left.peak_luminance_nits, config.left.hw_accel_options, config.left.decoder_options),
-          std::make_unique<VideoDecoder>(RIGHT, config.right.decoder, config.right.hw_accel_spec, demuxers_[RIGHT]->video_codec_parameters(), config.right.peak_luminance_nits, config.right.hw_accel_options, config.right.decoder_options)},
-      video_filterers_{std::make_unique<VideoFilterer>(LEFT,
-                                                       demuxers_[LEFT].get(),
-                                                       video_decoders_[LEFT].get(),
-                                                       config.left.tone_mapping_mode,
-                                                       config.left.boost_tone,
-                                                       config.left.video_filters,
-                                                       config.left.color_space,
-                                                       config.left.color_range,
-                                                       config.left.color_primaries,
-                                                       config.left.color_trc,
-                                                       demuxers_[RIGHT].get(),
-                                                       video_decoders_[RIGHT].get(),
-                                                       config.right.color_trc,
-                                                       config.disable_auto_filters),
-                       std::make_unique<VideoFilterer>(RIGHT,
-                                                       demuxers_[RIGHT].get(),
-                                                       video_decoders_[RIGHT].get(),
-                                                       config.right.tone_mapping_mode,
-                                                       config.right.boost_tone,
-                                                       config.right.video_filters,
-                                                       config.right.color_space,
-                                                       config.right.color_range,
-                                                       config.right.color_primaries,
-                                                       config.right.color_trc,
-                                                       demuxers_[LEFT].get(),
-                                                       video_decoders_[LEFT].get(),
-                                                       config.left.color_trc,
-                                                       config.disable_auto_filters)},
+      verbose_(config.verbose),
+      construction_start_time_(std::chrono::steady_clock::now()),
+      demuxers_{time_startup_phase(startup_timings_,
+                                   "open inputs",
+                                   [&]() {
+                                     return create_per_side_in_parallel<Demuxer>([&](const Side side) {
+                                       const InputVideo& input = side == LEFT ? config.left : config.right;
+
+                                       return std::make_unique<Demuxer>(side, input.demuxer, input.file_name, input.demuxer_options, input.decoder_options, config.read_ahead_size, config.memory_mapped_input, config.verbose);
+                                     });
+                                   })},
+      video_decoders_{time_startup_phase(startup_timings_,
+                                         "open decoders",
+                                         [&]() {
+                                           return create_per_side_in_parallel<VideoDecoder>([&](const Side side) {
+                                             const InputVideo& input = side == LEFT ? config.left : config.right;
+
+                                             return std::make_unique<VideoDecoder>(side, input.decoder, input.hw_accel_spec, demuxers_[side]->video_codec_parameters(), input.peak_luminance_nits, input.hw_accel_options, input.decoder_options);
+                                           });
+                                         })},
+      video_filterers_{time_startup_phase(startup_timings_,
+                                          "build filter graphs",
+                                          [&]() {
+                                            return create_per_side_in_parallel<VideoFilterer>([&](const Side side) {
+                                              const Side other_side = side == LEFT ? RIGHT : LEFT;
+                                              const InputVideo& input = side == LEFT ? config.left : config.right;
+                                              const InputVideo& other_input = side == LEFT ? config.right : config.left;
+
+                                              return std::make_unique<VideoFilterer>(side,
+                                                                                     demuxers_[side].get(),
+                                                                                     video_decoders_[side].get(),
+                                                                                     input.tone_mapping_mode,
+                                                                                     input.boost_tone,
+                                                                                     input.video_filters,
+                                                                                     input.color_space,
+                                                                                     input.color_range,
+                                                                                     input.color_primaries,
+                                                                                     input.color_trc,
+                                                                                     demuxers_[other_side].get(),
+                                                                                     video_decoders_[other_side].get(),
+                                                                                     other_input.color_trc,
+                                                                                     config.disable_auto_filters,
+                                                                                     config.tone_map_lut,
+                                                                                     config.verbose);
+                                            });
+                                          })},
       max_width_{std::max(video_filterers_[LEFT]->dest_width(), video_filterers_[RIGHT]->dest_width())},
       max_height_{std::max(video_filterers_[LEFT]->dest_height(), video_filterers_[RIGHT]->dest_height())},
       initial_fast_input_alignment_{use_fast_input_alignment(config)},
+      adaptive_resolution_{config.adaptive_resolution},
       shortest_duration_{std::min(demuxers_[LEFT]->duration(), demuxers_[RIGHT]->duration()) * AV_TIME_TO_SEC},
       format_converters_{std::make_unique<FormatConverter>(video_filterers_[LEFT]->dest_width(),
                                                            video_filterers_[LEFT]->dest_height(),
@@ -177,23 +222,50 @@ VideoCompare::VideoCompare(const VideoCompareConfig& config)
                                                            video_decoders_[RIGHT]->color_range(),
                                                            RIGHT,
                                                            determine_sws_flags(initial_fast_input_alignment_))},
-      display_{std::make_unique<Display>(config.display_number,
-                                         config.display_mode,
-                                         config.verbose,
-                                         config.fit_window_to_usable_bounds,
-                                         config.high_dpi_allowed,
-                                         config.use_10_bpc,
-                                         initial_fast_input_alignment_,
-                                         config.bilinear_texture_filtering,
-                                         config.window_size,
-                                         max_width_,
-                                         max_height_,
-                                         shortest_duration_,
-                                         config.wheel_sensitivity,
-                                         config.left.file_name,
-                                         config.right.file_name)},
+      full_resolution_format_converters_{adaptive_resolution_ ? std::make_unique<FormatConverter>(video_filterers_[LEFT]->dest_width(),
+                                                                                                 video_filterers_[LEFT]->dest_height(),
+                                                                                                 max_width_,
+                                                                                                 max_height_,
+                                                                                                 video_filterers_[LEFT]->dest_pixel_format(),
+                                                                                                 determine_pixel_format(config),
+                                                                                                 video_decoders_[LEFT]->color_space(),
+                                                                                                 video_decoders_[LEFT]->color_range(),
+                                                                                                 LEFT,
+                                                                                                 determine_sws_flags(false))
+                                                              : nullptr,
+                                         adaptive_resolution_ ? std::make_unique<FormatConverter>(video_filterers_[RIGHT]->dest_width(),
+                                                                                                 video_filterers_[RIGHT]->dest_height(),
+                                                                                                 max_width_,
+                                                                                                 max_height_,
+                                                                                                 video_filterers_[RIGHT]->dest_pixel_format(),
+                                                                                                 determine_pixel_format(config),
+                                                                                                 video_decoders_[RIGHT]->color_space(),
+                                                                                                 video_decoders_[RIGHT]->color_range(),
+                                                                                                 RIGHT,
+                                                                                                 determine_sws_flags(false))
+                                                              : nullptr},
+      display_{time_startup_phase(startup_timings_,
+                                  "create display",
+                                  [&]() {
+                                    return std::make_unique<Display>(config.display_number,
+                                                                     config.display_mode,
+                                                                     config.verbose,
+                                                                     config.fit_window_to_usable_bounds,
+                                                                     config.high_dpi_allowed,
+                                                                     config.use_10_bpc,
+                                                                     initial_fast_input_alignment_,
+                                                                     config.bilinear_texture_filtering,
+                                                                     config.window_size,
+                                                                     max_width_,
+                                                                     max_height_,
+                                                                     shortest_duration_,
+                                                                     config.wheel_sensitivity,
+                                                                     config.left.file_name,
+                                                                     config.right.file_name);
+                                  })},
       timer_{std::make_unique<Timer>()},
-      packet_queues_{std::make_unique<PacketQueue>(QUEUE_SIZE), std::make_unique<PacketQueue>(QUEUE_SIZE)},
+      packet_queues_{std::make_unique<PacketQueue>(demuxers_[LEFT]->bit_rate(), demuxers_[LEFT]->guess_frame_rate(), demuxers_[LEFT]->time_base()),
+                     std::make_unique<PacketQueue>(demuxers_[RIGHT]->bit_rate(), demuxers_[RIGHT]->guess_frame_rate(), demuxers_[RIGHT]->time_base())},
       decoded_frame_queues_{std::make_unique<DecodedFrameQueue>(QUEUE_SIZE), std::make_unique<DecodedFrameQueue>(QUEUE_SIZE)},
       filtered_frame_queues_{std::make_unique<FrameQueue>(QUEUE_SIZE), std::make_unique<FrameQueue>(QUEUE_SIZE)},
       converted_frame_queues_{std::make_unique<FrameQueue>(QUEUE_SIZE), std::make_unique<FrameQueue>(QUEUE_SIZE)} {
@@ -233,6 +305,56 @@ VideoCompare::VideoCompare(const VideoCompareConfig& config)
   dump_video_info(LEFT, config.left.file_name.c_str());
   dump_video_info(RIGHT, config.right.file_name.c_str());
 
+  auto create_image_sequence_decoder = [&](const Side side) {
+    if (config.sequence_lookahead == 0 || !demuxers_[side]->is_image_sequence() || video_decoders_[side]->is_hw_accelerated()) {
+      return;
+    }
+
+    // leave half of the cores to the other side
+    const size_t worker_count = std::max(std::thread::hardware_concurrency() / 2, 1U);
+    const size_t lookahead = config.sequence_lookahead > 0 ? static_cast<size_t>(config.sequence_lookahead) : worker_count * 2;
+
+    image_sequence_decoders_[side] = std::make_unique<ImageSequenceDecoder>(side, video_decoders_[side]->codec(), demuxers_[side]->video_codec_parameters(), worker_count, lookahead);
+
+    if (config.verbose) {
+      sa_log_info(side, string_sprintf("Image sequence: decoding up to %zu images ahead on %zu workers", lookahead, worker_count));
+    }
+  };
+
+  create_image_sequence_decoder(LEFT);
+  create_image_sequence_decoder(RIGHT);
+
+  if (!config.metrics_database_file_name.empty()) {
+    metrics_database_ = MetricsDatabase::open(config.metrics_database_file_name);
+
+    const uint64_t metrics_context = MetricsDatabase::context(config.left.file_name, config.right.file_name, config.time_shift.multiplier, config.time_shift.offset_ms, video_filterers_[LEFT]->filter_description(),
+                                                              video_filterers_[RIGHT]->filter_description());
+    display_->set_metrics_database(metrics_database_.get(), metrics_context);
+
+    if (config.verbose) {
+      sa_log_info(NONE, string_sprintf("Metrics database: %zu cached scores in %s", metrics_database_->size(), config.metrics_database_file_name.c_str()));
+    }
+  }
+
+  if (config.verbose) {
+    std::string startup_breakdown;
+
+    for (const auto& phase_timing : startup_timings_) {
+      startup_breakdown += string_sprintf("%s %.1f ms, ", phase_timing.first.c_str(), phase_timing.second / 1000.0F);
+    }
+
+    sa_log_info(NONE, string_sprintf("Startup: %stotal %.1f ms", startup_breakdown.c_str(), elapsed_since_construction_us() / 1000.0F));
+  }
+
+  if (config.verbose) {
+    auto dump_packet_queue_limits = [&](const Side side) {
+      sa_log_info(side, string_sprintf("Packet queue: up to %zu packets or %.1f MiB", packet_queues_[side]->max_packets(), static_cast<float>(packet_queues_[side]->max_bytes()) / (1024 * 1024)));
+    };
+
+    dump_packet_queue_limits(LEFT);
+    dump_packet_queue_limits(RIGHT);
+  }
+
   // Initialize metadata overlay
   auto collect_metadata = [&](const Side side) -> VideoMetadata {
     VideoMetadata metadata;
@@ -272,9 +394,26 @@ VideoCompare::VideoCompare(const VideoCompareConfig& config)
   display_->update_metadata(collect_metadata(LEFT), collect_metadata(RIGHT));
 
   update_decoder_mode(time_shift_offset_av_time_);
+
+  publish_discard_before_pts(LEFT, AV_NOPTS_VALUE);
+  publish_discard_before_pts(RIGHT, AV_NOPTS_VALUE);
 }
 
 void VideoCompare::operator()() {
+  // bypass the streaming pipeline when comparing two still images
+  if (demuxers_[LEFT]->is_still_image() && demuxers_[RIGHT]->is_still_image()) {
+    std::array<AVPacketUniquePtr, Side::Count> image_packets{read_still_image_packet(LEFT), read_still_image_packet(RIGHT)};
+
+    if (image_packets[LEFT] != nullptr && image_packets[RIGHT] != nullptr) {
+      compare_still_images(image_packets);
+      return;
+    }
+
+    if (!demuxers_[LEFT]->rewind() || !demuxers_[RIGHT]->rewind()) {
+      throw std::runtime_error("Rewinding inputs after probing for still images");
+    }
+  }
+
   stages_.emplace_back(&VideoCompare::thread_demultiplex_left, this);
   stages_.emplace_back(&VideoCompare::thread_demultiplex_right, this);
   stages_.emplace_back(&VideoCompare::thread_decode_video_left, this);
@@ -293,6 +432,123 @@ void VideoCompare::operator()() {
   exception_holder_.rethrow_stored_exception();
 }
 
+AVPacketUniquePtr VideoCompare::read_still_image_packet(const Side side) {
+  ScopedLogSide scoped_log_side(side);
+
+  AVPacketUniquePtr image_packet{nullptr, avpacket_deleter};
+
+  while (true) {
+    AVPacketUniquePtr packet{new AVPacket, avpacket_deleter};
+    av_init_packet(packet.get());
+    packet->data = nullptr;
+
+    if (!(*demuxers_[side])(*packet)) {
+      break;
+    }
+    if (packet->stream_index != demuxers_[side]->video_stream_index()) {
+      continue;
+    }
+
+    // more than one frame, so not a still image after all
+    if (image_packet != nullptr) {
+      return AVPacketUniquePtr{nullptr, avpacket_deleter};
+    }
+
+    image_packet = std::move(packet);
+  }
+
+  return image_packet;
+}
+
+AVFrameUniquePtr VideoCompare::decode_still_image(const Side side, AVPacket* image_packet) {
+  ScopedLogSide scoped_log_side(side);
+
+  // drain the decoder and filter graph right away, as nothing follows the image
+  video_decoders_[side]->send(image_packet);
+  video_decoders_[side]->send(nullptr);
+
+  AVFrameSharedPtr frame_decoded{av_frame_alloc(), avframe_deleter};
+
+  if (!video_decoders_[side]->receive(frame_decoded.get(), demuxers_[side].get())) {
+    throw std::runtime_error("Decoding still image");
+  }
+
+  if (frame_decoded->format == video_decoders_[side]->hw_pixel_format()) {
+    AVFrameSharedPtr sw_frame_decoded{av_frame_alloc(), avframe_deleter};
+
+    // Transfer data from GPU to CPU
+    if (av_hwframe_transfer_data(sw_frame_decoded.get(), frame_decoded.get(), 0) < 0) {
+      throw std::runtime_error("Error transferring frame from GPU to CPU");
+    }
+    if (av_frame_copy_props(sw_frame_decoded.get(), frame_decoded.get()) < 0) {
+      throw std::runtime_error("Copying SW frame properties");
+    }
+
+    frame_decoded = sw_frame_decoded;
+  }
+
+  if (!video_filterers_[side]->send(frame_decoded.get()) || !video_filterers_[side]->send(nullptr)) {
+    throw std::runtime_error("Error while feeding the filter graph");
+  }
+
+  AVFrameUniquePtr frame_filtered{av_frame_alloc(), avframe_deleter};
+
+  if (!video_filterers_[side]->receive(frame_filtered.get())) {
+    throw std::runtime_error("Filtering still image");
+  }
+
+  return frame_filtered;
+}
+
+void VideoCompare::compare_still_images(const std::array<AVPacketUniquePtr, Side::Count>& image_packets) {
+  const std::array<AVFrameUniquePtr, Side::Count> filtered_frames{decode_still_image(LEFT, image_packets[LEFT].get()), decode_still_image(RIGHT, image_packets[RIGHT].get())};
+  std::array<AVFrameUniquePtr, Side::Count> converted_frames;
+
+  auto convert = [&](const Side side, const bool fast_input_alignment) {
+    AVFrameUniquePtr frame_converted{av_frame_alloc(), avframe_deleter};
+
+    if (av_frame_copy_props(frame_converted.get(), filtered_frames[side].get()) < 0) {
+      throw std::runtime_error("Copying filtered frame properties");
+    }
+
+    format_converters_[side]->set_pending_flags(determine_sws_flags(fast_input_alignment));
+    (*format_converters_[side])(filtered_frames[side].get(), frame_converted.get());
+
+    converted_frames[side] = std::move(frame_converted);
+  };
+
+  bool converted_with_fast_input_alignment = false;
+  bool first_frame_presented = false;
+
+  // everything is converted once up front, and after that only rendered in response to input
+  while (true) {
+    display_->input();
+
+    if (!keep_running()) {
+      break;
+    }
+
+    if (converted_frames[LEFT] == nullptr || display_->get_fast_input_alignment() != converted_with_fast_input_alignment) {
+      converted_with_fast_input_alignment = display_->get_fast_input_alignment();
+
+      convert(LEFT, converted_with_fast_input_alignment);
+      convert(RIGHT, converted_with_fast_input_alignment);
+
+      display_->request_refresh();
+    }
+
+    const AVFrame* left_display_frame = converted_frames[!display_->get_swap_left_right() ? LEFT : RIGHT].get();
+    const AVFrame* right_display_frame = converted_frames[!display_->get_swap_left_right() ? RIGHT : LEFT].get();
+
+    if (display_->possibly_refresh(left_display_frame, right_display_frame, "1/1", "") && verbose_ && !first_frame_presented) {
+      sa_log_info(NONE, string_sprintf("Time to first frame: %.1f ms", elapsed_since_construction_us() / 1000.0F));
+      first_frame_presented = true;
+    }
+
+    display_->wait_for_input(STILL_IMAGE_INPUT_TIMEOUT_MS);
+  }
+}
+
 void VideoCompare::thread_demultiplex_left() {
   demultiplex(LEFT);
 }
@@ -361,6 +617,10 @@ void VideoCompare::decode_video(const Side side) {
           // Flush the decoder
           video_decoders_[side]->flush();
 
+          if (image_sequence_decoders_[side] != nullptr) {
+            image_sequence_decoders_[side]->flush();
+          }
+
           // Seeks are now OK
           ready_to_seek_.set(ReadyToSeek::DECODER, side);
         }
@@ -374,8 +634,16 @@ void VideoCompare::decode_video(const Side side) {
       // Read packet from queue
       if (!packet_queues_[side]->pop(packet)) {
         // Flush remaining frames cached in the decoder
-        while (process_packet(side, packet.get())) {
-          ;
+        if (image_sequence_decoders_[side] != nullptr) {
+          AVFrameSharedPtr frame_decoded;
+
+          while ((frame_decoded = image_sequence_decoders_[side]->receive(true)) != nullptr && push_decoded_frame(side, frame_decoded)) {
+            ;
+          }
+        } else {
+          while (process_packet(side, packet.get())) {
+            ;
+          }
         }
 
         // Enter wait state
@@ -387,6 +655,11 @@ void VideoCompare::decode_video(const Side side) {
         continue;
       }
 
+      if (image_sequence_decoders_[side] != nullptr) {
+        process_image_sequence_packet(side, std::move(packet));
+        continue;
+      }
+
       // If the packet didn't send, receive more frames and try again
       while (!seeking_ && !process_packet(side, packet.get())) {
         ;
@@ -427,17 +700,52 @@ bool VideoCompare::process_packet(const Side side, AVPacket* packet) {
       frame_for_filtering = frame_decoded;
     }
 
-    if (!decoded_frame_queues_[side]->push(frame_for_filtering)) {
+    if (!push_decoded_frame(side, frame_for_filtering)) {
       return sent;
     }
+  }
 
-    // Send the decoded frame to the right filterer, as well, if in single decoder mode
-    if (single_decoder_mode_) {
-      decoded_frame_queues_[RIGHT]->push(frame_for_filtering);
+  return sent;
+}
+
+void VideoCompare::process_image_sequence_packet(const Side side, AVPacketUniquePtr packet) {
+  ImageSequenceDecoder* image_sequence_decoder = image_sequence_decoders_[side].get();
+
+  // make room in the look-ahead window by delivering the oldest image first
+  while (image_sequence_decoder->is_full()) {
+    if (seeking_ || !push_decoded_frame(side, image_sequence_decoder->receive(true))) {
+      return;
     }
   }
 
-  return sent;
+  image_sequence_decoder->submit(std::move(packet));
+
+  // deliver all images which are already decoded, in order
+  AVFrameSharedPtr frame_decoded;
+
+  while ((frame_decoded = image_sequence_decoder->receive(false)) != nullptr) {
+    if (!push_decoded_frame(side, frame_decoded)) {
+      return;
+    }
+  }
+}
+
+bool VideoCompare::push_decoded_frame(const Side side, AVFrameSharedPtr frame) {
+  // frames decoded by the image sequence pool have not been through VideoDecoder::receive()
+  if (image_sequence_decoders_[side] != nullptr) {
+    video_decoders_[side]->adjust_timestamps(frame.get(), demuxers_[side].get());
+  }
+
+  if (!decoded_frame_queues_[side]->push(frame)) {
+    return false;
+  }
+
+  // Send the decoded frame to the right filterer, as well, if in single decoder mode
+  if (single_decoder_mode_) {
+    decoded_frame_queues_[RIGHT]->push(frame);
+  }
+
+  return true;
 }
 
 void VideoCompare::thread_filter_left() {
@@ -465,6 +773,11 @@ void VideoCompare::filter_video(const Side side) {
       AVFrameSharedPtr frame_to_filter;
 
       if (decoded_frame_queues_[side]->pop(frame_to_filter)) {
+        // bypass the filter graph altogether, unless it depends on the cadence or timing of its input frames
+        if (video_filterers_[side]->preserves_timing() && must_discard(side, video_filterers_[side]->filtered_pts(frame_to_filter.get()))) {
+          continue;
+        }
+
         filter_decoded_frame(side, frame_to_filter);
       } else if (decoded_frame_queues_[side]->is_stopped() || seeking_) {
         // Close the filter source
@@ -497,6 +810,11 @@ void VideoCompare::filter_decoded_frame(const Side side, AVFrameSharedPtr frame_
       break;
     }
 
+    // skip conversion and display of frames which are already late
+    if (must_discard(side, frame_filtered->pts)) {
+      continue;
+    }
+
     if (!filtered_frame_queues_[side]->push(std::move(frame_filtered))) {
       return;
     }
@@ -530,17 +848,25 @@ void VideoCompare::format_convert_video(const Side side) {
       AVFrameUniquePtr frame_filtered{av_frame_alloc(), avframe_deleter};
 
       if (filtered_frame_queues_[side]->pop(frame_filtered)) {
+        if (must_discard(side, frame_filtered->pts)) {
+          continue;
+        }
+
         // scale and convert pixel format before pushing to frame queue for displaying
-        AVFrameUniquePtr frame_converted{av_frame_alloc(), avframe_and_data_deleter};
+        AVFrameUniquePtr frame_converted{av_frame_alloc(), avframe_deleter};
 
         if (av_frame_copy_props(frame_converted.get(), frame_filtered.get()) < 0) {
           throw std::runtime_error("Copying filtered frame properties");
         }
-        if (av_image_alloc(frame_converted->data, frame_converted->linesize, format_converters_[side]->dest_width(), format_converters_[side]->dest_height(), format_converters_[side]->dest_pixel_format(), 64) < 0) {
-          throw std::runtime_error("Allocating converted picture");
-        }
         (*format_converters_[side])(frame_filtered.get(), frame_converted.get());
 
+        // keep the source of reduced or fast-scaled frames, so they can be re-converted once full quality is required,
+        // and of all frames while subtracting in the YUV domain
+        if (keep_source_frames_ || static_cast<size_t>(frame_converted->width) != max_width_ || static_cast<size_t>(frame_converted->height) != max_height_ ||
+            get_sws_flags(frame_converted.get()) != determine_sws_flags(false)) {
+          ffmpeg::attach_source_frame(frame_converted.get(), frame_filtered.release());
+        }
+
         converted_frame_queues_[side]->push(std::move(frame_converted));
       } else if (filtered_frame_queues_[side]->is_stopped() || seeking_) {
         // Stop filtering
@@ -553,6 +879,16 @@ void VideoCompare::format_convert_video(const Side side) {
   }
 }
 
+void VideoCompare::publish_discard_before_pts(const Side side, const int64_t pts) {
+  discard_before_pts_[side].store(pts, std::memory_order_relaxed);
+}
+
+bool VideoCompare::must_discard(const Side side, const int64_t pts) const {
+  const int64_t discard_before_pts = discard_before_pts_[side].load(std::memory_order_relaxed);
+
+  return discard_before_pts != AV_NOPTS_VALUE && pts != AV_NOPTS_VALUE && pts < discard_before_pts;
+}
+
 bool VideoCompare::keep_running() const {
   return !display_->get_quit() && !exception_holder_.has_exception();
 }
@@ -568,6 +904,10 @@ void VideoCompare::update_decoder_mode(const int right_time_shift) {
   single_decoder_mode_ = same_decoded_video_both_sides_ && (av_q2d(time_shift_.multiplier) == 1.0) && (abs(right_time_shift) < NEAR_ZERO_TIME_SHIFT_THRESHOLD);
 }
 
+int64_t VideoCompare::elapsed_since_construction_us() const {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - construction_start_time_).count();
+}
+
 void VideoCompare::dump_debug_info(const int frame_number, const int effective_right_time_shift, const int average_refresh_time) {
   auto dump_queue_side = [&](const std::string& name, const std::string side_name, const Side side, const auto& queue) {
     std::cout << side_name << " " << name << ": size=" << queue[side]->size() << ", is_stopped=" << queue[side]->is_stopped() << ", quit=" << queue[side]->is_quit() << std::endl;
@@ -645,6 +985,7 @@ void VideoCompare::compare() {
     // for refreshing the display only
     Timer display_refresh_timer;
     sorted_flat_deque<uint32_t> refresh_time_deque(8);
+    bool first_frame_presented = false;
 
     // for the full cycle
     Timer full_cycle_timer;
@@ -656,9 +997,76 @@ void VideoCompare::compare() {
 
     double next_refresh_at = 0;
 
+    // for shedding work while regular playback cannot keep up
+    QualityGovernor quality_governor;
+    bool steady_playback = true;
+    float queue_fill_sum = 0.0F;
+    int queue_fill_samples = 0;
+    std::string quality_message;
+
+    // for refining the displayed frames in the background once playback has been idle for a while
+    Timer idle_timer;
+    std::array<const AVFrame*, Side::Count> previous_displayed_frames{nullptr, nullptr};
+    std::array<std::future<AVFrameUniquePtr>, Side::Count> refinement_futures;
+
+    const int refinement_sws_flags = determine_sws_flags(false);
+
+    auto needs_refinement = [&](const AVFrame* frame) {
+      return ffmpeg::get_source_frame(frame) != nullptr &&
+             (static_cast<size_t>(frame->width) != max_width_ || static_cast<size_t>(frame->height) != max_height_ || get_sws_flags(frame) != refinement_sws_flags);
+    };
+
+    auto start_refinement = [&](const AVFrame* frame) {
+      // the copied properties include a reference to the source frame, keeping it alive while converting
+      AVFrameUniquePtr frame_refined{av_frame_alloc(), avframe_deleter};
+
+      if (av_frame_copy_props(frame_refined.get(), frame) < 0) {
+        throw std::runtime_error("Copying converted frame properties");
+      }
+
+      const AVPixelFormat dest_pixel_format = static_cast<AVPixelFormat>(frame->format);
+
+      return std::async(std::launch::async, [this, dest_pixel_format, refinement_sws_flags](AVFrameUniquePtr frame_refined) {
+        AVFrame* source_frame = ffmpeg::get_source_frame(frame_refined.get());
+
+        FormatConverter format_converter(source_frame->width, source_frame->height, max_width_, max_height_, static_cast<AVPixelFormat>(source_frame->format), dest_pixel_format, source_frame->colorspace,
+                                         source_frame->color_range, NONE, refinement_sws_flags);
+        format_converter(source_frame, frame_refined.get());
+
+        return frame_refined;
+      }, std::move(frame_refined));
+    };
+
+    auto possibly_swap_in_refined_frame = [&](std::deque<AVFrameUniquePtr>& frames, std::future<AVFrameUniquePtr>& refinement_future) {
+      if (!refinement_future.valid() || refinement_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+      }
+
+      AVFrameUniquePtr frame_refined = refinement_future.get();
+      const AVFrame* source_frame = ffmpeg::get_source_frame(frame_refined.get());
+
+      // the frame may have been evicted from the buffer (e.g. by seeking) in the meantime
+      for (auto& frame : frames) {
+        if (ffmpeg::get_source_frame(frame.get()) == source_frame) {
+          if (!keep_source_frames_) {
+            av_buffer_unref(&frame_refined->opaque_ref);
+          }
+          frame = std::move(frame_refined);
+
+          display_->request_refresh();
+          break;
+        }
+      }
+    };
+
     for (uint64_t frame_number = 0;; ++frame_number) {
       std::string message = display_->get_show_fps() ? fps_message : "";
 
+      if (!quality_message.empty()) {
+        message = quality_message;
+        quality_message.clear();
+      }
+
       full_cycle_timer.update();
 
       // sample keyboard and mouse input events
@@ -674,9 +1082,50 @@ void VideoCompare::compare() {
       }
 #endif
 
-      const int format_conversion_sws_flags = determine_sws_flags(display_->get_fast_input_alignment());
-      format_converters_[LEFT]->set_pending_flags(format_conversion_sws_flags);
-      format_converters_[RIGHT]->set_pending_flags(format_conversion_sws_flags);
+      const bool regular_playback = display_->get_play() && display_->get_buffer_play_loop_mode() == Display::Loop::OFF;
+      const QualityGovernor::Level quality_level = regular_playback ? quality_governor.level() : QualityGovernor::FULL_QUALITY;
+
+      steady_playback = steady_playback && regular_playback;
+      queue_fill_sum += static_cast<float>(converted_frame_queues_[LEFT]->size() + converted_frame_queues_[RIGHT]->size()) / static_cast<float>(QUEUE_SIZE * Side::Count);
+      queue_fill_samples++;
+
+      keep_source_frames_ = display_->get_yuv_subtraction();
+
+      display_->set_freeze_diff_scale(quality_level >= QualityGovernor::FIXED_DIFF_SCALE);
+      display_->set_reduce_diff_resolution(quality_level >= QualityGovernor::REDUCED_DIFF_RESOLUTION);
+
+      const float playback_speed_factor = display_->get_playback_speed_factor();
+
+      // when fast-forwarding, most frames would never be shown anyway
+      AVDiscard skip_frame = quality_level >= QualityGovernor::DROP_NON_REFERENCE_FRAMES ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+
+      if (regular_playback && playback_speed_factor >= SKIP_NON_KEY_FRAMES_SPEED) {
+        skip_frame = std::max(skip_frame, AVDISCARD_NONKEY);
+      } else if (regular_playback && playback_speed_factor >= SKIP_NON_REFERENCE_FRAMES_SPEED) {
+        skip_frame = std::max(skip_frame, AVDISCARD_NONREF);
+      }
+
+      video_decoders_[LEFT]->set_pending_skip_frame(skip_frame);
+      video_decoders_[RIGHT]->set_pending_skip_frame(skip_frame);
+
+      const int format_conversion_sws_flags = quality_level >= QualityGovernor::FAST_SCALING ? SWS_FAST_BILINEAR : determine_sws_flags(display_->get_fast_input_alignment());
+      const bool full_resolution_required = !adaptive_resolution_ || display_->get_full_resolution_required();
+
+      if (full_resolution_required) {
+        format_converters_[LEFT]->set_pending_flags(format_conversion_sws_flags);
+        format_converters_[RIGHT]->set_pending_flags(format_conversion_sws_flags);
+        format_converters_[LEFT]->set_pending_dest_size(max_width_, max_height_);
+        format_converters_[RIGHT]->set_pending_dest_size(max_width_, max_height_);
+      } else {
+        // during playback at zoom levels <= 1, there is no point in converting more pixels than can be shown
+        int on_screen_width, on_screen_height;
+        std::tie(on_screen_width, on_screen_height) = display_->get_on_screen_video_size();
+
+        format_converters_[LEFT]->set_pending_flags(SWS_FAST_BILINEAR);
+        format_converters_[RIGHT]->set_pending_flags(SWS_FAST_BILINEAR);
+        format_converters_[LEFT]->set_pending_dest_size(on_screen_width, on_screen_height);
+        format_converters_[RIGHT]->set_pending_dest_size(on_screen_width, on_screen_height);
+      }
 
       // allow 50 ms of lag without resetting timer (and ticking playback)
       if (display_->get_tick_playback() || (display_->get_possibly_tick_playback() && (timer_->us_until_target() < -50000))) {
@@ -695,6 +1144,10 @@ void VideoCompare::compare() {
 
         ready_to_seek_.reset();
         seeking_ = true;
+        steady_playback = false;
+
+        publish_discard_before_pts(LEFT, AV_NOPTS_VALUE);
+        publish_discard_before_pts(RIGHT, AV_NOPTS_VALUE);
 
         // drain packet and frame queues
         auto stop_and_empty_packet_queue = [&](const Side side) {
@@ -842,6 +1295,29 @@ void VideoCompare::compare() {
 
         return result;
       };
+      // let the filter and converter threads drop frames which will never be shown (PTS are in the time-shifted domain here)
+      int64_t left_discard_before_pts = AV_NOPTS_VALUE;
+      int64_t right_discard_before_pts = AV_NOPTS_VALUE;
+
+      // when fast-forwarding: the PTS which should be on screen by now, less one frame of slack, given how far playback lags behind the timer
+      if (regular_playback && playback_speed_factor > 1.0F && frame_number > 0 && !left.frames_.empty() && !right.frames_.empty()) {
+        const int64_t lag = std::max<int64_t>(-timer_->us_until_target(), 0) * playback_speed_factor;
+
+        left_discard_before_pts = left.pts_ + lag - left.delta_pts_;
+        right_discard_before_pts = right.pts_ + lag - right.delta_pts_;
+      }
+
+      // when resyncing: everything the side which is behind would pop and discard below
+      if (is_behind(left.pts_, right.pts_, min_delta)) {
+        left_discard_before_pts = std::max(left_discard_before_pts, right.pts_ - min_delta);
+      }
+      if (is_behind(right.pts_, left.pts_, min_delta)) {
+        right_discard_before_pts = std::max(right_discard_before_pts, left.pts_ - min_delta);
+      }
+
+      publish_discard_before_pts(LEFT, left_discard_before_pts);
+      publish_discard_before_pts(RIGHT, right_discard_before_pts != AV_NOPTS_VALUE ? right_discard_before_pts + effective_right_time_shift : AV_NOPTS_VALUE);
+
       auto sync_frame_queue = [&](SideState& side_state, const SideState& other_side) {
         if (is_behind(side_state.pts_, other_side.pts_, min_delta)) {
           adjusting = true;
@@ -929,6 +1405,16 @@ void VideoCompare::compare() {
             frames.pop_back();
           }
           frames.push_front(std::move(frame));
+
+          // older full-size frames stay as converted unless subtracting in the YUV domain, while reduced ones keep their
+          // source, as they must be restored to full resolution before being shown when paused
+          if (!keep_source_frames_ && frames.size() > MAX_BUFFERED_SOURCE_FRAMES) {
+            AVFrame* older_frame = frames[MAX_BUFFERED_SOURCE_FRAMES].get();
+
+            if (static_cast<size_t>(older_frame->width) == max_width_ && static_cast<size_t>(older_frame->height) == max_height_) {
+              av_buffer_unref(&older_frame->opaque_ref);
+            }
+          }
         } else if (frame != nullptr) {
           if (!frames.empty()) {
             frames.front() = std::move(frame);
@@ -956,10 +1442,64 @@ void VideoCompare::compare() {
       if (frame_offset >= 0 && !left.frames_.empty() && !right.frames_.empty()) {
         const bool is_playback_in_sync = is_in_sync(left.pts_, right.pts_, left.delta_pts_, right.delta_pts_);
 
+        steady_playback = steady_playback && is_playback_in_sync;
+
         // reduce refresh rate to 10 Hz for faster re-syncing
         const bool skip_refresh = !is_playback_in_sync && display_refresh_timer.us_until_target() > -RESYNC_UPDATE_RATE_US;
 
         if (!skip_refresh) {
+          // replace reduced or fast-scaled frames about to be shown with full-quality ones
+          auto restore_full_resolution = [&](AVFrameUniquePtr& frame, const Side side) {
+            const AVFrame* source_frame = ffmpeg::get_source_frame(frame.get());
+
+            if (source_frame == nullptr ||
+                (static_cast<size_t>(frame->width) == max_width_ && static_cast<size_t>(frame->height) == max_height_ && get_sws_flags(frame.get()) == format_conversion_sws_flags)) {
+              return;
+            }
+
+            AVFrameUniquePtr frame_converted{av_frame_alloc(), avframe_deleter};
+
+            // also shares the reference to the source frame
+            if (av_frame_copy_props(frame_converted.get(), frame.get()) < 0) {
+              throw std::runtime_error("Copying converted frame properties");
+            }
+
+            full_resolution_format_converters_[side]->set_pending_flags(format_conversion_sws_flags);
+            (*full_resolution_format_converters_[side])(const_cast<AVFrame*>(source_frame), frame_converted.get());
+
+            if (format_conversion_sws_flags == determine_sws_flags(false)) {
+              av_buffer_unref(&frame_converted->opaque_ref);
+            }
+
+            frame = std::move(frame_converted);
+            display_->request_refresh();
+          };
+
+          if (adaptive_resolution_ && full_resolution_required) {
+            restore_full_resolution(left.frames_[frame_offset], LEFT);
+            restore_full_resolution(right.frames_[frame_offset], RIGHT);
+          }
+
+          const bool needs_refinement_left = needs_refinement(left.frames_[frame_offset].get());
+          const bool needs_refinement_right = needs_refinement(right.frames_[frame_offset].get());
+
+          if (left.frames_[frame_offset].get() != previous_displayed_frames[LEFT] || right.frames_[frame_offset].get() != previous_displayed_frames[RIGHT] || display_->get_play() ||
+              display_->get_buffer_play_loop_mode() != Display::Loop::OFF) {
+            idle_timer.update();
+
+            previous_displayed_frames = {left.frames_[frame_offset].get(), right.frames_[frame_offset].get()};
+          } else if (-idle_timer.us_until_target() >= REFINEMENT_IDLE_DELAY_US) {
+            if (needs_refinement_left && !refinement_futures[LEFT].valid()) {
+              refinement_futures[LEFT] = start_refinement(left.frames_[frame_offset].get());
+            }
+            if (needs_refinement_right && !refinement_futures[RIGHT].valid()) {
+              refinement_futures[RIGHT] = start_refinement(right.frames_[frame_offset].get());
+            }
+          }
+
+          possibly_swap_in_refined_frame(left.frames_, refinement_futures[LEFT]);
+          possibly_swap_in_refined_frame(right.frames_, refinement_futures[RIGHT]);
+
           const auto& left_frames_ref = !display_->get_swap_left_right() ? left.frames_ : right.frames_;
           const auto& right_frames_ref = !display_->get_swap_left_right() ? right.frames_ : left.frames_;
 
@@ -995,6 +1535,11 @@ void VideoCompare::compare() {
 
             if (display_->possibly_refresh(left_display_frame, right_display_frame, current_total_browsable, message)) {
               refresh_time_deque.push_back(-display_refresh_timer.us_until_target());
+
+              if (verbose_ && !first_frame_presented) {
+                sa_log_info(NONE, string_sprintf("Time to first frame: %.1f ms", elapsed_since_construction_us() / 1000.0F));
+              }
+              first_frame_presented = true;
             } else {
               sleep_for_ms(refresh_time_deque.average() / 1000);
             }
@@ -1060,6 +1605,24 @@ void VideoCompare::compare() {
 
           fps_message = string_sprintf("Video/UI FPS: %.1f/%.1f", video_fps, ui_fps);
 
+          // only judge windows of regular, in-sync playback
+          const int64_t frame_duration = std::max(left.delta_pts_, right.delta_pts_);
+
+          if (steady_playback && frame_duration > 0) {
+            const float target_fps = static_cast<float>(ONE_SECOND_US) * display_->get_playback_speed_factor() / static_cast<float>(frame_duration);
+            const float refresh_load = static_cast<float>(refresh_time_deque.average()) * target_fps / static_cast<float>(ONE_SECOND_US);
+
+            if (quality_governor.update(video_fps, target_fps, queue_fill_sum / static_cast<float>(queue_fill_samples), refresh_load)) {
+              quality_message = "Quality: " + QualityGovernor::describe(quality_governor.level());
+
+              sa_log_info(NONE, string_sprintf("Playback quality changed to level %d (%s) at %.1f of %.1f FPS", quality_governor.level(), QualityGovernor::describe(quality_governor.level()).c_str(), video_fps, target_fps));
+            }
+          }
+
+          steady_playback = true;
+          queue_fill_sum = 0.0F;
+          queue_fill_samples = 0;
+
           full_cycle_time_deque.clear();
           unique_frame_combo_tags_processed = 0;
         }
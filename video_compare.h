@@ -1,16 +1,21 @@
 #pragma once
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <shared_mutex>
 #include <stdexcept>
 #include <string>
 #include <thread>
+#include <utility>
 #include <vector>
 #include "config.h"
 #include "core_types.h"
 #include "demuxer.h"
 #include "display.h"
 #include "format_converter.h"
+#include "image_sequence_decoder.h"
+#include "packet_queue.h"
 #include "queue.h"
 #include "timer.h"
 #include "video_decoder.h"
@@ -19,11 +24,9 @@ extern "C" {
 #include <libavcodec/avcodec.h>
 }
 
-using AVPacketUniquePtr = std::unique_ptr<AVPacket, std::function<void(AVPacket*)>>;
 using AVFrameSharedPtr = std::shared_ptr<AVFrame>;
 using AVFrameUniquePtr = std::unique_ptr<AVFrame, std::function<void(AVFrame*)>>;
 
-using PacketQueue = Queue<AVPacketUniquePtr>;
 using DecodedFrameQueue = Queue<AVFrameSharedPtr>;
 using FrameQueue = Queue<AVFrameUniquePtr>;
 
@@ -96,6 +99,12 @@ class VideoCompare {
   void operator()();
 
  private:
+  // single-frame inputs are decoded, filtered and converted once, without the streaming pipeline; a null packet
+  // is returned for inputs which turn out to have more than one frame
+  AVPacketUniquePtr read_still_image_packet(const Side side);
+  AVFrameUniquePtr decode_still_image(const Side side, AVPacket* image_packet);
+  void compare_still_images(const std::array<AVPacketUniquePtr, Side::Count>& image_packets);
+
   void thread_demultiplex_left();
   void thread_demultiplex_right();
   void demultiplex(const Side side);
@@ -104,6 +113,8 @@ class VideoCompare {
   void thread_decode_video_right();
   void decode_video(const Side side);
   bool process_packet(const Side side, AVPacket* packet);
+  void process_image_sequence_packet(const Side side, AVPacketUniquePtr packet);
+  bool push_decoded_frame(const Side side, AVFrameSharedPtr frame);
 
   void thread_filter_left();
   void thread_filter_right();
@@ -119,6 +130,13 @@ class VideoCompare {
 
   void update_decoder_mode(const int right_time_shift);
 
+  // frames with a PTS below the watermark will never be shown and are dropped by the filter and converter threads;
+  // AV_NOPTS_VALUE disables dropping
+  void publish_discard_before_pts(const Side side, const int64_t pts);
+  bool must_discard(const Side side, const int64_t pts) const;
+
+  int64_t elapsed_since_construction_us() const;
+
   void dump_debug_info(const int frame_number, const int right_time_shift, const int average_refresh_time);
 
   void compare();
@@ -130,6 +148,11 @@ class VideoCompare {
   const size_t frame_buffer_size_;
   const TimeShiftConfig time_shift_;
   const int64_t time_shift_offset_av_time_;
+  const bool verbose_;
+
+  // startup phases and their wall-clock durations in microseconds, for verbose output
+  const std::chrono::steady_clock::time_point construction_start_time_;
+  std::vector<std::pair<std::string, int64_t>> startup_timings_;
 
   const std::array<std::unique_ptr<Demuxer>, Side::Count> demuxers_;
   const std::array<std::unique_ptr<VideoDecoder>, Side::Count> video_decoders_;
@@ -138,9 +161,14 @@ class VideoCompare {
   const size_t max_width_;
   const size_t max_height_;
   const bool initial_fast_input_alignment_;
+  const bool adaptive_resolution_;
   const double shortest_duration_;
 
   const std::array<std::unique_ptr<FormatConverter>, Side::Count> format_converters_;
+  // only used in adaptive resolution mode, for re-converting displayed frames from their retained source
+  const std::array<std::unique_ptr<FormatConverter>, Side::Count> full_resolution_format_converters_;
+  // declared before the display, which refers to it
+  std::shared_ptr<MetricsDatabase> metrics_database_;
   const std::unique_ptr<Display> display_;
   const std::unique_ptr<Timer> timer_;
   const std::array<std::unique_ptr<PacketQueue>, Side::Count> packet_queues_;
@@ -148,11 +176,16 @@ class VideoCompare {
   const std::array<std::unique_ptr<FrameQueue>, Side::Count> filtered_frame_queues_;
   const std::array<std::unique_ptr<FrameQueue>, Side::Count> converted_frame_queues_;
 
+  // only for image sequences, which are decoded by a pool of workers instead of the video decoder
+  std::array<std::unique_ptr<ImageSequenceDecoder>, Side::Count> image_sequence_decoders_;
+
   std::vector<std::thread> stages_;
 
   ExceptionHolder exception_holder_;
 
   std::atomic_bool seeking_{false};
   std::atomic_bool single_decoder_mode_{false};
+  std::atomic_bool keep_source_frames_{false};
+  std::array<std::atomic<int64_t>, Side::Count> discard_before_pts_;
   ReadyToSeek ready_to_seek_;
 };
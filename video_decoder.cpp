@@ -149,6 +149,8 @@ std::string VideoDecoder::hw_accel_name() const {
 }
 
 bool VideoDecoder::send(AVPacket* packet) {
+  codec_context_->skip_frame = static_cast<AVDiscard>(pending_skip_frame_.load());
+
   auto ret = avcodec_send_packet(codec_context_, packet);
   if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
     return false;
@@ -164,13 +166,22 @@ bool VideoDecoder::receive(AVFrame* frame, Demuxer* demuxer) {
   }
   ffmpeg::check(ret);
 
+  adjust_timestamps(frame, demuxer);
+
+  return true;
+}
+
+void VideoDecoder::adjust_timestamps(AVFrame* frame, Demuxer* demuxer) {
 #if defined(AV_FRAME_FLAG_KEY)
   const bool is_key = (frame->flags & AV_FRAME_FLAG_KEY) != 0;
 #else
   const bool is_key = frame->key_frame != 0;
 #endif
 
-  const bool use_avframe_state = trust_decoded_pts_ || next_pts_ == AV_NOPTS_VALUE || is_key || frame->pts == first_pts_;
+  // PTS extrapolation would be off by the skipped frames' durations
+  const bool skipping_frames = codec_context_->skip_frame > AVDISCARD_DEFAULT;
+
+  const bool use_avframe_state = trust_decoded_pts_ || skipping_frames || next_pts_ == AV_NOPTS_VALUE || is_key || frame->pts == first_pts_;
   const int64_t avframe_pts = frame->pts != AV_NOPTS_VALUE ? frame->pts : (frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : 0);
 
   // use an increasing timestamp via pkt_duration between keyframes; otherwise, fall back to the best effort timestamp when PTS is not available
@@ -195,14 +206,16 @@ bool VideoDecoder::receive(AVFrame* frame, Demuxer* demuxer) {
   first_pts_ = first_pts_ == AV_NOPTS_VALUE ? avframe_pts : first_pts_;
   previous_pts_ = avframe_pts;
   next_pts_ = frame->pts + ffmpeg::frame_duration(frame);
-
-  return true;
 }
 
 void VideoDecoder::flush() {
   avcodec_flush_buffers(codec_context_);
 }
 
+void VideoDecoder::set_pending_skip_frame(const AVDiscard skip_frame) {
+  pending_skip_frame_ = skip_frame;
+}
+
 unsigned VideoDecoder::width() const {
   return codec_context_->width;
 }
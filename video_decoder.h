@@ -1,4 +1,5 @@
 #pragma once
+#include <atomic>
 #include <string>
 #include "core_types.h"
 #include "demuxer.h"
@@ -29,7 +30,14 @@ class VideoDecoder : public SideAware {
   bool send(AVPacket* packet);
   bool receive(AVFrame* frame, Demuxer* demuxer);
 
+  // for frames decoded elsewhere on behalf of this decoder, in presentation order
+  void adjust_timestamps(AVFrame* frame, Demuxer* demuxer);
+
   void flush();
+
+  // takes effect on the decoding thread with the next packet sent
+  void set_pending_skip_frame(const AVDiscard skip_frame);
+
   bool swap_dimensions() const;
   unsigned width() const;
   unsigned height() const;
@@ -63,5 +71,7 @@ class VideoDecoder : public SideAware {
 
   bool trust_decoded_pts_;
 
+  std::atomic_int pending_skip_frame_{AVDISCARD_DEFAULT};
+
   unsigned peak_luminance_nits_;
 };
@@ -1,12 +1,41 @@
 #include "video_filterer.h"
 #include <cmath>
 #include <iostream>
+#include <set>
 #include <string>
+#include <thread>
 #include "ffmpeg.h"
 #include "string_utils.h"
+extern "C" {
+#include <libavutil/opt.h>
+}
 
 static constexpr char VIDEO_FILTER_GROUP_DELIMITER = '|';
 
+// filters known to map each frame to exactly one output frame with the same timestamp, using that frame alone;
+// any other filter may change the frame cadence or timestamps, or depend on neighboring frames. Filters whose
+// expressions may use the frame number or time (e.g. crop, drawtext, eq, geq, hue, rotate) are not listed, as
+// their output for a frame depends on where decoding started.
+static const std::set<std::string> FRAME_INDEPENDENT_FILTERS = {
+    "avgblur", "boxblur", "buffer", "buffersink", "chromashift", "colorbalance", "colorchannelmixer", "colorcontrast", "colorcorrect", "colorize", "colorkey", "colorlevels",
+    "colormatrix", "colorspace", "colortemperature", "convolution", "copy", "curves", "deband", "edgedetect", "exposure", "format", "gblur", "hflip", "hqx", "huesaturation",
+    "lenscorrection", "lut", "lut1d", "lut3d", "lutrgb", "lutyuv", "median", "monochrome", "negate", "noformat", "null", "pad", "pp7", "scale", "selectivecolor", "setdar",
+    "setfield", "setparams", "setrange", "setsar", "sharpen", "shuffleplanes", "smartblur", "sobel", "spp", "super2xsai", "swapuv", "tonemap", "transpose", "unsharp", "vflip",
+    "vibrance", "xbr", "zscale"};
+
+static bool is_frame_independent(AVFilterContext* filter_context) {
+  const std::string name = filter_context->filter->name;
+
+  if (FRAME_INDEPENDENT_FILTERS.count(name) == 0) {
+    return false;
+  }
+
+  // scale expressions may also use the frame number and time, but only when evaluated per frame
+  int64_t eval_mode = 0;
+
+  return name != "scale" || (av_opt_get_int(filter_context, "eval", AV_OPT_SEARCH_CHILDREN, &eval_mode) >= 0 && eval_mode == 0);
+}
+
 static unsigned get_content_light_level_or_zero(const AVFrame* frame) {
   AVFrameSideData* frame_side_data = av_frame_get_side_data(frame, AV_FRAME_DATA_CONTENT_LIGHT_LEVEL);
 
@@ -32,11 +61,14 @@ VideoFilterer::VideoFilterer(const Side side,
                              const Demuxer* other_demuxer,
                              const VideoDecoder* other_video_decoder,
                              const std::string& other_custom_color_trc,
-                             const bool disable_auto_filters)
+                             const bool disable_auto_filters,
+                             const bool use_tone_map_lut,
+                             const bool verbose)
     : SideAware(side),
       demuxer_(demuxer),
       video_decoder_(video_decoder),
       tone_mapping_mode_(tone_mapping_mode),
+      verbose_(verbose),
       width_(video_decoder->width()),
       height_(video_decoder->height()),
       pixel_format_(video_decoder->pixel_format()),
@@ -192,28 +224,48 @@ VideoFilterer::VideoFilterer(const Side side,
       float tone_adjustment = (tone_mapping_mode == ToneMapping::RELATIVE && peak_luminance_nits_ < other_peak_luminance_nits) ? static_cast<float>(peak_luminance_nits_) / other_peak_luminance_nits : 1.0F;
       tone_adjustment *= boost_tone;
 
+      std::string tone_mapping_pixel_format;
+      std::vector<std::string> tone_mapping_filters;
+
       if (std::fabs(tone_adjustment - 1.0F) > 1e-5) {
-        filters.push_back("format=gbrpf32");
+        tone_mapping_pixel_format = "gbrpf32";
 
         if (tone_mapping_mode == ToneMapping::AUTO) {
           // peak luma gets injected from within init_filters() during auto-mode
-          filters.push_back("zscale=t=linear:npl=%d");
+          tone_mapping_filters.push_back("zscale=t=linear:npl=%d");
         } else {
-          filters.push_back(string_sprintf("zscale=t=linear:npl=%d", peak_luminance_nits_));
+          tone_mapping_filters.push_back(string_sprintf("zscale=t=linear:npl=%d", peak_luminance_nits_));
         }
 
-        filters.push_back(string_sprintf("tonemap=clip:param=%.5f", tone_adjustment));
-        filters.push_back(string_sprintf("zscale=p=%s:t=%s", display_primaries.c_str(), display_trc.c_str()));
+        tone_mapping_filters.push_back(string_sprintf("tonemap=clip:param=%.5f", tone_adjustment));
+        tone_mapping_filters.push_back(string_sprintf("zscale=p=%s:t=%s", display_primaries.c_str(), display_trc.c_str()));
       } else {
-        filters.push_back("format=rgb48");
+        tone_mapping_pixel_format = "rgb48";
 
         if (tone_mapping_mode == ToneMapping::AUTO) {
           // peak luma gets injected from within init_filters() during auto-mode
-          filters.push_back(string_sprintf("zscale=p=%s:t=%s:npl=%%d", display_primaries.c_str(), display_trc.c_str()));
+          tone_mapping_filters.push_back(string_sprintf("zscale=p=%s:t=%s:npl=%%d", display_primaries.c_str(), display_trc.c_str()));
         } else {
-          filters.push_back(string_sprintf("zscale=p=%s:t=%s:npl=%d", display_primaries.c_str(), display_trc.c_str(), peak_luminance_nits_));
+          tone_mapping_filters.push_back(string_sprintf("zscale=p=%s:t=%s:npl=%d", display_primaries.c_str(), display_trc.c_str(), peak_luminance_nits_));
         }
       }
+
+      if (use_tone_map_lut && custom_post_filters.empty()) {
+        // the chain is baked into a 3D LUT (once the colorimetry of the filtered frames is known) and applied in receive()
+        filters.push_back(string_sprintf("format=%s", av_get_pix_fmt_name(AV_PIX_FMT_GBRP16)));
+
+        tone_map_lut_filters_ = string_join(tone_mapping_filters, ",");
+        tone_map_lut_workers_ = std::make_unique<RowWorkers>(std::max(1, static_cast<int>(std::thread::hardware_concurrency() / 2)));
+
+        log_info(string_sprintf("Tone mapping through a %d^3 3D LUT.", ToneMapLut::LATTICE_SIZE));
+      } else {
+        if (use_tone_map_lut) {
+          log_warning("Tone-mapping LUT cannot be combined with custom post-filters; using the tone-mapping filters instead.");
+        }
+
+        filters.push_back("format=" + tone_mapping_pixel_format);
+        filters.insert(filters.end(), tone_mapping_filters.begin(), tone_mapping_filters.end());
+      }
     } else {
       log_warning(string_sprintf("Cannot add tone mapping filters: %s", string_join(warnings, ", ").c_str()));
     }
@@ -238,6 +290,15 @@ void VideoFilterer::init() {
   filter_graph_ = avfilter_graph_alloc();
 
   ffmpeg::check(init_filters(video_decoder_->codec_context(), demuxer_->time_base()));
+
+  preserves_timing_ = true;
+
+  for (unsigned i = 0; i < filter_graph_->nb_filters; i++) {
+    if (!is_frame_independent(filter_graph_->filters[i])) {
+      preserves_timing_ = false;
+      break;
+    }
+  }
 }
 
 void VideoFilterer::free() {
@@ -293,7 +354,7 @@ int VideoFilterer::init_filters(const AVCodecContext* dec_ctx, const AVRational
     inputs->pad_idx = 0;
     inputs->next = nullptr;
 
-    const std::string& filters = (tone_mapping_mode_ == ToneMapping::AUTO && dynamic_range_ != DynamicRange::STANDARD) ? string_sprintf(filter_description_, peak_luminance_nits_) : filter_description_;
+    const std::string filters = resolve_peak_luminance(filter_description_);
 
     if ((ret = avfilter_graph_parse_ptr(filter_graph_, filters.c_str(), &inputs, &outputs, nullptr)) >= 0) {
       ret = avfilter_graph_config(filter_graph_, nullptr);
@@ -306,6 +367,34 @@ int VideoFilterer::init_filters(const AVCodecContext* dec_ctx, const AVRational
   return ret;
 }
 
+std::string VideoFilterer::resolve_peak_luminance(const std::string& filters) const {
+  return (tone_mapping_mode_ == ToneMapping::AUTO && dynamic_range_ != DynamicRange::STANDARD) ? string_sprintf(filters, peak_luminance_nits_) : filters;
+}
+
+void VideoFilterer::apply_tone_map_lut(AVFrame* filtered_frame) {
+  const std::string color_primaries = filtered_frame->color_primaries != AVCOL_PRI_UNSPECIFIED ? av_color_primaries_name(filtered_frame->color_primaries) : "";
+  const std::string color_trc = filtered_frame->color_trc != AVCOL_TRC_UNSPECIFIED ? av_color_transfer_name(filtered_frame->color_trc) : "";
+  const std::string tone_mapping_filters = resolve_peak_luminance(tone_map_lut_filters_);
+  const std::string key = color_primaries + "|" + color_trc + "|" + tone_mapping_filters;
+
+  if (key != tone_map_lut_key_) {
+    tone_map_lut_ = ToneMapLut::get(color_primaries, color_trc, tone_mapping_filters);
+    tone_map_lut_key_ = key;
+
+    if (verbose_) {
+      const ToneMapLut::Deviation deviation = tone_map_lut_->measure_deviation();
+
+      log_info(string_sprintf("Tone-mapping LUT deviation from %s: max %.1f, mean %.2f (16-bit code values), max %.2f in 8-bit code values", tone_mapping_filters.c_str(), deviation.max, deviation.mean, deviation.max / 257.0F));
+    }
+  }
+
+  tone_map_lut_->apply(filtered_frame, *tone_map_lut_workers_);
+
+  // same output colorimetry as the final zscale of the chain
+  filtered_frame->color_primaries = AVCOL_PRI_BT709;
+  filtered_frame->color_trc = AVCOL_TRC_IEC61966_2_1;
+}
+
 bool VideoFilterer::send(AVFrame* decoded_frame) {
   if (decoded_frame != nullptr) {
     bool must_reinit = false;
@@ -377,10 +466,26 @@ bool VideoFilterer::receive(AVFrame* filtered_frame) {
   filtered_frame->pts = av_rescale_q(filtered_frame->pts, av_buffersink_get_time_base(buffersink_ctx_), AV_R_MICROSECONDS) - demuxer_->start_time();
   ffmpeg::frame_duration(filtered_frame) = av_rescale_q(ffmpeg::frame_duration(filtered_frame), demuxer_->time_base(), AV_R_MICROSECONDS);
 
+  if (!tone_map_lut_filters_.empty()) {
+    apply_tone_map_lut(filtered_frame);
+  }
+
   return true;
 }
 
+bool VideoFilterer::preserves_timing() const {
+  return preserves_timing_;
+}
+
+int64_t VideoFilterer::filtered_pts(const AVFrame* decoded_frame) const {
+  return decoded_frame->pts != AV_NOPTS_VALUE ? av_rescale_q(decoded_frame->pts, demuxer_->time_base(), AV_R_MICROSECONDS) - demuxer_->start_time() : AV_NOPTS_VALUE;
+}
+
 std::string VideoFilterer::filter_description() const {
+  if (!tone_map_lut_filters_.empty()) {
+    return string_sprintf("%s,3dlut(%s)", filter_description_.c_str(), tone_map_lut_filters_.c_str());
+  }
+
   return filter_description_;
 }
 
@@ -1,8 +1,11 @@
 #pragma once
+#include <memory>
 #include "config.h"
 #include "core_types.h"
 #include "demuxer.h"
+#include "row_workers.h"
 #include "side_aware.h"
+#include "tone_map_lut.h"
 #include "video_decoder.h"
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -25,7 +28,9 @@ class VideoFilterer : public SideAware {
                 const Demuxer* other_demuxer,
                 const VideoDecoder* other_video_decoder,
                 const std::string& other_custom_color_trc,
-                const bool disable_auto_filters);
+                const bool disable_auto_filters,
+                const bool use_tone_map_lut,
+                const bool verbose);
   ~VideoFilterer();
 
   void init();
@@ -39,6 +44,11 @@ class VideoFilterer : public SideAware {
 
   std::string filter_description() const;
 
+  // false unless every filter in the graph is known to keep each frame and its timestamp, using that frame alone
+  bool preserves_timing() const;
+  // the PTS a decoded frame will have after filtering, assuming the timing is preserved
+  int64_t filtered_pts(const AVFrame* decoded_frame) const;
+
   size_t src_width() const;
   size_t src_height() const;
   AVPixelFormat src_pixel_format() const;
@@ -49,11 +59,23 @@ class VideoFilterer : public SideAware {
  private:
   int init_filters(const AVCodecContext* dec_ctx, AVRational time_base);
 
+  std::string resolve_peak_luminance(const std::string& filters) const;
+
+  void apply_tone_map_lut(AVFrame* filtered_frame);
+
   const Demuxer* demuxer_;
   const VideoDecoder* video_decoder_;
   const ToneMapping tone_mapping_mode_;
+  const bool verbose_;
 
   std::string filter_description_;
+  bool preserves_timing_;
+
+  // tone-mapping chain baked into a 3D LUT instead of being part of the filter graph
+  std::string tone_map_lut_filters_;
+  std::string tone_map_lut_key_;
+  std::shared_ptr<const ToneMapLut> tone_map_lut_;
+  std::unique_ptr<RowWorkers> tone_map_lut_workers_;
 
   int width_;
   int height_;
@@ -0,0 +1,154 @@
+#include "yuv_difference.h"
+#include <algorithm>
+#include <cmath>
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+// differences of this fraction of the code range or more are shown at full intensity
+static constexpr double SATURATION_FRACTION = 1.0 / 8.0;
+
+static constexpr int BLOCK_ROWS = 32;
+
+bool YuvDifference::is_supported(const AVFrame* left_frame, const AVFrame* right_frame) {
+  if (left_frame == nullptr || right_frame == nullptr || left_frame->format != right_frame->format || left_frame->width != right_frame->width || left_frame->height != right_frame->height) {
+    return false;
+  }
+
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(left_frame->format));
+
+  if (descriptor == nullptr || (descriptor->flags & (AV_PIX_FMT_FLAG_RGB | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_BE))) {
+    return false;
+  }
+
+  // gray, or fully planar YUV (which excludes semi-planar formats such as NV12 and P010)
+  const int components = descriptor->nb_components >= 3 ? 3 : 1;
+
+  if (components == 3 && !(descriptor->flags & AV_PIX_FMT_FLAG_PLANAR)) {
+    return false;
+  }
+
+  const int depth = descriptor->comp[0].depth;
+
+  if (depth < 8 || depth > 16) {
+    return false;
+  }
+
+  for (int c = 0; c < components; c++) {
+    const AVComponentDescriptor& component = descriptor->comp[c];
+
+    if (component.plane != c || component.depth != depth || component.shift != 0 || component.offset != 0 || component.step != (depth > 8 ? 2 : 1)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void YuvDifference::update_lut(const int bit_depth, const bool output_10_bpc, const bool sqrt_response) {
+  if (bit_depth == lut_bit_depth_ && output_10_bpc == lut_output_10_bpc_ && sqrt_response == lut_sqrt_response_) {
+    return;
+  }
+
+  const int max_code = output_10_bpc ? 1023 : 255;
+  const int output_shift = output_10_bpc ? 6 : 0;
+  const double saturation = ((1 << bit_depth) - 1) * SATURATION_FRACTION;
+
+  // samples may use the whole 16 bits of their storage, however unlikely, so there is an entry for every difference
+  lut_.resize(bit_depth > 8 ? 65536 : 256);
+
+  for (size_t d = 0; d < lut_.size(); d++) {
+    const double x = std::min(1.0, static_cast<double>(d) / saturation);
+
+    lut_[d] = static_cast<uint16_t>(std::lround((sqrt_response ? std::sqrt(x) : x) * max_code) << output_shift);
+  }
+
+  lut_bit_depth_ = bit_depth;
+  lut_output_10_bpc_ = output_10_bpc;
+  lut_sqrt_response_ = sqrt_response;
+}
+
+template <typename S, typename O>
+void YuvDifference::process_rows(const AVFrame* left_frame, const AVFrame* right_frame, uint8_t* output, const size_t output_pitch, const bool luma_only, const int start_x, const RowWorkers& row_workers) const {
+  const AVPixFmtDescriptor* descriptor = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(left_frame->format));
+
+  // luma-only skips the chroma planes entirely, which also renders the difference in gray
+  const bool has_chroma = descriptor->nb_components >= 3 && !luma_only;
+  const int chroma_shift_x = descriptor->log2_chroma_w;
+  const int chroma_shift_y = descriptor->log2_chroma_h;
+
+  const int width = left_frame->width;
+  const int chroma_start_x = start_x >> chroma_shift_x;
+  const int chroma_end_x = -((-width) >> chroma_shift_x);
+
+  const uint16_t* lut = lut_.data();
+
+  row_workers.run_dynamic(
+      left_frame->height,
+      [=](const int start_row, const int end_row) {
+        // per-row absolute differences, computed in simple loops the compiler vectorizes
+        std::vector<uint16_t> luma_difference(width);
+        std::vector<uint16_t> cb_difference(has_chroma ? chroma_end_x : 0);
+        std::vector<uint16_t> cr_difference(has_chroma ? chroma_end_x : 0);
+
+        auto difference_row = [](const AVFrame* left, const AVFrame* right, const int plane, const int y, const int from_x, const int to_x, uint16_t* out) {
+          const S* row_left = reinterpret_cast<const S*>(left->data[plane] + static_cast<ptrdiff_t>(y) * left->linesize[plane]);
+          const S* row_right = reinterpret_cast<const S*>(right->data[plane] + static_cast<ptrdiff_t>(y) * right->linesize[plane]);
+
+          for (int x = from_x; x < to_x; x++) {
+            const int d = static_cast<int>(row_left[x]) - static_cast<int>(row_right[x]);
+            out[x] = static_cast<uint16_t>(d < 0 ? -d : d);
+          }
+        };
+
+        int chroma_y = -1;
+
+        for (int y = start_row; y < end_row; y++) {
+          difference_row(left_frame, right_frame, 0, y, start_x, width, luma_difference.data());
+
+          if (has_chroma && (y >> chroma_shift_y) != chroma_y) {
+            chroma_y = y >> chroma_shift_y;
+
+            difference_row(left_frame, right_frame, 1, chroma_y, chroma_start_x, chroma_end_x, cb_difference.data());
+            difference_row(left_frame, right_frame, 2, chroma_y, chroma_start_x, chroma_end_x, cr_difference.data());
+          }
+
+          O* out = reinterpret_cast<O*>(output + static_cast<ptrdiff_t>(y) * output_pitch) + start_x * 3;
+
+          if (has_chroma) {
+            for (int x = start_x; x < width; x++, out += 3) {
+              const uint16_t luma = lut[luma_difference[x]];
+
+              out[0] = static_cast<O>(std::max(luma, lut[cr_difference[x >> chroma_shift_x]]));
+              out[1] = static_cast<O>(luma);
+              out[2] = static_cast<O>(std::max(luma, lut[cb_difference[x >> chroma_shift_x]]));
+            }
+          } else {
+            for (int x = start_x; x < width; x++, out += 3) {
+              out[0] = out[1] = out[2] = static_cast<O>(lut[luma_difference[x]]);
+            }
+          }
+        }
+      },
+      BLOCK_ROWS);
+}
+
+void YuvDifference::operator()(const AVFrame* left_frame, const AVFrame* right_frame, uint8_t* output, const size_t output_pitch, const bool output_10_bpc, const bool sqrt_response, const bool luma_only, const int start_x, const RowWorkers& row_workers) {
+  const int bit_depth = av_pix_fmt_desc_get(static_cast<AVPixelFormat>(left_frame->format))->comp[0].depth;
+
+  update_lut(bit_depth, output_10_bpc, sqrt_response);
+
+  if (bit_depth > 8) {
+    if (output_10_bpc) {
+      process_rows<uint16_t, uint16_t>(left_frame, right_frame, output, output_pitch, luma_only, start_x, row_workers);
+    } else {
+      process_rows<uint16_t, uint8_t>(left_frame, right_frame, output, output_pitch, luma_only, start_x, row_workers);
+    }
+  } else {
+    if (output_10_bpc) {
+      process_rows<uint8_t, uint16_t>(left_frame, right_frame, output, output_pitch, luma_only, start_x, row_workers);
+    } else {
+      process_rows<uint8_t, uint8_t>(left_frame, right_frame, output, output_pitch, luma_only, start_x, row_workers);
+    }
+  }
+}
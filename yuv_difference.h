@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "row_workers.h"
+extern "C" {
+#include <libavutil/frame.h>
+}
+
+// Difference of two frames computed per plane in their native planar YUV (or gray) format at 8 to 16 bits, i.e.
+// before any RGB conversion. The result is mapped to packed RGB through lookup tables: luma differences are
+// shown in gray, while Cb and Cr differences light up blue and red, respectively (unless only luma is shown).
+class YuvDifference {
+ public:
+  // true if both frames share a supported pixel format and their dimensions
+  static bool is_supported(const AVFrame* left_frame, const AVFrame* right_frame);
+
+  // writes columns [start_x, width) into RGB24 output, or RGB48 output holding 10-bit codes shifted up by 6 bits;
+  // differences are mapped linearly or through a square root, which makes off-by-one errors clearly visible
+  void operator()(const AVFrame* left_frame, const AVFrame* right_frame, uint8_t* output, const size_t output_pitch, const bool output_10_bpc, const bool sqrt_response, const bool luma_only, const int start_x, const RowWorkers& row_workers);
+
+ private:
+  void update_lut(const int bit_depth, const bool output_10_bpc, const bool sqrt_response);
+
+  template <typename S, typename O>
+  void process_rows(const AVFrame* left_frame, const AVFrame* right_frame, uint8_t* output, const size_t output_pitch, const bool luma_only, const int start_x, const RowWorkers& row_workers) const;
+
+  // maps the absolute difference of two samples to an output code
+  std::vector<uint16_t> lut_;
+  int lut_bit_depth_{0};
+  bool lut_output_10_bpc_{false};
+  bool lut_sqrt_response_{false};
+};